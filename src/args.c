@@ -23,21 +23,39 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <getopt.h>
 
 
 void usage(char const *name, bool print_long)
 {
-    printf("Usage: %s [OPTION]... FILE\n", name);
+    printf("Usage: %s [OPTION]... FILE...\n", name);
     if (print_long)
     {
         puts("\
-Display GIF images.\n\
+Display GIF images.  Each FILE may be a GIF or a directory of GIFs; the\n\
+files are shown one at a time, in order.\n\
 \n\
 OPTIONS\n\
-      --help     display this help and exit\n\
-      --version  output version information and exit\n\
+      --stats       print timing statistics to stderr on exit\n\
+      --trace=FILE  write a Chrome trace-event JSON file to FILE\n\
+      --dump-frames=DIR\n\
+                    write every composited frame to DIR as a PAM image,\n\
+                      plus a manifest of frame timings, without opening\n\
+                      a window\n\
+      --y4m         stream frames to stdout as YUV4MPEG2 video, without\n\
+                      opening a window\n\
+      --fps=N       frame rate for --y4m output (default 50)\n\
+      --vsync       show frames on the display refresh they fall due in\n\
+      --renderer=NAME\n\
+                    'default' for SDL's choice of renderer, or 'software'\n\
+                      for the software renderer with a dedicated scaler\n\
+      --montage     start with a grid of thumbnails of every FILE\n\
+      --cache       keep composited frames on disk, so files reopen\n\
+                      without being decoded again\n\
+      --help        display this help and exit\n\
+      --version     output version information and exit\n\
 \n\
 Report bugs to: <https://github.com/Treecase/gifview/issues>\n\
 pkg home page: <https://github.com/Treecase/gifview>\
@@ -58,15 +76,38 @@ There is NO WARRANTY, to the extent permitted by law.\
 ");
 }
 
-char const *parse_args(int argc, char *argv[])
+struct Arguments parse_args(int argc, char *argv[])
 {
     static char const *const short_options = "";
     static struct option const long_options[] = {
         {"help",    no_argument, NULL, 0},
         {"version", no_argument, NULL, 0},
+        {"stats",   no_argument, NULL, 0},
+        {"trace",   required_argument, NULL, 0},
+        {"dump-frames", required_argument, NULL, 0},
+        {"y4m",     no_argument, NULL, 0},
+        {"fps",     required_argument, NULL, 0},
+        {"vsync",   no_argument, NULL, 0},
+        {"renderer", required_argument, NULL, 0},
+        {"montage", no_argument, NULL, 0},
+        {"cache",   no_argument, NULL, 0},
         {NULL, 0, NULL, 0}
     };
 
+    struct Arguments args = {
+        .files = NULL,
+        .file_count = 0,
+        .stats = false,
+        .trace_file = NULL,
+        .dump_dir = NULL,
+        .y4m = false,
+        .fps = 50,
+        .vsync = false,
+        .software = false,
+        .montage = false,
+        .cache = false,
+    };
+
     bool bad_args = false;
     int c, long_opt_ptr;
     while (
@@ -91,6 +132,67 @@ char const *parse_args(int argc, char *argv[])
                 version();
                 exit(EXIT_SUCCESS);
                 break;
+
+            /* --stats */
+            case 2:
+                args.stats = true;
+                break;
+
+            /* --trace */
+            case 3:
+                args.trace_file = optarg;
+                break;
+
+            /* --dump-frames */
+            case 4:
+                args.dump_dir = optarg;
+                break;
+
+            /* --y4m */
+            case 5:
+                args.y4m = true;
+                break;
+
+            /* --fps */
+            case 6:{
+                char *end = NULL;
+                unsigned long const fps = strtoul(optarg, &end, 10);
+                if (*end != '\0' || fps < 1 || fps > 1000)
+                {
+                    fprintf(stderr, "--fps must be a number from 1 to 1000\n");
+                    bad_args = true;
+                }
+                args.fps = fps;
+                break;}
+
+            /* --vsync */
+            case 7:
+                args.vsync = true;
+                break;
+
+            /* --renderer */
+            case 8:
+                if (strcmp(optarg, "software") == 0)
+                    args.software = true;
+                else if (strcmp(optarg, "default") == 0)
+                    args.software = false;
+                else
+                {
+                    fprintf(
+                        stderr, "--renderer must be 'default' or 'software'\n");
+                    bad_args = true;
+                }
+                break;
+
+            /* --montage */
+            case 9:
+                args.montage = true;
+                break;
+
+            /* --cache */
+            case 10:
+                args.cache = true;
+                break;
             }
             break;
 
@@ -112,11 +214,7 @@ char const *parse_args(int argc, char *argv[])
         usage(argv[0], false);
         exit(EXIT_FAILURE);
     }
-    else if (optind + 1 != argc)
-    {
-        /* TODO: Handle this properly instead of just exiting. */
-        usage(argv[0], false);
-        exit(EXIT_FAILURE);
-    }
-    return argv[optind];
+    args.files = argv + optind;
+    args.file_count = argc - optind;
+    return args;
 }
@@ -23,6 +23,34 @@
 #include <stdbool.h>
 
 
+/** Parsed command-line arguments. */
+struct Arguments
+{
+    /** Paths to the GIFs (or directories of GIFs) to display. */
+    char **files;
+    /** Number of paths in FILES. */
+    int file_count;
+    /** Print performance statistics on exit. */
+    bool stats;
+    /** File to write a trace to, or NULL. */
+    char const *trace_file;
+    /** Directory to write composited frames to instead of displaying them,
+     * or NULL. */
+    char const *dump_dir;
+    /** Stream frames to stdout as YUV4MPEG2 instead of displaying them. */
+    bool y4m;
+    /** Frame rate for y4m output. */
+    unsigned fps;
+    /** Synchronize presents to the display refresh. */
+    bool vsync;
+    /** Draw with SDL's software renderer and GIFView's own frame scaler. */
+    bool software;
+    /** Start with the thumbnail grid showing. */
+    bool montage;
+    /** Keep composited frames in the on-disk frame cache. */
+    bool cache;
+};
+
 /** Print GIFView help information. */
 void usage(char const *name, bool print_long);
 
@@ -30,7 +58,7 @@ void usage(char const *name, bool print_long);
 void version(void);
 
 /** Parse command-line arguments. */
-char const *parse_args(int argc, char *argv[]);
+struct Arguments parse_args(int argc, char *argv[]);
 
 
 #endif /* GIFVIEW_ARGS_H */
@@ -0,0 +1,529 @@
+/*
+ * gifview-bench - GIFView decode benchmark.
+ * bench.c -- Headless end-to-end decode/composite benchmark.
+ *
+ * Runs gif_from_file and frame compositing over a corpus of GIF files, then
+ * reports per-file and aggregate throughput/latency as JSON.  Optionally
+ * compares the aggregate numbers against a previously saved run.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "config.h"
+#include "sdlgif.h"
+#include "util.h"
+#include "gif/gif.h"
+#include "stats/stats.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <dirent.h>
+#include <getopt.h>
+#include <sys/stat.h>
+#if !_WIN32
+#include <sys/resource.h>
+#endif
+
+#include <SDL2/SDL.h>
+#include <SDL_ttf.h>
+
+
+/** Per-file benchmark results. */
+struct FileResult
+{
+    char *path;
+    /** File size in bytes. */
+    size_t bytes;
+    /** Number of composited frames. */
+    size_t frames;
+    /** Seconds taken by each iteration (parse + composite). */
+    double *latencies;
+    /** Seconds spent in gif_from_file, summed over all iterations. */
+    double parse_time;
+    /** Seconds spent compositing, summed over all iterations. */
+    double composite_time;
+};
+
+/** Benchmark options. */
+struct Options
+{
+    size_t iterations;
+    char const *output;
+    char const *baseline;
+    /** Allowed slowdown (in percent) before a baseline comparison fails. */
+    double threshold;
+};
+
+
+/** Aggregate metrics that get compared against the baseline. */
+static char const *const COMPARED_METRICS[] = {
+    "mb_per_s", "frames_per_s", "p50_ms", "p99_ms", "peak_rss_kb",
+    "peak_pixels_kb", "peak_surfaces_kb"
+};
+
+/** Whether a bigger value of the corresponding COMPARED_METRICS is better. */
+static bool const COMPARED_METRICS_HIGHER_IS_BETTER[] = {
+    true, true, false, false, false, false, false
+};
+
+
+void usage(char const *name, bool print_long)
+{
+    printf("Usage: %s [OPTION]... PATH...\n", name);
+    if (print_long)
+    {
+        puts("\
+Benchmark GIF decoding and frame compositing over the GIF files in PATHs.\n\
+Directories are searched recursively for files ending in '.gif'.\n\
+\n\
+OPTIONS\n\
+  -n, --iterations=N   decode each file N times (default 3)\n\
+  -o, --output=FILE    write the JSON report to FILE instead of stdout\n\
+  -b, --baseline=FILE  compare results against a previously saved report\n\
+  -t, --threshold=PCT  fail if any metric is PCT percent worse than the\n\
+                         baseline (default 5)\n\
+      --help           display this help and exit\
+");
+    }
+    else
+        printf("Try '%s --help' for more information.\n", name);
+}
+
+
+/** Get time in seconds from an arbitrary fixed point. */
+double now(void)
+{
+    return (
+        (double)SDL_GetPerformanceCounter()
+        / (double)SDL_GetPerformanceFrequency());
+}
+
+/** Get the peak resident set size of the process, in kilobytes. */
+long peak_rss_kb(void)
+{
+#if _WIN32
+    return 0;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+        return 0;
+    return usage.ru_maxrss;
+#endif
+}
+
+int compare_doubles(void const *a, void const *b)
+{
+    double const x = *(double const *)a, y = *(double const *)b;
+    return (x > y) - (x < y);
+}
+
+int compare_strings(void const *a, void const *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/** Nearest-rank percentile P of the N sorted values in SORTED. */
+double percentile(double const *sorted, size_t n, double p)
+{
+    if (n == 0)
+        return 0.0;
+    size_t rank = (size_t)(p / 100.0 * n + 0.5);
+    if (rank < 1)
+        rank = 1;
+    if (rank > n)
+        rank = n;
+    return sorted[rank - 1];
+}
+
+/** Returns true if NAME ends with ".gif" (case insensitive). */
+bool has_gif_extension(char const *name)
+{
+    size_t const len = strlen(name);
+    return len >= 4 && SDL_strcasecmp(name + len - 4, ".gif") == 0;
+}
+
+
+/** Growable array of paths. */
+struct PathList
+{
+    size_t count, allocated;
+    char **paths;
+};
+
+void pathlist_append(struct PathList *list, char *path)
+{
+    if (list->count == list->allocated)
+    {
+        list->allocated = list->allocated? 2 * list->allocated : 64;
+        list->paths = realloc(
+            list->paths, list->allocated * sizeof(*list->paths));
+    }
+    list->paths[list->count++] = path;
+}
+
+/**
+ * Add PATH to LIST.  If PATH is a directory, its GIF files are added instead,
+ * recursively.
+ */
+void collect_paths(struct PathList *list, char const *path)
+{
+    struct stat st;
+    if (stat(path, &st) != 0)
+    {
+        error("%s: %s\n", path, strerror(errno));
+        return;
+    }
+    if (!S_ISDIR(st.st_mode))
+    {
+        pathlist_append(list, estrdup(path));
+        return;
+    }
+
+    DIR *dir = opendir(path);
+    if (!dir)
+    {
+        error("%s: %s\n", path, strerror(errno));
+        return;
+    }
+    struct PathList entries = {0, 0, NULL};
+    for (struct dirent *ent; (ent = readdir(dir)) != NULL;)
+    {
+        if (ent->d_name[0] == '.')
+            continue;
+        char *child = NULL;
+        sprintfa(&child, "%s/%s", path, ent->d_name);
+        if (stat(child, &st) == 0
+            && (S_ISDIR(st.st_mode) || has_gif_extension(ent->d_name)))
+            pathlist_append(&entries, child);
+        else
+            free(child);
+    }
+    closedir(dir);
+
+    /* Sort so that reports from different runs line up. */
+    qsort(entries.paths, entries.count, sizeof(*entries.paths),
+        compare_strings);
+    for (size_t i = 0; i < entries.count; ++i)
+    {
+        collect_paths(list, entries.paths[i]);
+        free(entries.paths[i]);
+    }
+    free(entries.paths);
+}
+
+
+/** FrameCallback which counts the frames it's given. */
+void count_frame(SDL_Surface *frame, size_t delay, void *userdata)
+{
+    size_t *count = userdata;
+    (*count)++;
+}
+
+/** Benchmark a single file. */
+struct FileResult bench_file(char const *path, size_t iterations)
+{
+    struct FileResult result = {
+        .path = estrdup(path),
+        .bytes = 0,
+        .frames = 0,
+        .latencies = calloc(iterations, sizeof(double)),
+        .parse_time = 0.0,
+        .composite_time = 0.0,
+    };
+    struct stat st;
+    if (stat(path, &st) == 0)
+        result.bytes = st.st_size;
+
+    for (size_t i = 0; i < iterations; ++i)
+    {
+        double const start = now();
+        GIF gif = gif_from_file(path);
+        double const parsed = now();
+        size_t frames = 0;
+        sdlgif_composite_frames(gif, count_frame, &frames);
+        double const composited = now();
+        gif_free(gif);
+
+        result.frames = frames;
+        result.parse_time += parsed - start;
+        result.composite_time += composited - parsed;
+        result.latencies[i] = composited - start;
+    }
+    return result;
+}
+
+
+/** Print S to OUT as a JSON string literal. */
+void json_print_string(FILE *out, char const *s)
+{
+    fputc('"', out);
+    for (; *s; ++s)
+    {
+        unsigned char const c = *s;
+        if (c == '"' || c == '\\')
+            fprintf(out, "\\%c", c);
+        else if (c < 0x20)
+            fprintf(out, "\\u%.4x", c);
+        else
+            fputc(c, out);
+    }
+    fputc('"', out);
+}
+
+/**
+ * Find the last occurrence of "KEY": in TEXT and parse the number following
+ * it into VALUE.  The aggregate object is written last, so for reports made by
+ * this program this finds the aggregate value.  Returns false if KEY wasn't
+ * found.
+ */
+bool json_find_number(char const *text, char const *key, double *value)
+{
+    char *needle = NULL;
+    sprintfa(&needle, "\"%s\":", key);
+    char const *found = NULL;
+    for (char const *p = text; (p = strstr(p, needle)) != NULL; ++p)
+        found = p;
+    if (found)
+        *value = strtod(found + strlen(needle), NULL);
+    free(needle);
+    return found != NULL;
+}
+
+/** Read the whole of PATH into a newly-allocated string. */
+char *read_file(char const *path)
+{
+    FILE *file = fopen(path, "rb");
+    if (!file)
+        return NULL;
+    size_t size = 0, allocated = 4096;
+    char *text = malloc(allocated);
+    size_t n;
+    while ((n = fread(text + size, 1, allocated - size - 1, file)) > 0)
+    {
+        size += n;
+        if (size + 1 == allocated)
+        {
+            allocated *= 2;
+            text = realloc(text, allocated);
+        }
+    }
+    fclose(file);
+    text[size] = '\0';
+    return text;
+}
+
+
+int main(int argc, char *argv[])
+{
+    static char const *const short_options = "n:o:b:t:";
+    static struct option const long_options[] = {
+        {"iterations",  required_argument, NULL, 'n'},
+        {"output",      required_argument, NULL, 'o'},
+        {"baseline",    required_argument, NULL, 'b'},
+        {"threshold",   required_argument, NULL, 't'},
+        {"help",        no_argument,       NULL, 'h'},
+        {NULL, 0, NULL, 0}
+    };
+
+    struct Options opts = {
+        .iterations = 3,
+        .output = NULL,
+        .baseline = NULL,
+        .threshold = 5.0,
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, short_options, long_options, NULL))
+        != -1)
+    {
+        switch (c)
+        {
+        case 'n':
+            opts.iterations = strtoul(optarg, NULL, 10);
+            if (opts.iterations == 0)
+                fatal("--iterations must be at least 1\n");
+            break;
+        case 'o':
+            opts.output = optarg;
+            break;
+        case 'b':
+            opts.baseline = optarg;
+            break;
+        case 't':
+            opts.threshold = strtod(optarg, NULL);
+            break;
+        case 'h':
+            usage(argv[0], true);
+            exit(EXIT_SUCCESS);
+            break;
+        default:
+            usage(argv[0], false);
+            exit(EXIT_FAILURE);
+            break;
+        }
+    }
+    if (optind >= argc)
+    {
+        usage(argv[0], false);
+        exit(EXIT_FAILURE);
+    }
+
+    struct PathList paths = {0, 0, NULL};
+    for (int i = optind; i < argc; ++i)
+        collect_paths(&paths, argv[i]);
+    if (paths.count == 0)
+        fatal("No GIF files found\n");
+
+    /* Plain Text graphics are rendered with SDL_ttf, but no video is needed. */
+    if (TTF_Init() != 0)
+        fatal("TTF_Init failed: %s\n", TTF_GetError());
+
+    struct FileResult *results = calloc(paths.count, sizeof(*results));
+    size_t const samples_count = paths.count * opts.iterations;
+    double *samples = malloc(samples_count * sizeof(*samples));
+    size_t total_bytes = 0, total_frames = 0;
+    double total_time = 0.0;
+    for (size_t i = 0; i < paths.count; ++i)
+    {
+        results[i] = bench_file(paths.paths[i], opts.iterations);
+        memcpy(
+            samples + i * opts.iterations,
+            results[i].latencies,
+            opts.iterations * sizeof(*samples));
+        total_bytes += results[i].bytes * opts.iterations;
+        total_frames += results[i].frames * opts.iterations;
+        for (size_t j = 0; j < opts.iterations; ++j)
+            total_time += results[i].latencies[j];
+    }
+    qsort(samples, samples_count, sizeof(*samples), compare_doubles);
+
+    double aggregate[] = {
+        total_bytes / 1e6 / total_time,
+        total_frames / total_time,
+        1000.0 * percentile(samples, samples_count, 50.0),
+        1000.0 * percentile(samples, samples_count, 99.0),
+        peak_rss_kb(),
+        stats_memory_usage(STATS_MEMORY_PIXELS).peak / 1024.0,
+        stats_memory_usage(STATS_MEMORY_SURFACES).peak / 1024.0,
+    };
+    int64_t const leaked = (
+        stats_memory_usage(STATS_MEMORY_PIXELS).current
+        + stats_memory_usage(STATS_MEMORY_SURFACES).current);
+    if (leaked != 0)
+        warn("%lld bytes of pixels and surfaces were never freed\n",
+            (long long)leaked);
+    size_t const metrics_count = (
+        sizeof(COMPARED_METRICS) / sizeof(*COMPARED_METRICS));
+
+    FILE *out = stdout;
+    if (opts.output)
+    {
+        out = fopen(opts.output, "w");
+        if (!out)
+            fatal("%s: %s\n", opts.output, strerror(errno));
+    }
+
+    fprintf(out, "{\n  \"version\": \"%s\",\n", GIFVIEW_VERSION);
+    fprintf(out, "  \"iterations\": %zu,\n  \"files\": [\n", opts.iterations);
+    for (size_t i = 0; i < paths.count; ++i)
+    {
+        struct FileResult const *r = &results[i];
+        qsort(r->latencies, opts.iterations, sizeof(double), compare_doubles);
+        double file_time = 0.0;
+        for (size_t j = 0; j < opts.iterations; ++j)
+            file_time += r->latencies[j];
+
+        fputs("    {\"path\": ", out);
+        json_print_string(out, r->path);
+        fprintf(out,
+            ", \"bytes\": %zu, \"frames\": %zu"
+            ", \"parse_ms\": %.3f, \"composite_ms\": %.3f"
+            ", \"mb_per_s\": %.3f, \"frames_per_s\": %.3f"
+            ", \"p50_ms\": %.3f, \"p99_ms\": %.3f}%s\n",
+            r->bytes, r->frames,
+            1000.0 * r->parse_time / opts.iterations,
+            1000.0 * r->composite_time / opts.iterations,
+            r->bytes * opts.iterations / 1e6 / file_time,
+            r->frames * opts.iterations / file_time,
+            1000.0 * percentile(r->latencies, opts.iterations, 50.0),
+            1000.0 * percentile(r->latencies, opts.iterations, 99.0),
+            i + 1 < paths.count? "," : "");
+    }
+    fputs("  ],\n", out);
+
+    /* Compare against the baseline before writing the aggregate, so the
+     * aggregate object stays last in the report. */
+    bool regressed = false;
+    char *baseline = opts.baseline? read_file(opts.baseline) : NULL;
+    if (opts.baseline && !baseline)
+        error("%s: %s\n", opts.baseline, strerror(errno));
+    if (baseline)
+    {
+        fputs("  \"baseline\": {", out);
+        bool first = true;
+        for (size_t i = 0; i < metrics_count; ++i)
+        {
+            double base;
+            if (!json_find_number(baseline, COMPARED_METRICS[i], &base)
+                || base == 0.0)
+                continue;
+            double change = 100.0 * (aggregate[i] - base) / base;
+            if (!COMPARED_METRICS_HIGHER_IS_BETTER[i])
+                change = -change;
+            bool const worse = change < -opts.threshold;
+            regressed = regressed || worse;
+            fprintf(out,
+                "%s\n    \"%s\": {\"baseline\": %.3f, \"current\": %.3f"
+                ", \"improvement_pct\": %.2f, \"regressed\": %s}",
+                first? "" : ",", COMPARED_METRICS[i], base, aggregate[i],
+                change, worse? "true" : "false");
+            first = false;
+            fprintf(stderr, "%-13s %12.3f -> %12.3f  (%+.2f%%)%s\n",
+                COMPARED_METRICS[i], base, aggregate[i], change,
+                worse? "  REGRESSION" : "");
+        }
+        fputs("\n  },\n", out);
+        free(baseline);
+    }
+
+    fprintf(out,
+        "  \"aggregate\": {\"files\": %zu, \"bytes\": %zu, \"frames\": %zu,"
+        " \"seconds\": %.6f",
+        paths.count, total_bytes, total_frames, total_time);
+    for (size_t i = 0; i < metrics_count; ++i)
+        fprintf(out, ", \"%s\": %.3f", COMPARED_METRICS[i], aggregate[i]);
+    fputs("}\n}\n", out);
+    if (out != stdout)
+        fclose(out);
+
+    for (size_t i = 0; i < paths.count; ++i)
+    {
+        free(results[i].path);
+        free(results[i].latencies);
+        free(paths.paths[i]);
+    }
+    free(results);
+    free(samples);
+    free(paths.paths);
+    sdlgif_quit();
+    TTF_Quit();
+
+    return regressed? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,378 @@
+/*
+ * gifview-gen - Synthetic GIF generator.
+ * gen.c -- Generate GIFs with controlled structure for benchmarking.
+ *
+ * Output is streamed a frame at a time, so huge canvases and frame counts only
+ * cost as much memory as a single frame.  The generator uses its own PRNG, so a
+ * given seed produces the same file on every platform.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "util.h"
+#include "gif/gif.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <getopt.h>
+
+
+/** Pixel content patterns. */
+enum Pattern
+{
+    /** Uniformly random indices.  Worst case for LZW. */
+    PATTERN_NOISE,
+    /** Diagonal gradient. */
+    PATTERN_GRADIENT,
+    /** Vertical stripes, 8 pixels wide. */
+    PATTERN_STRIPES,
+    /** A single color.  Best case for LZW. */
+    PATTERN_FLAT,
+};
+
+static char const *const PATTERN_NAMES[] = {
+    "noise", "gradient", "stripes", "flat"
+};
+
+/** Generator options. */
+struct Options
+{
+    uint16_t width, height;
+    size_t frames;
+    size_t colors;
+    bool local_tables;
+    unsigned interlace_percent;
+    char const *disposals;
+    enum Pattern pattern;
+    bool partial;
+    bool transparent;
+    uint16_t delay;
+    bool loop;
+    uint64_t seed;
+    char const *output;
+};
+
+
+void usage(char const *name, bool print_long)
+{
+    printf("Usage: %s [OPTION]... FILE\n", name);
+    if (print_long)
+    {
+        puts("\
+Generate a synthetic GIF file for benchmarking.\n\
+\n\
+OPTIONS\n\
+  -W, --width=N         canvas width (default 256)\n\
+  -H, --height=N        canvas height (default 256)\n\
+  -f, --frames=N        number of frames (default 16)\n\
+  -c, --colors=N        color table size, 2-256 (default 256)\n\
+  -l, --local-tables    give every frame its own local color table\n\
+  -i, --interlace=PCT   interlace PCT percent of the frames (default 0)\n\
+  -d, --disposal=LIST   cycle through the disposal methods in LIST,\n\
+                          eg. \"0123\" (default \"1\")\n\
+  -p, --pattern=NAME    pixel content: noise, gradient, stripes or flat\n\
+                          (default noise)\n\
+  -r, --partial         frames after the first cover random sub-rectangles\n\
+  -t, --transparent     make color index 0 transparent\n\
+      --delay=N         frame delay in 100ths of a second (default 4)\n\
+      --loop            add a NETSCAPE2.0 looping extension\n\
+  -s, --seed=N          random seed (default 1)\n\
+      --help            display this help and exit\
+");
+    }
+    else
+        printf("Try '%s --help' for more information.\n", name);
+}
+
+
+/** xorshift64* PRNG. */
+uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * UINT64_C(2685821657736338717);
+}
+
+/** Random number in [0, N). */
+size_t random_below(uint64_t *state, size_t n)
+{
+    return (next_random(state) >> 16) % n;
+}
+
+/** Make a color table with COLORS random colors. */
+struct GIF_ColorTable *random_color_table(uint64_t *rng, size_t colors)
+{
+    struct GIF_ColorTable *table = malloc(sizeof(*table));
+    table->sorted = false;
+    table->size = colors;
+    table->colors = malloc(3 * colors);
+    for (size_t i = 0; i < 3 * colors; ++i)
+        table->colors[i] = next_random(rng) >> 56;
+    return table;
+}
+
+/** Fill IMAGE's pixels with the pattern for frame number FRAME. */
+void fill_pixels(
+    struct GIF_Image *image, struct Options const *opts, size_t frame,
+    uint64_t *rng)
+{
+    size_t const colors = opts->colors;
+    uint8_t *p = image->pixels;
+    for (size_t y = 0; y < image->height; ++y)
+    {
+        size_t const canvas_y = y + image->top;
+        for (size_t x = 0; x < image->width; ++x)
+        {
+            size_t const canvas_x = x + image->left;
+            switch (opts->pattern)
+            {
+            case PATTERN_NOISE:
+                *p++ = random_below(rng, colors);
+                break;
+            case PATTERN_GRADIENT:
+                *p++ = (
+                    (canvas_x + canvas_y + frame) * colors
+                    / ((size_t)opts->width + opts->height)) % colors;
+                break;
+            case PATTERN_STRIPES:
+                *p++ = ((canvas_x + frame) / 8) % colors;
+                break;
+            case PATTERN_FLAT:
+                *p++ = frame % colors;
+                break;
+            }
+        }
+    }
+}
+
+/** Parse a non-negative integer option, dying if it's out of range. */
+unsigned long parse_number(
+    char const *name, char const *arg, unsigned long min, unsigned long max)
+{
+    char *end = NULL;
+    errno = 0;
+    unsigned long const value = strtoul(arg, &end, 10);
+    if (errno || *end != '\0' || value < min || value > max)
+        fatal("--%s must be a number from %lu to %lu\n", name, min, max);
+    return value;
+}
+
+
+int main(int argc, char *argv[])
+{
+    static char const *const short_options = "W:H:f:c:li:d:p:rts:";
+    enum {OPT_DELAY = 256, OPT_LOOP, OPT_HELP};
+    static struct option const long_options[] = {
+        {"width",           required_argument, NULL, 'W'},
+        {"height",          required_argument, NULL, 'H'},
+        {"frames",          required_argument, NULL, 'f'},
+        {"colors",          required_argument, NULL, 'c'},
+        {"local-tables",    no_argument,       NULL, 'l'},
+        {"interlace",       required_argument, NULL, 'i'},
+        {"disposal",        required_argument, NULL, 'd'},
+        {"pattern",         required_argument, NULL, 'p'},
+        {"partial",         no_argument,       NULL, 'r'},
+        {"transparent",     no_argument,       NULL, 't'},
+        {"seed",            required_argument, NULL, 's'},
+        {"delay",           required_argument, NULL, OPT_DELAY},
+        {"loop",            no_argument,       NULL, OPT_LOOP},
+        {"help",            no_argument,       NULL, OPT_HELP},
+        {NULL, 0, NULL, 0}
+    };
+
+    struct Options opts = {
+        .width = 256,
+        .height = 256,
+        .frames = 16,
+        .colors = 256,
+        .local_tables = false,
+        .interlace_percent = 0,
+        .disposals = "1",
+        .pattern = PATTERN_NOISE,
+        .partial = false,
+        .transparent = false,
+        .delay = 4,
+        .loop = false,
+        .seed = 1,
+        .output = NULL,
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, short_options, long_options, NULL))
+        != -1)
+    {
+        switch (c)
+        {
+        case 'W':
+            opts.width = parse_number("width", optarg, 1, UINT16_MAX);
+            break;
+        case 'H':
+            opts.height = parse_number("height", optarg, 1, UINT16_MAX);
+            break;
+        case 'f':
+            opts.frames = parse_number("frames", optarg, 1, SIZE_MAX);
+            break;
+        case 'c':
+            opts.colors = parse_number("colors", optarg, 2, 256);
+            break;
+        case 'l':
+            opts.local_tables = true;
+            break;
+        case 'i':
+            opts.interlace_percent = parse_number("interlace", optarg, 0, 100);
+            break;
+        case 'd':
+            opts.disposals = optarg;
+            if (!*optarg || strspn(optarg, "0123") != strlen(optarg))
+                fatal("--disposal must be a list of the digits 0-3\n");
+            break;
+        case 'p':{
+            size_t const count = sizeof(PATTERN_NAMES) / sizeof(*PATTERN_NAMES);
+            size_t i = 0;
+            while (i < count && strcmp(optarg, PATTERN_NAMES[i]) != 0)
+                i++;
+            if (i == count)
+                fatal("unknown pattern '%s'\n", optarg);
+            opts.pattern = i;
+            break;}
+        case 'r':
+            opts.partial = true;
+            break;
+        case 't':
+            opts.transparent = true;
+            break;
+        case 's':
+            opts.seed = strtoull(optarg, NULL, 10);
+            break;
+        case OPT_DELAY:
+            opts.delay = parse_number("delay", optarg, 0, UINT16_MAX);
+            break;
+        case OPT_LOOP:
+            opts.loop = true;
+            break;
+        case OPT_HELP:
+            usage(argv[0], true);
+            exit(EXIT_SUCCESS);
+            break;
+        default:
+            usage(argv[0], false);
+            exit(EXIT_FAILURE);
+            break;
+        }
+    }
+    if (optind + 1 != argc)
+    {
+        usage(argv[0], false);
+        exit(EXIT_FAILURE);
+    }
+    opts.output = argv[optind];
+
+    /* xorshift gets stuck at 0. */
+    uint64_t rng = opts.seed? opts.seed : 1;
+
+    GIF gif = {
+        .version = GIF_Version_89a,
+        .width = opts.width,
+        .height = opts.height,
+        .bg_color_index = 0,
+        .color_resolution = 7,
+        .pixel_aspect_ratio = 0,
+        .global_color_table = (
+            opts.local_tables? NULL : random_color_table(&rng, opts.colors)),
+        .graphics = NULL,
+        .comments = NULL,
+        .app_extensions = NULL,
+    };
+    if (opts.loop)
+    {
+        /* Sub-block 1 (loop count), repeat forever. */
+        static uint8_t netscape_data[3] = {1, 0, 0};
+        struct GIF_ApplicationExt *netscape = malloc(sizeof(*netscape));
+        memcpy(netscape->appid, "NETSCAPE", 8);
+        memcpy(netscape->auth_code, "2.0", 3);
+        netscape->data_size = sizeof(netscape_data);
+        netscape->data = malloc(sizeof(netscape_data));
+        memcpy(netscape->data, netscape_data, sizeof(netscape_data));
+        linkedlist_append(&gif.app_extensions, linkedlist_new(netscape));
+    }
+
+    errno = 0;
+    FILE *file = fopen(opts.output, "wb");
+    if (file == NULL)
+        fatal("fopen: %s\n", strerror(errno));
+    gif_write_begin(file, &gif);
+
+    size_t const disposals_count = strlen(opts.disposals);
+    for (size_t i = 0; i < opts.frames; ++i)
+    {
+        struct GIF_GraphicExt gext = {
+            .disposal_method = opts.disposals[i % disposals_count] - '0',
+            .user_input_flag = false,
+            .transparent_color_flag = opts.transparent,
+            .delay_time = opts.delay,
+            .transparent_color_idx = 0,
+        };
+
+        struct GIF_Image image = {
+            .left = 0,
+            .top = 0,
+            .width = opts.width,
+            .height = opts.height,
+            .interlace_flag = random_below(&rng, 100) < opts.interlace_percent,
+            .color_table = gif.global_color_table,
+        };
+        if (opts.partial && i > 0)
+        {
+            image.width = 1 + random_below(&rng, opts.width);
+            image.height = 1 + random_below(&rng, opts.height);
+            image.left = random_below(&rng, opts.width - image.width + 1);
+            image.top = random_below(&rng, opts.height - image.height + 1);
+        }
+        if (opts.local_tables)
+            image.color_table = random_color_table(&rng, opts.colors);
+        image.size = (size_t)image.width * image.height;
+        image.pixels = malloc(image.size);
+        fill_pixels(&image, &opts, i, &rng);
+
+        struct GIF_Graphic graphic = {
+            .extension = &gext,
+            .is_img = true,
+            .img = image,
+        };
+        gif_write_graphic(file, &gif, &graphic);
+
+        if (opts.local_tables)
+        {
+            free(image.color_table->colors);
+            free(image.color_table);
+        }
+        free(image.pixels);
+    }
+
+    gif_write_end(file);
+    errno = 0;
+    if (fclose(file))
+        fatal("fclose: %s\n", strerror(errno));
+
+    gif_free(gif);
+    return EXIT_SUCCESS;
+}
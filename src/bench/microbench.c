@@ -0,0 +1,638 @@
+/*
+ * gifview-microbench - GIFView kernel microbenchmarks.
+ * microbench.c -- Isolated timings of the decoder's inner loops.
+ *
+ * Each benchmark is calibrated once to find an iteration count that runs for
+ * at least --min-time seconds, then timed over several repetitions with that
+ * same count.  The median repetition is reported, normalized per input byte
+ * and per output pixel.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "util.h"
+#include "mip.h"
+#include "scale.h"
+#include "yuv.h"
+#include "gif/gif.h"
+#include "gif/lzw.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <getopt.h>
+
+#include <SDL2/SDL.h>
+
+
+/** Number of timed repetitions per benchmark. */
+static size_t const REPETITIONS = 7;
+
+
+/** A single benchmark case. */
+struct Benchmark
+{
+    char *name;
+    /** Run the kernel once on DATA. */
+    void (*run)(void *data);
+    /** Free DATA. */
+    void (*free)(void *data);
+    void *data;
+    /** Bytes of input consumed per run, or 0 if not meaningful. */
+    size_t bytes;
+    /** Pixels produced per run, or 0 if not meaningful. */
+    size_t pixels;
+};
+
+/** Benchmark options. */
+struct Options
+{
+    double min_time;
+    size_t iterations;
+    char const *filter;
+};
+
+/** Sink for kernel results, so the compiler can't optimize the kernels away. */
+static volatile uintptr_t sink;
+
+
+void usage(char const *name, bool print_long)
+{
+    printf("Usage: %s [OPTION]...\n", name);
+    if (print_long)
+    {
+        puts("\
+Time the GIF decoder's inner kernels in isolation.\n\
+\n\
+OPTIONS\n\
+  -m, --min-time=SECS   calibrate iteration counts to run for at least SECS\n\
+                          seconds per repetition (default 0.1)\n\
+  -n, --iterations=N    use exactly N iterations per repetition, for\n\
+                          comparing runs like-for-like\n\
+  -f, --filter=TEXT     only run benchmarks whose names contain TEXT\n\
+      --help            display this help and exit\
+");
+    }
+    else
+        printf("Try '%s --help' for more information.\n", name);
+}
+
+
+/** Get time in seconds from an arbitrary fixed point. */
+double now(void)
+{
+    return (
+        (double)SDL_GetPerformanceCounter()
+        / (double)SDL_GetPerformanceFrequency());
+}
+
+int compare_doubles(void const *a, void const *b)
+{
+    double const x = *(double const *)a, y = *(double const *)b;
+    return (x > y) - (x < y);
+}
+
+/** xorshift64* PRNG, so inputs are the same on every platform. */
+uint64_t next_random(uint64_t *state)
+{
+    *state ^= *state >> 12;
+    *state ^= *state << 25;
+    *state ^= *state >> 27;
+    return *state * UINT64_C(2685821657736338717);
+}
+
+/** Fill SIZE bytes of OUT with random values less than 2^BITS. */
+void fill_random(uint8_t *out, size_t size, unsigned bits, uint64_t *rng)
+{
+    for (size_t i = 0; i < size; ++i)
+        out[i] = (next_random(rng) >> 56) & ((1u << bits) - 1);
+}
+
+
+/* ===[ bitstream_read ]=== */
+struct BitstreamData
+{
+    size_t code_size;
+    size_t size;
+    uint8_t *bytes;
+};
+
+void bitstream_run(void *data)
+{
+    struct BitstreamData const *d = data;
+    struct Bitstream stream = {
+        .stream = d->bytes, .size = d->size, .byte = 0, .bit = 0
+    };
+    size_t const codes = d->size * 8 / d->code_size;
+    unsigned int acc = 0;
+    for (size_t i = 0; i < codes; ++i)
+        acc += bitstream_read(d->code_size, &stream);
+    sink = acc;
+}
+
+void bitstream_free(void *data)
+{
+    struct BitstreamData *d = data;
+    free(d->bytes);
+    free(d);
+}
+
+struct Benchmark bitstream_benchmark(size_t code_size, uint64_t *rng)
+{
+    struct BitstreamData *d = malloc(sizeof(*d));
+    d->code_size = code_size;
+    d->size = 64 * 1024;
+    d->bytes = malloc(d->size);
+    fill_random(d->bytes, d->size, 8, rng);
+
+    struct Benchmark b = {
+        .run = bitstream_run,
+        .free = bitstream_free,
+        .data = d,
+        .bytes = d->size,
+        .pixels = 0,
+    };
+    sprintfa(&b.name, "bitstream_read/%zu-bit", code_size);
+    return b;
+}
+
+
+/* ===[ unlzw ]=== */
+struct UnlzwData
+{
+    size_t min_code_size;
+    uint8_t *compressed;
+    size_t size;
+};
+
+void unlzw_run(void *data)
+{
+    struct UnlzwData const *d = data;
+    uint8_t *out = NULL;
+    sink = unlzw(d->min_code_size, d->compressed, d->size, &out);
+    free(out);
+}
+
+void unlzw_free(void *data)
+{
+    struct UnlzwData *d = data;
+    free(d->compressed);
+    free(d);
+}
+
+/**
+ * Benchmark decompressing a 512x512 image.  If REPETITIVE, the image is a
+ * single color, which gives the longest strings.  Otherwise it's random 8-bit
+ * noise, which gives the most codes.
+ */
+struct Benchmark unlzw_benchmark(bool repetitive, uint64_t *rng)
+{
+    size_t const pixels = 512 * 512;
+    uint8_t *image = calloc(pixels, 1);
+    if (!repetitive)
+        fill_random(image, pixels, 8, rng);
+
+    struct UnlzwData *d = malloc(sizeof(*d));
+    d->min_code_size = 8;
+    size_t const size = lzw(d->min_code_size, image, pixels, &d->compressed);
+    d->size = size;
+    free(image);
+
+    struct Benchmark b = {
+        .name = estrdup(repetitive? "unlzw/repetitive" : "unlzw/noise"),
+        .run = unlzw_run,
+        .free = unlzw_free,
+        .data = d,
+        .bytes = size,
+        .pixels = pixels,
+    };
+    return b;
+}
+
+
+/* ===[ deinterlace ]=== */
+void deinterlace_run(void *data)
+{
+    struct GIF_Image *image = data;
+    deinterlace(image);
+    sink = image->pixels[0];
+}
+
+void deinterlace_free(void *data)
+{
+    struct GIF_Image *image = data;
+    free(image->pixels);
+    free(image);
+}
+
+/** Benchmark deinterlacing a WIDTH x HEIGHT image. */
+struct Benchmark deinterlace_benchmark(
+    uint16_t width, uint16_t height, uint64_t *rng)
+{
+    struct GIF_Image *image = calloc(1, sizeof(*image));
+    image->width = width;
+    image->height = height;
+    image->interlace_flag = true;
+    image->size = (size_t)width * height;
+    image->pixels = malloc(image->size);
+    fill_random(image->pixels, image->size, 8, rng);
+
+    struct Benchmark b = {
+        .run = deinterlace_run,
+        .free = deinterlace_free,
+        .data = image,
+        .bytes = image->size,
+        .pixels = image->size,
+    };
+    sprintfa(&b.name, "deinterlace/%ux%u", width, height);
+    return b;
+}
+
+
+/* ===[ Palette expansion ]=== */
+struct PaletteData
+{
+    SDL_Surface *indexed;
+    SDL_Surface *rgba;
+};
+
+void palette_run(void *data)
+{
+    struct PaletteData const *d = data;
+    SDL_BlitSurface(d->indexed, NULL, d->rgba, NULL);
+    sink = ((uint8_t const *)d->rgba->pixels)[0];
+}
+
+void palette_free(void *data)
+{
+    struct PaletteData *d = data;
+    SDL_FreeSurface(d->indexed);
+    SDL_FreeSurface(d->rgba);
+    free(d);
+}
+
+/**
+ * Benchmark expanding an 8-bit indexed image to RGBA, the same way frames are
+ * composited.  If COLORKEY, index 0 is transparent.
+ */
+struct Benchmark palette_benchmark(bool colorkey, uint64_t *rng)
+{
+    int const width = 512, height = 512;
+    struct PaletteData *d = malloc(sizeof(*d));
+    d->indexed = SDL_CreateRGBSurfaceWithFormat(
+        0, width, height, 8, SDL_PIXELFORMAT_INDEX8);
+    d->rgba = SDL_CreateRGBSurfaceWithFormat(
+        0, width, height, 32, SDL_PIXELFORMAT_RGBA32);
+    if (!d->indexed || !d->rgba)
+        fatal("SDL_CreateRGBSurfaceWithFormat -- %s\n", SDL_GetError());
+
+    SDL_Color colors[256];
+    for (size_t i = 0; i < 256; ++i)
+    {
+        uint64_t const rgb = next_random(rng);
+        colors[i] = (SDL_Color){rgb >> 56, rgb >> 48, rgb >> 40, 0xFF};
+    }
+    SDL_SetPaletteColors(d->indexed->format->palette, colors, 0, 256);
+    for (int y = 0; y < height; ++y)
+    {
+        fill_random(
+            (uint8_t *)d->indexed->pixels + y * d->indexed->pitch,
+            width, 8, rng);
+    }
+    if (colorkey)
+        SDL_SetColorKey(d->indexed, SDL_TRUE, 0);
+
+    struct Benchmark b = {
+        .name = estrdup(colorkey? "palette/colorkey" : "palette/opaque"),
+        .run = palette_run,
+        .free = palette_free,
+        .data = d,
+        .bytes = (size_t)width * height,
+        .pixels = (size_t)width * height,
+    };
+    return b;
+}
+
+
+/* ===[ RGB to YUV ]=== */
+struct YUVData
+{
+    int width, height;
+    uint8_t *rgba;
+    uint8_t *yuv;
+    bool scalar;
+};
+
+void yuv_run(void *data)
+{
+    struct YUVData const *d = data;
+    size_t const luma_size = (size_t)d->width * d->height;
+    size_t const chroma_size = (size_t)(d->width / 2) * (d->height / 2);
+    uint8_t *const u = d->yuv + luma_size;
+    uint8_t *const v = u + chroma_size;
+    if (d->scalar)
+        yuv420_from_rgba_scalar(
+            d->rgba, 4 * d->width, d->width, d->height, d->yuv, u, v);
+    else
+        yuv420_from_rgba(
+            d->rgba, 4 * d->width, d->width, d->height, d->yuv, u, v);
+    sink = d->yuv[0];
+}
+
+void yuv_free(void *data)
+{
+    struct YUVData *d = data;
+    free(d->rgba);
+    free(d->yuv);
+    free(d);
+}
+
+/**
+ * Benchmark converting a composited RGBA frame to YUV 4:2:0 for Y4M output,
+ * with either the default (SIMD where available) or the scalar kernel.
+ */
+struct Benchmark yuv_benchmark(bool scalar, uint64_t *rng)
+{
+    struct YUVData *d = malloc(sizeof(*d));
+    d->width = 512;
+    d->height = 512;
+    d->scalar = scalar;
+    size_t const pixels = (size_t)d->width * d->height;
+    d->rgba = malloc(4 * pixels);
+    d->yuv = malloc(pixels + pixels / 2);
+    fill_random(d->rgba, 4 * pixels, 8, rng);
+
+    struct Benchmark b = {
+        .name = estrdup(scalar? "yuv420/scalar" : "yuv420/default"),
+        .run = yuv_run,
+        .free = yuv_free,
+        .data = d,
+        .bytes = 4 * pixels,
+        .pixels = pixels,
+    };
+    return b;
+}
+
+
+/* ===[ Mip downscale ]=== */
+struct MipData
+{
+    int width, height;
+    uint8_t *rgba;
+    uint8_t *half;
+    bool scalar;
+};
+
+void mip_run(void *data)
+{
+    struct MipData const *d = data;
+    size_t const half_pitch = 4 * ((d->width + 1) / 2);
+    if (d->scalar)
+        mip_downscale_rgba_scalar(
+            d->rgba, 4 * d->width, d->width, d->height, d->half, half_pitch);
+    else
+        mip_downscale_rgba(
+            d->rgba, 4 * d->width, d->width, d->height, d->half, half_pitch);
+    sink = d->half[0];
+}
+
+void mip_free(void *data)
+{
+    struct MipData *d = data;
+    free(d->rgba);
+    free(d->half);
+    free(d);
+}
+
+/**
+ * Benchmark halving a composited RGBA frame for the zoomed-out mip pyramid,
+ * with either the default (SIMD where available) or the scalar kernel.
+ */
+struct Benchmark mip_benchmark(bool scalar, uint64_t *rng)
+{
+    struct MipData *d = malloc(sizeof(*d));
+    d->width = 512;
+    d->height = 512;
+    d->scalar = scalar;
+    size_t const pixels = (size_t)d->width * d->height;
+    d->rgba = malloc(4 * pixels);
+    d->half = malloc(pixels);
+    fill_random(d->rgba, 4 * pixels, 8, rng);
+
+    struct Benchmark b = {
+        .name = estrdup(scalar? "mip/scalar" : "mip/default"),
+        .run = mip_run,
+        .free = mip_free,
+        .data = d,
+        .bytes = 4 * pixels,
+        .pixels = pixels,
+    };
+    return b;
+}
+
+
+/* ===[ Software scaler ]=== */
+struct ScaleData
+{
+    int width, height;
+    SDL_Rect to;
+    uint8_t *src;
+    uint8_t *dst;
+    bool scalar;
+};
+
+void scale_run(void *data)
+{
+    struct ScaleData const *d = data;
+    if (d->scalar)
+        scale_image_scalar(
+            d->src, 4 * d->width, d->width, d->height, &d->to, &d->to,
+            d->dst, 4 * d->to.w);
+    else
+        scale_image(
+            d->src, 4 * d->width, d->width, d->height, &d->to, &d->to,
+            d->dst, 4 * d->to.w);
+    sink = d->dst[0];
+}
+
+void scale_free(void *data)
+{
+    struct ScaleData *d = data;
+    free(d->src);
+    free(d->dst);
+    free(d);
+}
+
+/**
+ * Benchmark the software renderer's frame scaler, zooming a 256x256 frame to
+ * 768x768 (nearest-neighbour) or 700x700 (bilinear), with either the default
+ * (SIMD and threads where available) or the scalar kernel.
+ */
+struct Benchmark scale_benchmark(bool bilinear, bool scalar, uint64_t *rng)
+{
+    struct ScaleData *d = malloc(sizeof(*d));
+    d->width = 256;
+    d->height = 256;
+    int const size = bilinear? 700 : 768;
+    d->to = (SDL_Rect){0, 0, size, size};
+    d->scalar = scalar;
+    size_t const pixels = (size_t)size * size;
+    d->src = malloc((size_t)4 * d->width * d->height);
+    d->dst = malloc(4 * pixels);
+    fill_random(d->src, (size_t)4 * d->width * d->height, 8, rng);
+
+    static char const *const names[2][2] = {
+        {"scale/nearest/default", "scale/nearest/scalar"},
+        {"scale/bilinear/default", "scale/bilinear/scalar"},
+    };
+    struct Benchmark b = {
+        .name = estrdup(names[bilinear][scalar]),
+        .run = scale_run,
+        .free = scale_free,
+        .data = d,
+        .bytes = 4 * pixels,
+        .pixels = pixels,
+    };
+    return b;
+}
+
+
+/** Time ITERATIONS runs of B, in seconds. */
+double time_benchmark(struct Benchmark const *b, size_t iterations)
+{
+    double const start = now();
+    for (size_t i = 0; i < iterations; ++i)
+        b->run(b->data);
+    return now() - start;
+}
+
+/** Run and report benchmark B. */
+void run_benchmark(struct Benchmark const *b, struct Options const *opts)
+{
+    size_t iterations = opts->iterations;
+    if (iterations == 0)
+    {
+        iterations = 1;
+        while (time_benchmark(b, iterations) < opts->min_time)
+            iterations *= 2;
+    }
+
+    double times[REPETITIONS];
+    for (size_t i = 0; i < REPETITIONS; ++i)
+        times[i] = time_benchmark(b, iterations) / iterations;
+    qsort(times, REPETITIONS, sizeof(*times), compare_doubles);
+    double const median = times[REPETITIONS / 2];
+    /* Spread between the fastest and slowest repetitions, as a sanity check
+     * on how noisy the numbers are. */
+    double const spread = 100.0 * (times[REPETITIONS - 1] - times[0]) / median;
+
+    printf("%-26s %10zu %12.1f", b->name, iterations, median * 1e9);
+    if (b->bytes)
+        printf(" %10.3f", median * 1e9 / b->bytes);
+    else
+        printf(" %10s", "-");
+    if (b->pixels)
+        printf(" %10.3f", median * 1e9 / b->pixels);
+    else
+        printf(" %10s", "-");
+    printf(" %7.1f%%\n", spread);
+    fflush(stdout);
+}
+
+
+int main(int argc, char *argv[])
+{
+    static char const *const short_options = "m:n:f:";
+    enum {OPT_HELP = 256};
+    static struct option const long_options[] = {
+        {"min-time",    required_argument, NULL, 'm'},
+        {"iterations",  required_argument, NULL, 'n'},
+        {"filter",      required_argument, NULL, 'f'},
+        {"help",        no_argument,       NULL, OPT_HELP},
+        {NULL, 0, NULL, 0}
+    };
+
+    struct Options opts = {
+        .min_time = 0.1,
+        .iterations = 0,
+        .filter = "",
+    };
+
+    int c;
+    while ((c = getopt_long(argc, argv, short_options, long_options, NULL))
+        != -1)
+    {
+        switch (c)
+        {
+        case 'm':
+            opts.min_time = strtod(optarg, NULL);
+            break;
+        case 'n':
+            opts.iterations = strtoul(optarg, NULL, 10);
+            break;
+        case 'f':
+            opts.filter = optarg;
+            break;
+        case OPT_HELP:
+            usage(argv[0], true);
+            exit(EXIT_SUCCESS);
+            break;
+        default:
+            usage(argv[0], false);
+            exit(EXIT_FAILURE);
+            break;
+        }
+    }
+    if (optind != argc)
+    {
+        usage(argv[0], false);
+        exit(EXIT_FAILURE);
+    }
+
+    uint64_t rng = 1;
+    struct Benchmark benchmarks[32];
+    size_t count = 0;
+    for (size_t code_size = 3; code_size <= 12; ++code_size)
+        benchmarks[count++] = bitstream_benchmark(code_size, &rng);
+    benchmarks[count++] = unlzw_benchmark(false, &rng);
+    benchmarks[count++] = unlzw_benchmark(true, &rng);
+    benchmarks[count++] = deinterlace_benchmark(256, 16384, &rng);
+    benchmarks[count++] = deinterlace_benchmark(16, 65535, &rng);
+    benchmarks[count++] = palette_benchmark(false, &rng);
+    benchmarks[count++] = palette_benchmark(true, &rng);
+    benchmarks[count++] = yuv_benchmark(false, &rng);
+    benchmarks[count++] = yuv_benchmark(true, &rng);
+    benchmarks[count++] = mip_benchmark(false, &rng);
+    benchmarks[count++] = mip_benchmark(true, &rng);
+    benchmarks[count++] = scale_benchmark(false, false, &rng);
+    benchmarks[count++] = scale_benchmark(false, true, &rng);
+    benchmarks[count++] = scale_benchmark(true, false, &rng);
+    benchmarks[count++] = scale_benchmark(true, true, &rng);
+
+    printf("%-26s %10s %12s %10s %10s %8s\n",
+        "benchmark", "iterations", "ns/run", "ns/byte", "ns/pixel", "spread");
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (strstr(benchmarks[i].name, opts.filter))
+            run_benchmark(&benchmarks[i], &opts);
+        benchmarks[i].free(benchmarks[i].data);
+        free(benchmarks[i].name);
+    }
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,219 @@
+/*
+ * dump.c -- Headless frame output definitions.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "dump.h"
+#include "sdlgif.h"
+#include "util.h"
+#include "yuv.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+#if _WIN32
+#include <direct.h>
+#include <fcntl.h>
+#include <io.h>
+#endif
+
+
+/** State passed to _dump_frame. */
+struct FrameDumper
+{
+    char const *dir;
+    FILE *manifest;
+    size_t index;
+    /** Start time of the next frame, in 100ths of a second. */
+    size_t time;
+};
+
+
+/** State passed to _stream_y4m_frame. */
+struct Y4MWriter
+{
+    FILE *out;
+    unsigned fps;
+    /** Planar YUV 4:2:0 data for the latest frame. */
+    uint8_t *yuv;
+    size_t yuv_size;
+    /** Number of output frames written so far. */
+    size_t written;
+    /** End time of the latest frame, in 100ths of a second. */
+    size_t time;
+};
+
+
+/** Create DIR, unless it already exists. */
+void _make_directory(char const *dir)
+{
+    errno = 0;
+#if _WIN32
+    int const err = _mkdir(dir);
+#else
+    int const err = mkdir(dir, 0777);
+#endif
+    if (err != 0 && errno != EEXIST)
+        fatal("mkdir '%s': %s\n", dir, strerror(errno));
+}
+
+/** Open DIR/NAME for writing. */
+FILE *_open_in_dir(char const *dir, char const *name)
+{
+    char *path = NULL;
+    sprintfa(&path, "%s/%s", dir, name);
+    errno = 0;
+    FILE *file = fopen(path, "wb");
+    if (file == NULL)
+        fatal("fopen '%s': %s\n", path, strerror(errno));
+    free(path);
+    return file;
+}
+
+/** Write an RGBA32 SURFACE to FILE as a PAM image. */
+void _write_pam(FILE *file, SDL_Surface *surface)
+{
+    fprintf(file,
+        "P7\nWIDTH %d\nHEIGHT %d\nDEPTH 4\nMAXVAL 255\nTUPLTYPE RGB_ALPHA\n"
+        "ENDHDR\n",
+        surface->w, surface->h);
+    SDL_LockSurface(surface);
+    for (int y = 0; y < surface->h; ++y)
+    {
+        efwrite(
+            (uint8_t const *)surface->pixels + (size_t)y * surface->pitch,
+            4, surface->w, file);
+    }
+    SDL_UnlockSurface(surface);
+}
+
+/** FrameCallback which writes FRAME to a file and adds it to the manifest. */
+void _dump_frame(SDL_Surface *frame, size_t delay, void *userdata)
+{
+    struct FrameDumper *dumper = userdata;
+
+    char *name = NULL;
+    sprintfa(&name, "frame_%.5zu.pam", dumper->index);
+    FILE *file = _open_in_dir(dumper->dir, name);
+    _write_pam(file, frame);
+    errno = 0;
+    if (fclose(file))
+        fatal("fclose: %s\n", strerror(errno));
+
+    fprintf(dumper->manifest, "%zu\t%s\t%zu\t%zu\n",
+        dumper->index, name, dumper->time * 10, delay * 10);
+    free(name);
+
+    dumper->index++;
+    dumper->time += delay;
+}
+
+/** Write the current frame of WRITER to its output. */
+void _write_y4m_frame(struct Y4MWriter *writer)
+{
+    efwrite("FRAME\n", 1, 6, writer->out);
+    efwrite(writer->yuv, 1, writer->yuv_size, writer->out);
+    writer->written++;
+}
+
+/**
+ * FrameCallback which converts FRAME to YUV, and writes it once for every
+ * output frame whose timestamp falls within it.
+ */
+void _stream_y4m_frame(SDL_Surface *frame, size_t delay, void *userdata)
+{
+    struct Y4MWriter *writer = userdata;
+    size_t const luma_size = (size_t)frame->w * frame->h;
+    size_t const chroma_size = (
+        (size_t)((frame->w + 1) / 2) * ((frame->h + 1) / 2));
+
+    SDL_LockSurface(frame);
+    yuv420_from_rgba(
+        frame->pixels, frame->pitch, frame->w, frame->h,
+        writer->yuv,
+        writer->yuv + luma_size,
+        writer->yuv + luma_size + chroma_size);
+    SDL_UnlockSurface(frame);
+
+    /* Output frame N is shown at N/FPS seconds, so this frame covers every N
+     * below ceil(end * FPS). */
+    writer->time += delay;
+    size_t const end = (writer->time * writer->fps + 99) / 100;
+    while (writer->written < end)
+        _write_y4m_frame(writer);
+}
+
+
+void dump_frames(GIF gif, char const *dir)
+{
+    _make_directory(dir);
+
+    struct FrameDumper dumper = {
+        .dir = dir,
+        .manifest = _open_in_dir(dir, "manifest.tsv"),
+        .index = 0,
+        .time = 0,
+    };
+    fputs("index\tfile\tstart_ms\tdelay_ms\n", dumper.manifest);
+
+    sdlgif_composite_frames(gif, _dump_frame, &dumper);
+
+    errno = 0;
+    if (fclose(dumper.manifest))
+        fatal("fclose: %s\n", strerror(errno));
+}
+
+void stream_y4m(
+    struct GIF_Reader *reader, GIF const *gif, unsigned fps, FILE *out)
+{
+#if _WIN32
+    _setmode(_fileno(out), _O_BINARY);
+#endif
+    size_t const luma_size = (size_t)gif->width * gif->height;
+    size_t const chroma_size = (
+        (size_t)((gif->width + 1) / 2) * ((gif->height + 1) / 2));
+    struct Y4MWriter writer = {
+        .out = out,
+        .fps = fps,
+        .yuv_size = luma_size + 2 * chroma_size,
+        .written = 0,
+        .time = 0,
+    };
+    writer.yuv = malloc(writer.yuv_size);
+
+    fprintf(out, "YUV4MPEG2 W%u H%u F%u:1 Ip A1:1 C420jpeg\n",
+        (unsigned)gif->width, (unsigned)gif->height, fps);
+    struct SDLGIFCompositor *compositor = sdlgif_compositor_new(
+        gif, _stream_y4m_frame, &writer);
+    struct GIF_Graphic *graphic;
+    while ((graphic = gif_read_graphic(reader)) != NULL)
+        sdlgif_compositor_add(compositor, graphic);
+    size_t const frames = sdlgif_compositor_finish(compositor);
+
+    /* Still images and GIFs with no delays still get a frame. */
+    if (writer.written == 0 && frames > 0)
+        _write_y4m_frame(&writer);
+
+    errno = 0;
+    if (fflush(out))
+        fatal("fflush: %s\n", strerror(errno));
+    free(writer.yuv);
+}
@@ -0,0 +1,48 @@
+/*
+ * dump.h -- Headless frame output declarations.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFVIEW_DUMP_H
+#define GIFVIEW_DUMP_H
+
+#include "gif/gif.h"
+
+#include <stdio.h>
+
+
+/**
+ * Composite GIF's frames and write each one to DIR as a PAM image
+ * (frame_NNNNN.pam), along with a manifest.tsv listing every frame's file,
+ * start time and delay.  DIR is created if it doesn't exist.  Frames are
+ * written as they are composited, so only one is held in memory at a time.
+ */
+void dump_frames(GIF gif, char const *dir);
+
+/**
+ * Read the rest of GIF from READER (see gif_read_begin), compositing its
+ * frames and streaming them to OUT as a YUV4MPEG2 video at FPS frames per
+ * second.  Frames are repeated or skipped as needed to convert the GIF's
+ * delays to the constant output rate.  Image data is decoded a graphic at a
+ * time, and only the frame being converted is held in memory, so output can
+ * be piped straight into an encoder.
+ */
+void stream_y4m(
+    struct GIF_Reader *reader, GIF const *gif, unsigned fps, FILE *out);
+
+
+#endif /* GIFVIEW_DUMP_H */
@@ -19,45 +19,38 @@
 
 #include "fontrenderer.h"
 
+#include <stdlib.h>
+#include <string.h>
 
-struct TextRenderer *textrenderer_new(char const *file, int ptsize)
+
+struct TextRenderer *textrenderer_new(struct GlyphAtlas *atlas)
 {
     struct TextRenderer *text = malloc(sizeof(struct TextRenderer));
-    text->font = TTF_OpenFont(file, ptsize);
-    text->surface = NULL;
-    text->texture = NULL;
+    text->atlas = atlas;
+    text->text[0] = '\0';
+    text->rect = glyphatlas_measure(atlas, text->text, true);
+    text->signal_changed = signal_new();
     return text;
 }
 
 void textrenderer_free(struct TextRenderer *text)
 {
-    TTF_CloseFont(text->font);
-    SDL_FreeSurface(text->surface);
-    SDL_DestroyTexture(text->texture);
+    signal_free(text->signal_changed);
     free(text);
 }
 
-void textrenderer_set_text(
-    struct TextRenderer *text, SDL_Renderer *renderer, char const *utf8text)
+void textrenderer_set_text(struct TextRenderer *text, char const *utf8text)
 {
-    static SDL_Color const WHITE = {0xff, 0xff, 0xff, 0xff};
-    static SDL_Color const BLACK = {0x00, 0x00, 0x00, 0xff};
-    static int const OUTLINE = 2;
-
-    TTF_SetFontOutline(text->font, OUTLINE);
-    SDL_Surface *outlined = TTF_RenderUTF8_Blended(text->font, utf8text, BLACK);
-    TTF_SetFontOutline(text->font, 0);
-    SDL_Surface *base = TTF_RenderUTF8_Blended(text->font, utf8text, WHITE);
-
-    SDL_Rect rect = base->clip_rect;
-    rect.x += OUTLINE;
-    rect.y += OUTLINE;
-    SDL_BlitSurface(base, NULL, outlined, &rect);
+    if (strncmp(text->text, utf8text, TEXTRENDERER_MAX_LENGTH - 1) == 0)
+        return;
+    strncpy(text->text, utf8text, TEXTRENDERER_MAX_LENGTH - 1);
+    text->text[TEXTRENDERER_MAX_LENGTH - 1] = '\0';
+    text->rect = glyphatlas_measure(text->atlas, text->text, true);
+    signal_emit(text->signal_changed);
+}
 
-    text->surface = outlined;
-    text->texture = SDL_CreateTextureFromSurface(renderer, text->surface);
-    text->rect.h = text->surface->h;
-    text->rect.w = text->surface->w;
-    text->rect.x = 0;
-    text->rect.y = 0;
+void textrenderer_draw(struct TextRenderer const *text, int x, int y)
+{
+    static SDL_Color const WHITE = {0xff, 0xff, 0xff, 0xff};
+    glyphatlas_draw(text->atlas, text->text, x, y, WHITE, true);
 }
@@ -20,29 +20,43 @@
 #ifndef GIFVIEW_FONTRENDERER_H
 #define GIFVIEW_FONTRENDERER_H
 
+#include "glyphatlas/glyphatlas.h"
+#include "menu/signal.h"
+
 #include <SDL2/SDL.h>
-#include <SDL_ttf.h>
 
 
-/** SDL_ttf-based text renderer. */
+/** Longest text (in bytes, including the NUL) a textrenderer holds. */
+#define TEXTRENDERER_MAX_LENGTH 128
+
+/** Outlined white text, drawn from a glyph atlas. */
 struct TextRenderer
 {
-    TTF_Font *font;
-    SDL_Surface *surface;
-    SDL_Texture *texture;
+    struct GlyphAtlas *atlas;
+    /** The text, truncated to fit. */
+    char text[TEXTRENDERER_MAX_LENGTH];
+    /** Size of the drawn text. */
     SDL_Rect rect;
+    /** Emitted when the text changes. */
+    Signal *signal_changed;
 };
 
 
-/** Create a new textrenderer. */
-struct TextRenderer *textrenderer_new(char const *file, int ptsize);
+/** Create a new textrenderer which draws from ATLAS. */
+struct TextRenderer *textrenderer_new(struct GlyphAtlas *atlas);
 
 /** Free a textrenderer. */
 void textrenderer_free(struct TextRenderer *text);
 
-/** Set the textrenderer's text. */
-void textrenderer_set_text(
-    struct TextRenderer *text, SDL_Renderer *renderer, char const *utf8text);
+/**
+ * Set the textrenderer's text.  Nothing is rasterized or allocated, so this is
+ * cheap enough to call on every update.  signal_changed is only emitted if
+ * the text is different.
+ */
+void textrenderer_set_text(struct TextRenderer *text, char const *utf8text);
+
+/** Draw the text with its top-left corner at X,Y. */
+void textrenderer_draw(struct TextRenderer const *text, int x, int y);
 
 
 #endif /* GIFVIEW_FONTRENDERER_H */
@@ -0,0 +1,833 @@
+/*
+ * framecache.c -- On-disk frame cache definitions.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "framecache.h"
+#include "util.h"
+#include "gif/lzw.h"
+#include "stats/stats.h"
+#include "stats/trace.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL.h>
+
+#if !_WIN32
+#include <dirent.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+#if !_WIN32
+/** Identifies a frame cache file, and its layout version. */
+static char const MAGIC[8] = {'G', 'I', 'F', 'V', 'C', 'A', 'C', '4'};
+/** Extension of cache files. */
+static char const EXTENSION[] = ".frames";
+/** Frame data starts on a multiple of this, so it maps page-aligned. */
+static uint64_t const DATA_ALIGNMENT = 4096;
+/** Each frame starts on a multiple of this. */
+static uint64_t const FRAME_ALIGNMENT = 16;
+/** Bytes of an indexed frame's palette. */
+static uint64_t const PALETTE_BYTES = 256 * 4;
+/** Bytes hashed from each of the start, middle and end of a source file. */
+static size_t const HASH_SAMPLE_SIZE = 64 * 1024;
+/**
+ * Files whose frames would take more than this are cached with their pixels
+ * LZW-compressed, so even huge ones fit in the budget.  Smaller ones are kept
+ * raw, so they can be mapped without being decoded.
+ */
+static uint64_t const RAW_LIMIT_BYTES = FRAMECACHE_BUDGET_BYTES / 8;
+
+
+/**
+ * Start of a cache file, in host byte order.  It's followed by the source
+ * file's absolute path (not NUL-terminated), FRAME_COUNT CacheFrames, and
+ * then, from FRAMES_OFFSET, the frames' pixels.
+ */
+struct CacheHeader
+{
+    char magic[8];
+    uint32_t width, height;
+    uint32_t frame_count;
+    uint32_t path_length;
+    /** Size and modification time of the source file when it was cached. */
+    uint64_t source_size;
+    int64_t source_mtime;
+    /** Hash of samples of the source file's contents. */
+    uint64_t content_hash;
+    uint64_t frames_offset;
+};
+
+/**
+ * Where a frame is in a cache file.  Indexed frames are a 256-entry RGBA
+ * palette followed by WIDTH x HEIGHT indices.  Others are WIDTH x HEIGHT
+ * RGBA32 pixels.  Neither has padding between rows.  The pixels (but not the
+ * palette) may be LZW-compressed with a minimum code size of 8.
+ */
+struct CacheFrame
+{
+    uint32_t delay;
+    /** Number of palette colors, or 0 if the frame is RGBA32. */
+    uint32_t color_count;
+    uint64_t offset;
+    /**
+     * Index of the first frame with the same pixels (see PreparedGIF), whose
+     * data this frame shares.
+     */
+    uint64_t source;
+    /** Bytes of LZW-compressed pixels, or 0 if they aren't compressed. */
+    uint64_t compressed_size;
+};
+
+/** A cache file, for eviction. */
+struct CacheFile
+{
+    char *path;
+    uint64_t size;
+    time_t used;
+};
+
+
+/** A file waiting to be written to the cache. */
+struct StoreJob
+{
+    char *path;
+    /** Referenced until the job is done. */
+    struct PreparedGIF *prepared;
+    struct StoreJob *next;
+};
+
+
+/** Directory cache files go in, or NULL if the cache is off. */
+static char *cache_dir = NULL;
+/** Background thread writing cache files, so opening files isn't slowed. */
+static SDL_Thread *store_thread = NULL;
+/** Held while using STORE_QUEUE. */
+static SDL_mutex *store_lock = NULL;
+/** Signalled when a file is queued, or STORE_QUITTING is set. */
+static SDL_cond *store_wake = NULL;
+/** Files waiting to be written, oldest first. */
+static struct StoreJob *store_queue = NULL;
+/** Set to stop STORE_THREAD, giving up on the file it's writing. */
+static SDL_atomic_t store_quitting;
+
+
+/** Continue an FNV-1a hash of N bytes of DATA. */
+uint64_t _hash_bytes(uint64_t hash, void const *data, size_t n)
+{
+    uint8_t const *bytes = data;
+    for (size_t i = 0; i < n; ++i)
+    {
+        hash ^= bytes[i];
+        hash *= 0x100000001b3;
+    }
+    return hash;
+}
+
+/**
+ * Hash the start, middle and end of the SIZE byte file FD.  Cheap even for
+ * huge files, and catches rewrites that keep the size and modification time.
+ */
+bool _hash_contents(int fd, uint64_t size, uint64_t *hash)
+{
+    uint8_t *buffer = malloc(HASH_SAMPLE_SIZE);
+    uint64_t const offsets[3] = {
+        0,
+        size / 2,
+        size > HASH_SAMPLE_SIZE? size - HASH_SAMPLE_SIZE : 0
+    };
+    *hash = 0xcbf29ce484222325;
+    for (size_t i = 0; i < 3; ++i)
+    {
+        ssize_t const got = pread(fd, buffer, HASH_SAMPLE_SIZE, offsets[i]);
+        if (got < 0)
+        {
+            free(buffer);
+            return false;
+        }
+        *hash = _hash_bytes(*hash, buffer, got);
+    }
+    free(buffer);
+    return true;
+}
+
+/**
+ * Get the absolute path of SOURCE, and the size, modification time and
+ * content hash to check its cache file against.  Returns NULL on failure.
+ */
+char *_describe_source(
+    char const *source, uint64_t *size, int64_t *mtime, uint64_t *hash)
+{
+    char *absolute = realpath(source, NULL);
+    if (!absolute)
+        return NULL;
+    int const fd = open(absolute, O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0
+        || !_hash_contents(fd, info.st_size, hash))
+    {
+        if (fd >= 0)
+            close(fd);
+        free(absolute);
+        return NULL;
+    }
+    close(fd);
+    *size = info.st_size;
+    *mtime = info.st_mtime;
+    return absolute;
+}
+
+/** Path of the cache file for the source file at ABSOLUTE. */
+char *_cache_path(char const *absolute)
+{
+    uint64_t const key = _hash_bytes(
+        0xcbf29ce484222325, absolute, strlen(absolute));
+    char *path = NULL;
+    sprintfa(
+        &path, "%s/%016llx%s", cache_dir, (unsigned long long)key, EXTENSION);
+    return path;
+}
+
+/** Round N up to a multiple of ALIGNMENT. */
+uint64_t _align(uint64_t n, uint64_t alignment)
+{
+    return (n + alignment - 1) / alignment * alignment;
+}
+
+/** Offset of the first frame's pixels in a cache file. */
+uint64_t _frames_offset(uint32_t path_length, uint32_t frame_count)
+{
+    return _align(
+        sizeof(struct CacheHeader) + path_length
+        + frame_count * (uint64_t)sizeof(struct CacheFrame),
+        DATA_ALIGNMENT);
+}
+
+/** Bytes of uncompressed pixels in a frame cached as described by ENTRY. */
+uint64_t _pixel_bytes(
+    struct CacheHeader const *header, struct CacheFrame const *entry)
+{
+    uint64_t const pixels = (uint64_t)header->width * header->height;
+    return entry->color_count? pixels : 4 * pixels;
+}
+
+/** Bytes of a cache file taken by a frame cached as described by ENTRY. */
+uint64_t _stored_size(
+    struct CacheHeader const *header, struct CacheFrame const *entry)
+{
+    return (
+        (entry->color_count? PALETTE_BYTES : 0)
+        + (entry->compressed_size
+            ? entry->compressed_size
+            : _pixel_bytes(header, entry)));
+}
+
+/**
+ * Decompress the pixels of a frame cached as described by ENTRY from DATA into
+ * a new surface.  Returns NULL if they don't decompress to the frame's size.
+ */
+SDL_Surface *_decode_frame(
+    struct CacheHeader const *header, struct CacheFrame const *entry,
+    uint8_t const *data)
+{
+    uint8_t *pixels = NULL;
+    size_t const size = unlzw(8, data, entry->compressed_size, &pixels);
+    if (size != _pixel_bytes(header, entry))
+    {
+        free(pixels);
+        return NULL;
+    }
+    SDL_Surface *frame = SDL_CreateRGBSurfaceWithFormat(
+        0, header->width, header->height, entry->color_count? 8 : 32,
+        entry->color_count? SDL_PIXELFORMAT_INDEX8 : SDL_PIXELFORMAT_RGBA32);
+    if (!frame)
+        fatal("SDL_CreateRGBSurfaceWithFormat -- %s\n", SDL_GetError());
+    size_t const row_bytes = (
+        (size_t)header->width * (entry->color_count? 1 : 4));
+    for (uint32_t y = 0; y < header->height; ++y)
+    {
+        memcpy(
+            (uint8_t *)frame->pixels + y * frame->pitch,
+            pixels + y * row_bytes, row_bytes);
+    }
+    free(pixels);
+    stats_memory_add(STATS_MEMORY_SURFACES, (size_t)frame->pitch * frame->h);
+    return frame;
+}
+
+/**
+ * Free PREPARED's arrays, and the first COUNT of its frames, which were loaded
+ * from a cache file.
+ */
+void _discard_frames(struct PreparedGIF *prepared, size_t count)
+{
+    for (size_t i = 0; i < count; ++i)
+    {
+        SDL_Surface *frame = prepared->frames[i];
+        /* Decoded frames own their pixels; the others point into the
+         * mapping. */
+        if (prepared->sources[i] == i && !(frame->flags & SDL_PREALLOC))
+        {
+            stats_memory_remove(
+                STATS_MEMORY_SURFACES, (size_t)frame->pitch * frame->h);
+        }
+        SDL_FreeSurface(frame);
+    }
+    free(prepared->frames);
+    free(prepared->sources);
+    free(prepared->delays);
+}
+
+/**
+ * Point PREPARED's frames into MAPPING, a SIZE byte cache file starting with
+ * HEADER, decompressing those which are compressed.  Returns false if any
+ * frame is out of bounds or corrupt.
+ */
+bool _map_frames(
+    uint8_t *mapping, uint64_t size, struct CacheHeader const *header,
+    struct PreparedGIF *prepared)
+{
+    uint8_t const *const table = (
+        mapping + sizeof(*header) + header->path_length);
+    prepared->frames = calloc(header->frame_count, sizeof(*prepared->frames));
+    prepared->sources = malloc(
+        header->frame_count * sizeof(*prepared->sources));
+    prepared->delays = malloc(header->frame_count * sizeof(*prepared->delays));
+    prepared->frame_count = header->frame_count;
+    prepared->bytes = 0;
+    for (uint32_t i = 0; i < header->frame_count; ++i)
+    {
+        struct CacheFrame entry;
+        memcpy(&entry, table + i * sizeof(entry), sizeof(entry));
+        if (entry.color_count > 256
+            || entry.source > i
+            || entry.offset < header->frames_offset
+            || entry.offset > size
+            || entry.compressed_size > size
+            || _stored_size(header, &entry) > size - entry.offset)
+        {
+            _discard_frames(prepared, i);
+            return false;
+        }
+        prepared->delays[i] = entry.delay;
+        prepared->sources[i] = entry.source;
+        if (entry.source != i)
+        {
+            prepared->frames[i] = prepared->frames[entry.source];
+            prepared->frames[i]->refcount++;
+            continue;
+        }
+
+        uint8_t *data = mapping + entry.offset;
+        uint8_t *pixels = data + (entry.color_count? PALETTE_BYTES : 0);
+        SDL_Surface *frame;
+        if (entry.compressed_size)
+        {
+            frame = _decode_frame(header, &entry, pixels);
+            if (!frame)
+            {
+                _discard_frames(prepared, i);
+                return false;
+            }
+            prepared->bytes += (size_t)frame->pitch * frame->h;
+        }
+        else
+        {
+            /* The surface only reads its pixels, so it can point straight
+             * into the read-only mapping. */
+            frame = SDL_CreateRGBSurfaceWithFormatFrom(
+                pixels, header->width, header->height,
+                entry.color_count? 8 : 32,
+                header->width * (entry.color_count? 1 : 4),
+                entry.color_count
+                ? SDL_PIXELFORMAT_INDEX8
+                : SDL_PIXELFORMAT_RGBA32);
+            if (!frame)
+            {
+                fatal(
+                    "SDL_CreateRGBSurfaceWithFormatFrom -- %s\n",
+                    SDL_GetError());
+            }
+        }
+        if (entry.color_count)
+        {
+            SDL_Color colors[256];
+            memcpy(colors, data, entry.color_count * 4);
+            SDL_SetPaletteColors(
+                frame->format->palette, colors, 0, entry.color_count);
+        }
+        prepared->frames[i] = frame;
+    }
+    return true;
+}
+
+/** Whether any of PREPARED's frames point into its cache file's mapping. */
+bool _uses_mapping(struct PreparedGIF const *prepared)
+{
+    for (size_t i = 0; i < prepared->frame_count; ++i)
+        if (prepared->frames[i]->flags & SDL_PREALLOC)
+            return true;
+    return false;
+}
+
+/** qsort comparator putting the least recently used CacheFiles first. */
+int _compare_use(void const *a, void const *b)
+{
+    struct CacheFile const *x = a, *y = b;
+    return (x->used > y->used) - (x->used < y->used);
+}
+
+/** Delete the least recently used cache files until they fit the budget. */
+void _evict_least_recent(void)
+{
+    DIR *dir = opendir(cache_dir);
+    if (!dir)
+        return;
+    struct CacheFile *files = NULL;
+    size_t count = 0, size = 0;
+    uint64_t total = 0;
+    size_t const extension_length = strlen(EXTENSION);
+    struct dirent const *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        size_t const length = strlen(entry->d_name);
+        if (length <= extension_length
+            || strcmp(entry->d_name + length - extension_length, EXTENSION))
+            continue;
+        char *path = NULL;
+        sprintfa(&path, "%s/%s", cache_dir, entry->d_name);
+        struct stat info;
+        if (stat(path, &info) != 0)
+        {
+            free(path);
+            continue;
+        }
+        if (count == size)
+        {
+            size = size? 2 * size : 64;
+            files = realloc(files, size * sizeof(*files));
+        }
+        files[count++] = (struct CacheFile){
+            .path = path, .size = info.st_size, .used = info.st_mtime
+        };
+        total += info.st_size;
+    }
+    closedir(dir);
+
+    qsort(files, count, sizeof(*files), _compare_use);
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (total > FRAMECACHE_BUDGET_BYTES && unlink(files[i].path) == 0)
+            total -= files[i].size;
+        free(files[i].path);
+    }
+    free(files);
+}
+
+/** Write N bytes of DATA to FILE, returning false on failure. */
+bool _write_all(FILE *file, void const *data, size_t n)
+{
+    return fwrite(data, 1, n, file) == n;
+}
+
+/** Write N zero bytes to FILE, returning false on failure. */
+bool _write_zeros(FILE *file, uint64_t n)
+{
+    /* As big as DATA_ALIGNMENT, so padding is a single write. */
+    static uint8_t const zeros[4096];
+    for (; n > sizeof(zeros); n -= sizeof(zeros))
+        if (!_write_all(file, zeros, sizeof(zeros)))
+            return false;
+    return _write_all(file, zeros, n);
+}
+
+/**
+ * Write FRAME, cached as described by ENTRY, to FILE.  If COMPRESS is set its
+ * pixels are LZW-compressed, and ENTRY's COMPRESSED_SIZE is filled in.
+ * Returns false on failure.
+ */
+bool _write_frame(
+    FILE *file, SDL_Surface const *frame, struct CacheFrame *entry,
+    bool compress)
+{
+    if (entry->color_count)
+    {
+        uint8_t palette[256 * 4] = {0};
+        memcpy(
+            palette, frame->format->palette->colors, entry->color_count * 4);
+        if (!_write_all(file, palette, sizeof(palette)))
+            return false;
+    }
+    size_t const row_bytes = (size_t)frame->w * (entry->color_count? 1 : 4);
+    uint8_t const *pixels = frame->pixels;
+    if (!compress)
+    {
+        for (int y = 0; y < frame->h; ++y)
+            if (!_write_all(file, pixels + y * frame->pitch, row_bytes))
+                return false;
+        return true;
+    }
+
+    /* lzw takes the rows back to back. */
+    uint8_t *packed = NULL;
+    if ((size_t)frame->pitch != row_bytes)
+    {
+        packed = malloc(row_bytes * frame->h);
+        for (int y = 0; y < frame->h; ++y)
+        {
+            memcpy(
+                packed + y * row_bytes, pixels + y * frame->pitch, row_bytes);
+        }
+        pixels = packed;
+    }
+    uint8_t *compressed = NULL;
+    entry->compressed_size = lzw(8, pixels, row_bytes * frame->h, &compressed);
+    free(packed);
+    bool const ok = _write_all(file, compressed, entry->compressed_size);
+    free(compressed);
+    return ok;
+}
+
+/**
+ * Write PREPARED's frames to the cache file of the GIF at PATH.  Returns true
+ * if the file was written.
+ */
+bool _write_cache(char const *path, struct PreparedGIF const *prepared)
+{
+    uint64_t const start = stats_now();
+    uint64_t size, hash;
+    int64_t mtime;
+    char *absolute = _describe_source(path, &size, &mtime, &hash);
+    if (!absolute)
+        return false;
+    uint32_t const path_length = strlen(absolute);
+    struct CacheHeader header = {
+        .width = prepared->gif.width,
+        .height = prepared->gif.height,
+        .frame_count = prepared->frame_count,
+        .path_length = path_length,
+        .source_size = size,
+        .source_mtime = mtime,
+        .content_hash = hash,
+        .frames_offset = _frames_offset(path_length, prepared->frame_count),
+    };
+    memcpy(header.magic, MAGIC, sizeof(MAGIC));
+    struct CacheFrame *entries = malloc(
+        prepared->frame_count * sizeof(*entries));
+    for (size_t i = 0; i < prepared->frame_count; ++i)
+    {
+        SDL_Surface const *frame = prepared->frames[i];
+        entries[i] = (struct CacheFrame){
+            .delay = prepared->delays[i],
+            .color_count = (
+                frame->format->format == SDL_PIXELFORMAT_INDEX8
+                ? frame->format->palette->ncolors
+                : 0),
+            .offset = 0,
+            .source = prepared->sources[i],
+            .compressed_size = 0,
+        };
+    }
+    uint64_t raw_size = header.frames_offset;
+    for (size_t i = 0; i < prepared->frame_count; ++i)
+    {
+        if (entries[i].source == i)
+        {
+            raw_size = _align(
+                raw_size + _stored_size(&header, &entries[i]),
+                FRAME_ALIGNMENT);
+        }
+    }
+    bool const compress = raw_size > RAW_LIMIT_BYTES;
+
+    /* Write to a temporary file and rename it into place, so readers never
+     * see a partly-written cache file.  The frame table is written last, once
+     * the frames' offsets and compressed sizes are known. */
+    char *cache_path = _cache_path(absolute);
+    char *temp_path = NULL;
+    sprintfa(
+        &temp_path, "%s.%ld.%lu.tmp", cache_path, (long)getpid(),
+        (unsigned long)SDL_ThreadID());
+    FILE *file = fopen(temp_path, "wb");
+    bool ok = file != NULL;
+    bool too_big = false, quitting = false;
+    ok = ok && _write_all(file, &header, sizeof(header));
+    ok = ok && _write_all(file, absolute, path_length);
+    ok = ok && _write_zeros(
+        file, header.frames_offset - sizeof(header) - path_length);
+    uint64_t written = header.frames_offset;
+    for (size_t i = 0; ok && i < prepared->frame_count; ++i)
+    {
+        size_t const source = entries[i].source;
+        if (source != i)
+        {
+            entries[i].offset = entries[source].offset;
+            entries[i].compressed_size = entries[source].compressed_size;
+            continue;
+        }
+        quitting = SDL_AtomicGet(&store_quitting);
+        too_big = written > FRAMECACHE_BUDGET_BYTES;
+        if (quitting || too_big)
+        {
+            ok = false;
+            break;
+        }
+        entries[i].offset = _align(written, FRAME_ALIGNMENT);
+        ok = (
+            _write_zeros(file, entries[i].offset - written)
+            && _write_frame(file, prepared->frames[i], &entries[i], compress));
+        written = entries[i].offset + _stored_size(&header, &entries[i]);
+    }
+    ok = ok && fseek(file, sizeof(header) + path_length, SEEK_SET) == 0;
+    ok = ok && _write_all(
+        file, entries, prepared->frame_count * sizeof(*entries));
+    if (file && fclose(file) != 0)
+        ok = false;
+    if (ok && rename(temp_path, cache_path) != 0)
+        ok = false;
+    if (!ok)
+    {
+        if (too_big)
+            warn("'%s' is too big to cache\n", path);
+        else if (!quitting)
+        {
+            warn(
+                "couldn't cache frames of '%s': %s\n", path,
+                strerror(errno));
+        }
+        unlink(temp_path);
+    }
+    free(temp_path);
+    free(cache_path);
+    free(entries);
+    free(absolute);
+    trace_span("cache store", start, TRACE_NO_ARG, ok? written : 0);
+    return ok;
+}
+
+/** Background thread which writes queued files to the cache. */
+int _store_worker(void *data)
+{
+    (void)data;
+    SDL_LockMutex(store_lock);
+    while (!SDL_AtomicGet(&store_quitting))
+    {
+        struct StoreJob *job = store_queue;
+        if (!job)
+        {
+            SDL_CondWait(store_wake, store_lock);
+            continue;
+        }
+        store_queue = job->next;
+        SDL_UnlockMutex(store_lock);
+        if (_write_cache(job->path, job->prepared))
+            _evict_least_recent();
+        playlist_unref_prepared(job->prepared);
+        free(job->path);
+        free(job);
+        SDL_LockMutex(store_lock);
+    }
+    SDL_UnlockMutex(store_lock);
+    return 0;
+}
+#endif
+
+
+void framecache_enable(void)
+{
+#if _WIN32
+    warn("the frame cache isn't supported on this platform\n");
+#else
+    if (cache_dir)
+        return;
+    char *root = estrdup(getenv("XDG_CACHE_HOME"));
+    if (!root)
+    {
+        char const *home = getenv("HOME");
+        if (!home)
+        {
+            warn("no cache directory, not caching frames\n");
+            return;
+        }
+        root = estrcat(home, "/.cache");
+    }
+    char *dir = estrcat(root, "/gifview");
+    if ((mkdir(root, 0777) != 0 && errno != EEXIST)
+        || (mkdir(dir, 0777) != 0 && errno != EEXIST))
+    {
+        warn("mkdir '%s': %s, not caching frames\n", dir, strerror(errno));
+        free(dir);
+        free(root);
+        return;
+    }
+    free(root);
+    cache_dir = dir;
+    store_lock = SDL_CreateMutex();
+    store_wake = SDL_CreateCond();
+    if (!store_lock || !store_wake)
+        fatal("SDL_CreateMutex -- %s\n", SDL_GetError());
+    SDL_AtomicSet(&store_quitting, 0);
+    store_thread = SDL_CreateThread(_store_worker, "framecache", NULL);
+    if (!store_thread)
+        error("SDL_CreateThread -- %s, not storing frames\n", SDL_GetError());
+#endif
+}
+
+void framecache_quit(void)
+{
+#if !_WIN32
+    if (!cache_dir)
+        return;
+    SDL_LockMutex(store_lock);
+    SDL_AtomicSet(&store_quitting, 1);
+    SDL_CondSignal(store_wake);
+    SDL_UnlockMutex(store_lock);
+    if (store_thread)
+        SDL_WaitThread(store_thread, NULL);
+    store_thread = NULL;
+    while (store_queue)
+    {
+        struct StoreJob *job = store_queue;
+        store_queue = job->next;
+        playlist_unref_prepared(job->prepared);
+        free(job->path);
+        free(job);
+    }
+    SDL_DestroyCond(store_wake);
+    SDL_DestroyMutex(store_lock);
+    free(cache_dir);
+    cache_dir = NULL;
+#endif
+}
+
+bool framecache_load(char const *path, struct PreparedGIF *prepared)
+{
+#if _WIN32
+    return false;
+#else
+    if (!cache_dir)
+        return false;
+    uint64_t const start = stats_now();
+    uint64_t size, hash;
+    int64_t mtime;
+    char *absolute = _describe_source(path, &size, &mtime, &hash);
+    if (!absolute)
+        return false;
+    char *cache_path = _cache_path(absolute);
+
+    bool hit = false;
+    uint8_t *mapping = MAP_FAILED;
+    struct stat info;
+    int const fd = open(cache_path, O_RDONLY);
+    if (fd >= 0 && fstat(fd, &info) == 0
+        && (uint64_t)info.st_size >= sizeof(struct CacheHeader))
+    {
+        mapping = mmap(NULL, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    }
+    if (mapping != MAP_FAILED)
+    {
+        struct CacheHeader header;
+        memcpy(&header, mapping, sizeof(header));
+        hit = (
+            memcmp(header.magic, MAGIC, sizeof(MAGIC)) == 0
+            && header.frame_count > 0
+            && header.source_size == size
+            && header.source_mtime == mtime
+            && header.content_hash == hash
+            && header.path_length == strlen(absolute)
+            && header.frames_offset == _frames_offset(
+                header.path_length, header.frame_count)
+            && header.frames_offset <= (uint64_t)info.st_size
+            && memcmp(
+                mapping + sizeof(header), absolute, header.path_length) == 0
+            && _map_frames(mapping, info.st_size, &header, prepared));
+        if (hit)
+        {
+            prepared->gif = (GIF){
+                .width = header.width, .height = header.height
+            };
+            /* Frames which were compressed are decoded into memory, so they
+             * don't need the mapping any more. */
+            prepared->mapping = NULL;
+            prepared->mapping_size = 0;
+            if (_uses_mapping(prepared))
+            {
+                prepared->bytes += info.st_size;
+                prepared->mapping = mapping;
+                prepared->mapping_size = info.st_size;
+            }
+            else
+                munmap(mapping, info.st_size);
+            /* Mark the file as recently used, for eviction. */
+            futimens(fd, NULL);
+        }
+        else
+            munmap(mapping, info.st_size);
+    }
+    if (fd >= 0)
+        close(fd);
+    free(cache_path);
+    free(absolute);
+
+    stats_count(hit? STATS_COUNTER_CACHE_HITS : STATS_COUNTER_CACHE_MISSES, 1);
+    if (hit)
+        trace_span("cache load", start, TRACE_NO_ARG, prepared->bytes);
+    return hit;
+#endif
+}
+
+void framecache_store(char const *path, struct PreparedGIF *prepared)
+{
+#if !_WIN32
+    if (!store_thread || prepared->frame_count == 0)
+        return;
+    SDL_LockMutex(store_lock);
+    struct StoreJob **last = &store_queue;
+    for (; *last; last = &(*last)->next)
+    {
+        /* It was prepared again before it could be stored. */
+        if (strcmp((*last)->path, path) == 0)
+        {
+            SDL_UnlockMutex(store_lock);
+            return;
+        }
+    }
+    SDL_AtomicIncRef(&prepared->references);
+    *last = malloc(sizeof(**last));
+    **last = (struct StoreJob){
+        .path = estrdup(path), .prepared = prepared, .next = NULL
+    };
+    SDL_CondSignal(store_wake);
+    SDL_UnlockMutex(store_lock);
+#endif
+}
+
+void framecache_release(struct PreparedGIF *prepared)
+{
+#if !_WIN32
+    _discard_frames(prepared, prepared->frame_count);
+    munmap(prepared->mapping, prepared->mapping_size);
+#endif
+}
@@ -0,0 +1,65 @@
+/*
+ * framecache.h -- On-disk frame cache declarations.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFVIEW_FRAMECACHE_H
+#define GIFVIEW_FRAMECACHE_H
+
+#include "playlist.h"
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/** Most bytes of cache files to keep.  The least recently used go first. */
+#define FRAMECACHE_BUDGET_BYTES ((uint64_t)2 * 1024 * 1024 * 1024)
+
+
+/**
+ * Turn the frame cache on.  Composited frames are kept in
+ * $XDG_CACHE_HOME/gifview (or ~/.cache/gifview), so files open again without
+ * being parsed or composited.  Until this is called, framecache_load and
+ * framecache_store do nothing.
+ */
+void framecache_enable(void);
+
+/**
+ * Map the cached frames of the GIF at PATH into PREPARED.  Returns false if
+ * the cache is off, or PATH isn't cached or has changed since it was.  Free
+ * the result with framecache_release.
+ */
+bool framecache_load(char const *path, struct PreparedGIF *prepared);
+
+/**
+ * Cache PREPARED's frames as those of the GIF at PATH.  They're written on a
+ * background thread, which holds a reference to PREPARED until it's done.
+ * Files whose frames are too big to map raw are stored LZW-compressed.
+ */
+void framecache_store(char const *path, struct PreparedGIF *prepared);
+
+/** Free frames loaded by framecache_load. */
+void framecache_release(struct PreparedGIF *prepared);
+
+/**
+ * Stop writing to the frame cache.  Files which haven't been written yet
+ * aren't, and their references are dropped.
+ */
+void framecache_quit(void);
+
+
+#endif /* GIFVIEW_FRAMECACHE_H */
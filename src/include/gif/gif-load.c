@@ -28,8 +28,11 @@
 #include "gif.h"
 #include "lzw.h"
 #include "util.h"
+#include "stats/stats.h"
+#include "stats/trace.h"
 
 #include <errno.h>
+#include <setjmp.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdnoreturn.h>
@@ -55,7 +58,8 @@ typedef struct ParseState
  *
  * Reads characters from STREAM according to STATE, building the RESULT as it
  * goes.  GEXT_STACK is used to store Graphic Control Extensions, as other
- * blocks can appear between them and the Graphic they control.
+ * blocks can appear between them and the Graphic they control.  Errors jump
+ * to RECOVER, or exit if it's NULL.
  */
 typedef struct Parser
 {
@@ -63,8 +67,15 @@ typedef struct Parser
     ParseState state;
     LinkedList *gext_stack;
     GIF result;
+    jmp_buf *recover;
 } Parser;
 
+/** A GIF being read a graphic at a time.  See gif_read_begin. */
+struct GIF_Reader
+{
+    Parser parser;
+};
+
 struct GenericExtension
 {
     uint8_t label;
@@ -106,7 +117,10 @@ static ParseState const
 
 
 /* ===[ Parser Methods ]=== */
-/** Print parser error message and exit. */
+/**
+ * Print parser error message, then jump to P's recovery point, or exit if it
+ * has none.
+ */
 noreturn void parser_error(
     Parser const *restrict p, char const *restrict fmt, ...)
 {
@@ -117,6 +131,8 @@ noreturn void parser_error(
     vfprintf(stderr, fmt2, ap);
     free(fmt2);
     va_end(ap);
+    if (p->recover)
+        longjmp(*p->recover, 1);
     exit(EXIT_FAILURE);
 }
 
@@ -135,10 +151,10 @@ void parser_free(Parser *p)
         parser_error(p, "Unused Graphic Extensions!");
 }
 
-/** Read a byte from P's stream and return it. */
+/** Read a byte from P's stream and return it, or 0 at the end of file. */
 uint8_t parser_next(Parser *p)
 {
-    uint8_t byte;
+    uint8_t byte = 0;
     efread(&byte, 1, 1, p->stream);
     return byte;
 }
@@ -151,10 +167,14 @@ uint8_t parser_peek(Parser *p)
     return byte;
 }
 
-/** Read N bytes from P's stream into OUT. */
+/**
+ * Read N bytes from P's stream into OUT.  Bytes past the end of the file are
+ * read as 0, which the states reject as they would any other bad data.
+ */
 void parser_read(Parser *restrict p, void *restrict out, size_t n)
 {
-    efread(out, 1, n, p->stream);
+    size_t const got = efread(out, 1, n, p->stream);
+    memset((uint8_t *)out + got, 0, n - got);
 }
 
 /** Push a Graphic Control Extension onto P's GCE stack. */
@@ -245,6 +265,22 @@ void add_plain_text_extension(Parser *p, struct GenericExtension ext)
 
 void add_extension(Parser *p, struct GenericExtension ext)
 {
+    /* Each kind of extension starts with fixed-size fields. */
+    size_t minimum_size = 0;
+    switch (ext.label)
+    {
+    case GIF_Ext_ApplicationExtension:  minimum_size = 11; break;
+    case GIF_Ext_GraphicControl:        minimum_size = 4; break;
+    case GIF_Ext_PlainText:             minimum_size = 12; break;
+    }
+    if (ext.data_size < minimum_size)
+    {
+        free(ext.data);
+        parser_error(
+            p, "extension 0x%.2hhx is only %zu bytes", ext.label,
+            ext.data_size);
+    }
+
     switch (ext.label)
     {
     case GIF_Ext_ApplicationExtension:
@@ -260,6 +296,7 @@ void add_extension(Parser *p, struct GenericExtension ext)
         add_plain_text_extension(p, ext);
         break;
     default:
+        free(ext.data);
         parser_error(p, "Invalid extension label 0x%.2hhx", ext.label);
         break;
     }
@@ -274,6 +311,7 @@ void add_extension(Parser *p, struct GenericExtension ext)
  */
 void read_data_sub_blocks(FILE *file, size_t *data_size, uint8_t **data)
 {
+    uint64_t const start = stats_now();
     *data_size = 0;
     *data = NULL;
     for(;;)
@@ -285,7 +323,7 @@ void read_data_sub_blocks(FILE *file, size_t *data_size, uint8_t **data)
 
         /* A block_size of 0 means we're done. */
         if (block_size == 0)
-            return;
+            break;
 
         /* Resize the data buffer to fit the block. */
         errno = 0;
@@ -297,6 +335,7 @@ void read_data_sub_blocks(FILE *file, size_t *data_size, uint8_t **data)
         efread(*data + *data_size, 1, block_size, file);
         *data_size += block_size;
     }
+    stats_stage_end(STATS_STAGE_FILE_READ, start);
 }
 
 /**
@@ -305,15 +344,16 @@ void read_data_sub_blocks(FILE *file, size_t *data_size, uint8_t **data)
  */
 struct GIF_ColorTable *read_color_table(FILE *file, bool sorted, size_t size)
 {
+    uint64_t const start = stats_now();
     struct GIF_ColorTable *out = malloc(sizeof(*out));
     out->sorted = sorted;
     out->size = size;
     out->colors = malloc(3 * size);
     efread(out->colors, 3, size, file);
+    stats_stage_end(STATS_STAGE_FILE_READ, start);
     return out;
 }
 
-/** Deinterlace interlaced GIF image data. */
 void deinterlace(struct GIF_Image *image)
 {
     uint8_t *interlaced = image->pixels;
@@ -385,9 +425,38 @@ ParseState _state_image_data(Parser *p, struct GIF_Image *image)
     size_t compressed_size = 0;
     read_data_sub_blocks(p->stream, &compressed_size, &compressed);
 
-    image->size = unlzw(min_code_size, compressed, &image->pixels);
+    uint64_t const lzw_start = stats_now();
+    image->size = 0;
+    image->pixels = NULL;
+    /* Codes can't be longer than 12 bits.  Images with impossible code sizes
+     * are left blank by the padding below. */
+    if (min_code_size >= 1 && min_code_size <= 11)
+    {
+        image->size = unlzw(
+            min_code_size, compressed, compressed_size, &image->pixels);
+    }
+    else
+        warn("bad LZW minimum code size %hhu\n", min_code_size);
+    stats_stage_end(STATS_STAGE_LZW, lzw_start);
+
+    /* Pad out truncated image data, so there's a pixel for every position. */
+    size_t const pixel_count = (size_t)image->width * image->height;
+    if (image->size < pixel_count)
+    {
+        image->pixels = realloc(image->pixels, pixel_count);
+        memset(image->pixels + image->size, 0, pixel_count - image->size);
+        image->size = pixel_count;
+    }
+    trace_span("unlzw", lzw_start, TRACE_NO_ARG, image->size);
+    stats_count(STATS_COUNTER_BYTES_DECODED, image->size);
+    stats_memory_add(STATS_MEMORY_PIXELS, image->size);
+
     if (image->interlace_flag)
+    {
+        uint64_t const deinterlace_start = stats_now();
         deinterlace(image);
+        stats_stage_end(STATS_STAGE_DEINTERLACE, deinterlace_start);
+    }
 
     free(compressed);
     return STATE_DATA;
@@ -502,21 +571,148 @@ ParseState state_header(Parser *p)
 }
 
 
-GIF gif_from_file(char const *filename)
+/** Run P's current state, moving it on to the next. */
+void _step_parser(Parser *p)
+{
+    ParseState const state = p->state;
+    uint64_t const state_start = stats_now();
+    long const offset = ftell(p->stream);
+    p->state = p->state.fn(p);
+    trace_span(
+        state.name, state_start, TRACE_NO_ARG, ftell(p->stream) - offset);
+}
+
+/**
+ * Run P until it finishes, or until its first image if FIRST_IMAGE_ONLY.  If
+ * RECOVERABLE, errors return false rather than exiting.
+ */
+bool _run_parser(Parser *p, bool first_image_only, bool recoverable)
 {
+    /* P isn't local to this function, so it keeps its value across the
+     * longjmp. */
+    jmp_buf recover;
+    p->recover = recoverable? &recover : NULL;
+    if (setjmp(recover) != 0)
+        return false;
+    while (p->state.fn)
+    {
+        bool const was_image = p->state.fn == state_image;
+        _step_parser(p);
+        if (first_image_only && was_image)
+            break;
+    }
+    return true;
+}
+
+/**
+ * Parse FILENAME into OUT, stopping after its first image if
+ * FIRST_IMAGE_ONLY.  If RECOVERABLE, errors are returned rather than exiting.
+ */
+enum GIF_Error _parse_file(
+    char const *filename, bool first_image_only, bool recoverable, GIF *out)
+{
+    uint64_t const start = stats_now();
     errno = 0;
     FILE *file = fopen(filename, "rb");
     if (file == NULL)
-        fatal("fopen: %s\n", strerror(errno));
+    {
+        if (!recoverable)
+            fatal("fopen: %s\n", strerror(errno));
+        error("fopen: %s: %s\n", filename, strerror(errno));
+        return GIF_ERROR_OPEN;
+    }
 
     Parser p = {.stream = file, .state = STATE_HEADER, .gext_stack=NULL};
-    while (p.state.fn)
-        p.state = p.state.fn(&p);
+    bool const ok = _run_parser(&p, first_image_only, recoverable);
+    stats_count(STATS_COUNTER_BYTES_READ, ftell(file));
 
     errno = 0;
-    if (fclose(file))
+    if (fclose(file) && ok)
         fatal("fclose: %s\n", strerror(errno));
 
     parser_free(&p);
-    return p.result;
+    stats_stage_end(STATS_STAGE_PARSE, start);
+    if (!ok)
+    {
+        gif_free(p.result);
+        return GIF_ERROR_PARSE;
+    }
+    *out = p.result;
+    return GIF_OK;
+}
+
+
+GIF gif_from_file(char const *filename)
+{
+    GIF out;
+    _parse_file(filename, false, false, &out);
+    return out;
+}
+
+GIF gif_first_image_from_file(char const *filename)
+{
+    GIF out;
+    _parse_file(filename, true, false, &out);
+    return out;
+}
+
+enum GIF_Error gif_try_from_file(char const *filename, GIF *out)
+{
+    return _parse_file(filename, false, true, out);
+}
+
+enum GIF_Error gif_try_first_image_from_file(char const *filename, GIF *out)
+{
+    return _parse_file(filename, true, true, out);
+}
+
+struct GIF_Reader *gif_read_begin(char const *filename, GIF const **gif)
+{
+    uint64_t const start = stats_now();
+    errno = 0;
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL)
+        fatal("fopen: %s\n", strerror(errno));
+
+    struct GIF_Reader *reader = malloc(sizeof(*reader));
+    reader->parser = (Parser){
+        .stream = file, .state = STATE_HEADER, .gext_stack = NULL,
+        .recover = NULL
+    };
+    /* The header and logical screen descriptor come before any data. */
+    while (reader->parser.state.fn != state_data)
+        _step_parser(&reader->parser);
+    stats_stage_end(STATS_STAGE_PARSE, start);
+    *gif = &reader->parser.result;
+    return reader;
+}
+
+struct GIF_Graphic *gif_read_graphic(struct GIF_Reader *reader)
+{
+    uint64_t const start = stats_now();
+    Parser *p = &reader->parser;
+    while (p->state.fn && !p->result.graphics)
+        _step_parser(p);
+    stats_stage_end(STATS_STAGE_PARSE, start);
+
+    /* Each graphic is taken out of the list as soon as it's read. */
+    LinkedList *node = p->result.graphics;
+    if (!node)
+        return NULL;
+    p->result.graphics = NULL;
+    struct GIF_Graphic *graphic = node->data;
+    free(node);
+    return graphic;
+}
+
+void gif_read_end(struct GIF_Reader *reader)
+{
+    Parser *p = &reader->parser;
+    stats_count(STATS_COUNTER_BYTES_READ, ftell(p->stream));
+    errno = 0;
+    if (fclose(p->stream))
+        fatal("fclose: %s\n", strerror(errno));
+    parser_free(p);
+    gif_free(p->result);
+    free(reader);
 }
@@ -0,0 +1,290 @@
+/*
+ * gif-save.c -- Write a GIF data stream.
+ *
+ * The writer can emit anything the loader models.  Since the loader doesn't
+ * keep track of where comments and application extensions appeared relative
+ * to the graphics, these are all written before the first graphic.
+ *
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "gif.h"
+#include "lzw.h"
+#include "util.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+enum GIF_BlockIdentifiers
+{
+    GIF_ExtensionIntroducer = 0x21,
+    GIF_ImageSeparator = 0x2C,
+    GIF_Trailer = 0x3B,
+};
+
+enum GIF_ExtensionBlockLabels
+{
+    GIF_Ext_PlainText = 0x01,
+    GIF_Ext_GraphicControl = 0xF9,
+    GIF_Ext_Comment = 0xFE,
+    GIF_Ext_ApplicationExtension = 0xFF
+};
+
+
+/* ===[ Primitives ]=== */
+/** Write a byte to FILE. */
+void write_byte(FILE *file, uint8_t byte)
+{
+    efwrite(&byte, 1, 1, file);
+}
+
+/** Write a little-endian 16-bit value to FILE. */
+void write_u16(FILE *file, uint16_t value)
+{
+    uint8_t const bytes[2] = {value & 0xFF, value >> 8};
+    efwrite(bytes, 1, 2, file);
+}
+
+/**
+ * Write DATA_SIZE bytes of DATA to FILE as a series of data sub-blocks,
+ * followed by a block terminator.
+ */
+void write_data_sub_blocks(FILE *file, size_t data_size, uint8_t const *data)
+{
+    while (data_size > 0)
+    {
+        uint8_t const block_size = data_size > 255? 255 : data_size;
+        write_byte(file, block_size);
+        efwrite(data, 1, block_size, file);
+        data += block_size;
+        data_size -= block_size;
+    }
+    write_byte(file, 0);
+}
+
+/**
+ * Get the exponent for TABLE's size field.  Color tables always have
+ * 2^(exponent+1) entries, so tables of other sizes get padded.
+ */
+uint8_t color_table_exponent(struct GIF_ColorTable const *table)
+{
+    uint8_t exponent = 0;
+    while (exponent < 7 && ((size_t)2 << exponent) < table->size)
+        exponent++;
+    return exponent;
+}
+
+/** Write TABLE to FILE, padding it to a power of 2 with black entries. */
+void write_color_table(FILE *file, struct GIF_ColorTable const *table)
+{
+    size_t const padded_size = (size_t)2 << color_table_exponent(table);
+    size_t const size = table->size < padded_size? table->size : padded_size;
+    efwrite(table->colors, 3, size, file);
+    for (size_t i = size; i < padded_size; ++i)
+    {
+        uint8_t const black[3] = {0, 0, 0};
+        efwrite(black, 1, 3, file);
+    }
+}
+
+/** Rearrange deinterlaced image rows into GIF interlaced order. */
+uint8_t *interlace(uint8_t const *pixels, uint16_t width, uint16_t height)
+{
+    static size_t const starts[4] = {0, 4, 2, 1};
+    static size_t const steps[4] = {8, 8, 4, 2};
+
+    uint8_t *interlaced = malloc((size_t)width * height);
+    size_t n = 0;
+    for (size_t pass = 0; pass < 4; ++pass)
+    {
+        for (size_t y = starts[pass]; y < height; ++n, y += steps[pass])
+        {
+            memcpy(
+                interlaced + n * width,
+                pixels + y * width,
+                width);
+        }
+    }
+    return interlaced;
+}
+
+
+/* ===[ Blocks ]=== */
+void write_application_extension(
+    FILE *file, struct GIF_ApplicationExt const *appext)
+{
+    write_byte(file, GIF_ExtensionIntroducer);
+    write_byte(file, GIF_Ext_ApplicationExtension);
+    write_byte(file, 11);
+    efwrite(appext->appid, 1, 8, file);
+    efwrite(appext->auth_code, 1, 3, file);
+    write_data_sub_blocks(file, appext->data_size, appext->data);
+}
+
+void write_comment_extension(FILE *file, char const *comment)
+{
+    write_byte(file, GIF_ExtensionIntroducer);
+    write_byte(file, GIF_Ext_Comment);
+    write_data_sub_blocks(file, strlen(comment), (uint8_t const *)comment);
+}
+
+void write_graphic_control_extension(
+    FILE *file, struct GIF_GraphicExt const *gext)
+{
+    uint8_t const fields = (
+        ((gext->disposal_method & 7) << 2)
+        | (gext->user_input_flag << 1)
+        | gext->transparent_color_flag);
+    write_byte(file, GIF_ExtensionIntroducer);
+    write_byte(file, GIF_Ext_GraphicControl);
+    write_byte(file, 4);
+    write_byte(file, fields);
+    write_u16(file, gext->delay_time);
+    write_byte(file, gext->transparent_color_idx);
+    write_byte(file, 0);
+}
+
+void write_plain_text_extension(
+    FILE *file, struct GIF_PlainTextExt const *ptext)
+{
+    write_byte(file, GIF_ExtensionIntroducer);
+    write_byte(file, GIF_Ext_PlainText);
+    write_byte(file, 12);
+    write_u16(file, ptext->tg_left);
+    write_u16(file, ptext->tg_top);
+    write_u16(file, ptext->tg_width);
+    write_u16(file, ptext->tg_height);
+    write_byte(file, ptext->cell_width);
+    write_byte(file, ptext->cell_height);
+    write_byte(file, ptext->fg_idx);
+    write_byte(file, ptext->bg_idx);
+    write_data_sub_blocks(file, ptext->data_size, ptext->data);
+}
+
+void write_image(
+    FILE *file, struct GIF_Image const *image,
+    struct GIF_ColorTable const *gct)
+{
+    struct GIF_ColorTable const *const lct = (
+        image->color_table != gct? image->color_table : NULL);
+
+    uint8_t fields = image->interlace_flag << 6;
+    if (lct)
+        fields |= (1 << 7) | (lct->sorted << 5) | color_table_exponent(lct);
+
+    write_byte(file, GIF_ImageSeparator);
+    write_u16(file, image->left);
+    write_u16(file, image->top);
+    write_u16(file, image->width);
+    write_u16(file, image->height);
+    write_byte(file, fields);
+    if (lct)
+        write_color_table(file, lct);
+
+    /* The loader pads or truncates image data as needed, but the encoder
+     * needs exactly one byte per pixel. */
+    size_t const pixel_count = (size_t)image->width * image->height;
+    uint8_t *pixels = calloc(pixel_count? pixel_count : 1, 1);
+    memcpy(
+        pixels, image->pixels,
+        image->size < pixel_count? image->size : pixel_count);
+    if (image->interlace_flag)
+    {
+        uint8_t *interlaced = interlace(pixels, image->width, image->height);
+        free(pixels);
+        pixels = interlaced;
+    }
+
+    /* The code size has to fit every color index, and the spec sets a
+     * minimum of 2. */
+    uint8_t max_index = 0;
+    for (size_t i = 0; i < pixel_count; ++i)
+        if (pixels[i] > max_index)
+            max_index = pixels[i];
+    uint8_t min_code_size = 2;
+    while (min_code_size < 8 && (1u << min_code_size) <= max_index)
+        min_code_size++;
+
+    uint8_t *compressed = NULL;
+    size_t const compressed_size = lzw(
+        min_code_size, pixels, pixel_count, &compressed);
+    write_byte(file, min_code_size);
+    write_data_sub_blocks(file, compressed_size, compressed);
+
+    free(compressed);
+    free(pixels);
+}
+
+
+/* ===[ Public ]=== */
+void gif_write_begin(FILE *file, GIF const *gif)
+{
+    efwrite(gif->version == GIF_Version_87a? "GIF87a" : "GIF89a", 1, 6, file);
+
+    struct GIF_ColorTable const *const gct = gif->global_color_table;
+    uint8_t fields = (gif->color_resolution & 7) << 4;
+    if (gct)
+        fields |= (1 << 7) | (gct->sorted << 3) | color_table_exponent(gct);
+    write_u16(file, gif->width);
+    write_u16(file, gif->height);
+    write_byte(file, fields);
+    write_byte(file, gif->bg_color_index);
+    write_byte(file, gif->pixel_aspect_ratio);
+    if (gct)
+        write_color_table(file, gct);
+
+    for (LinkedList *node = gif->app_extensions; node; node = node->next)
+        write_application_extension(file, node->data);
+    for (LinkedList *node = gif->comments; node; node = node->next)
+        write_comment_extension(file, node->data);
+}
+
+void gif_write_graphic(
+    FILE *file, GIF const *gif, struct GIF_Graphic const *graphic)
+{
+    if (graphic->extension)
+        write_graphic_control_extension(file, graphic->extension);
+    if (graphic->is_img)
+        write_image(file, &graphic->img, gif->global_color_table);
+    else
+        write_plain_text_extension(file, &graphic->plaintext);
+}
+
+void gif_write_end(FILE *file)
+{
+    write_byte(file, GIF_Trailer);
+}
+
+void gif_to_file(GIF const *gif, char const *filename)
+{
+    errno = 0;
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL)
+        fatal("fopen: %s\n", strerror(errno));
+
+    gif_write_begin(file, gif);
+    for (LinkedList *node = gif->graphics; node; node = node->next)
+        gif_write_graphic(file, gif, node->data);
+    gif_write_end(file);
+
+    errno = 0;
+    if (fclose(file))
+        fatal("fclose: %s\n", strerror(errno));
+}
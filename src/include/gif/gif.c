@@ -18,6 +18,7 @@
  */
 
 #include "gif.h"
+#include "stats/stats.h"
 
 #include <stdlib.h>
 
@@ -37,6 +38,7 @@ void gif_free_image(struct GIF_Image *image, struct GIF_ColorTable *gct)
         free(image->color_table);
     }
     free(image->pixels);
+    stats_memory_remove(STATS_MEMORY_PIXELS, image->size);
 }
 
 void gif_free_plaintextext(struct GIF_PlainTextExt *pte)
@@ -62,22 +64,27 @@ void gif_free_graphic(struct GIF_Graphic *g, struct GIF_ColorTable *gct)
 }
 
 
-void gif_free(GIF gif)
+void gif_free_graphics(GIF *gif)
 {
-    if (gif.global_color_table != NULL)
-    {
-        gif_free_colortable(gif.global_color_table);
-        free(gif.global_color_table);
-    }
-
-    for (LinkedList *node = gif.graphics; node != NULL;)
+    for (LinkedList *node = gif->graphics; node != NULL;)
     {
-        gif_free_graphic(node->data, gif.global_color_table);
+        gif_free_graphic(node->data, gif->global_color_table);
         LinkedList *next = node->next;
         free(node->data);
         free(node);
         node = next;
     }
+    gif->graphics = NULL;
+}
+
+void gif_free(GIF gif)
+{
+    gif_free_graphics(&gif);
+    if (gif.global_color_table != NULL)
+    {
+        gif_free_colortable(gif.global_color_table);
+        free(gif.global_color_table);
+    }
 
     for (LinkedList *node = gif.comments; node != NULL;)
     {
@@ -25,6 +25,7 @@
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
+#include <stdio.h>
 
 
 /** GIF Versions. */
@@ -166,11 +167,82 @@ typedef struct GIF
 } GIF;
 
 
-/* Load a GIF from a file. */
+/* Reasons gif_try_from_file can fail. */
+enum GIF_Error
+{
+    GIF_OK,
+    /* The file couldn't be opened. */
+    GIF_ERROR_OPEN,
+    /* The file isn't a valid GIF. */
+    GIF_ERROR_PARSE,
+};
+
+
+/* Load a GIF from a file.  Exits if the file can't be opened or parsed. */
 GIF gif_from_file(char const *filename);
 
+/*
+ * Load a GIF from a file, stopping after its first image.  The rest of the
+ * file isn't read, so the result only has the blocks up to and including that
+ * image.  Much cheaper than gif_from_file when only a preview is needed.
+ */
+GIF gif_first_image_from_file(char const *filename);
+
+/*
+ * Like gif_from_file, but report errors and return them instead of exiting.
+ * OUT is only set on success.  Safe to call from any thread.
+ */
+enum GIF_Error gif_try_from_file(char const *filename, GIF *out);
+
+/* Like gif_first_image_from_file, but return errors like gif_try_from_file. */
+enum GIF_Error gif_try_first_image_from_file(char const *filename, GIF *out);
+
 /* Deallocate GIF data. */
 void gif_free(GIF gif);
 
+/*
+ * Deallocate GRAPHIC's data, but not GRAPHIC itself.  GCT is its GIF's global
+ * color table, which images without a color table of their own point to.
+ */
+void gif_free_graphic(struct GIF_Graphic *graphic, struct GIF_ColorTable *gct);
+
+/*
+ * Deallocate GIF's graphics, keeping everything else, e.g. once they've been
+ * composited into frames.
+ */
+void gif_free_graphics(GIF *gif);
+
+/* Write a GIF to a file. */
+void gif_to_file(GIF const *gif, char const *filename);
+
+/*
+ * Streaming GIF output, for GIFs too big to hold in memory at once.
+ * gif_write_begin writes everything in GIF except its graphics, which are then
+ * written one at a time with gif_write_graphic.  gif_write_end finishes the
+ * data stream.
+ */
+void gif_write_begin(FILE *file, GIF const *gif);
+void gif_write_graphic(
+    FILE *file, GIF const *gif, struct GIF_Graphic const *graphic);
+void gif_write_end(FILE *file);
+
+/*
+ * Streaming GIF input, the counterpart of gif_write_begin.  gif_read_begin
+ * opens FILENAME and reads everything before its first graphic, pointing *GIF
+ * at the result.  Graphics are then read one at a time with gif_read_graphic,
+ * which returns NULL once there are none left.  They aren't added to *GIF,
+ * and are freed by the caller with gif_free_graphic and free.  Comments and
+ * application extensions are added to *GIF as they're read.  gif_read_end
+ * closes the file and frees *GIF.  Exits if the file can't be opened or
+ * parsed, like gif_from_file.
+ */
+struct GIF_Reader;
+struct GIF_Reader *gif_read_begin(char const *filename, GIF const **gif);
+struct GIF_Graphic *gif_read_graphic(struct GIF_Reader *reader);
+void gif_read_end(struct GIF_Reader *reader);
+
+/* Deinterlace interlaced GIF image data. */
+void deinterlace(struct GIF_Image *image);
+
 
 #endif /* GIFVIEW_GIF_H */
@@ -1,5 +1,5 @@
 /*
- * lzw.c -- LZW decoding definitions.
+ * lzw.c -- LZW encoding/decoding definitions.
  *
  * Copyright (C) 2022 Trevor Last
  *
@@ -25,13 +25,6 @@
 #include <string.h>
 
 
-struct Bitstream
-{
-    uint8_t const *stream;
-    size_t byte;
-    size_t bit;
-};
-
 struct String
 {
     size_t size;
@@ -46,7 +39,6 @@ struct Buffer
 };
 
 
-/** Read N bits from STREAM. */
 unsigned int bitstream_read(size_t n, struct Bitstream *stream)
 {
     unsigned int out = 0;
@@ -54,7 +46,10 @@ unsigned int bitstream_read(size_t n, struct Bitstream *stream)
 
     for (size_t i = 0; i < n; ++i)
     {
-        unsigned int b = (stream->stream[stream->byte] >> (stream->bit++)) & 1;
+        unsigned int b = 0;
+        if (stream->byte < stream->size)
+            b = (stream->stream[stream->byte] >> stream->bit) & 1;
+        stream->bit++;
         if (stream->bit >= 8)
         {
             stream->byte++;
@@ -94,7 +89,8 @@ void append(struct Buffer *buffer, struct String data)
 }
 
 
-size_t unlzw(size_t min_code_size, uint8_t const *in, uint8_t **out)
+size_t unlzw(
+    size_t min_code_size, uint8_t const *in, size_t size, uint8_t **out)
 {
     /* GIF has a maximum code size of 12 bits, the maximum code table size is
      * 2^12 = 4096 codes. */
@@ -120,7 +116,7 @@ size_t unlzw(size_t min_code_size, uint8_t const *in, uint8_t **out)
         table[i].data[0] = i;
     }
 
-    struct Bitstream input = {.stream = in, .byte = 0, .bit = 0};
+    struct Bitstream input = {.stream = in, .size = size, .byte = 0, .bit = 0};
     struct Buffer output = {.size = 0, .data = NULL};
 
     uint16_t symbol = 0;
@@ -128,8 +124,10 @@ size_t unlzw(size_t min_code_size, uint8_t const *in, uint8_t **out)
      * codes until we get a proper code. */
     do
     {
+        if (input.byte >= size)
+            goto LZW_done;
         symbol = bitstream_read(code_size, &input);
-        if (symbol == eoi)
+        if (symbol == eoi || symbol > cc)
             goto LZW_done;
     } while (symbol == cc);
     struct String previous = table[symbol];
@@ -137,6 +135,8 @@ size_t unlzw(size_t min_code_size, uint8_t const *in, uint8_t **out)
 
     for(;;)
     {
+        if (input.byte >= size)
+            goto LZW_done;
         symbol = bitstream_read(code_size, &input);
         if (symbol == cc)
         {
@@ -146,8 +146,10 @@ size_t unlzw(size_t min_code_size, uint8_t const *in, uint8_t **out)
             next = cc + 2;
             do
             {
+                if (input.byte >= size)
+                    goto LZW_done;
                 symbol = bitstream_read(code_size, &input);
-                if (symbol == eoi)
+                if (symbol == eoi || symbol > cc)
                     goto LZW_done;
             } while (symbol == cc);
             previous = table[symbol];
@@ -157,6 +159,11 @@ size_t unlzw(size_t min_code_size, uint8_t const *in, uint8_t **out)
         {
             goto LZW_done;
         }
+        else if (symbol > next)
+        {
+            /* Not in the table yet, so the data is corrupt. */
+            goto LZW_done;
+        }
         else if (symbol < next)
         {
             struct String const W = table[symbol];
@@ -186,3 +193,111 @@ LZW_done:
     *out = realloc(output.data, output.size);
     return output.size;
 }
+
+
+/** Bit-level output stream.  Bits are packed least-significant first. */
+struct BitWriter
+{
+    struct Buffer buffer;
+    uint32_t pending;
+    size_t pending_bits;
+};
+
+/** Write the low N bits of CODE to WRITER. */
+void bitwriter_write(struct BitWriter *writer, unsigned int code, size_t n)
+{
+    writer->pending |= (uint32_t)code << writer->pending_bits;
+    writer->pending_bits += n;
+    while (writer->pending_bits >= 8)
+    {
+        struct Buffer *const buffer = &writer->buffer;
+        if (buffer->size == buffer->allocated)
+        {
+            buffer->allocated = buffer->allocated? 2 * buffer->allocated : 4096;
+            buffer->data = realloc(buffer->data, buffer->allocated);
+        }
+        buffer->data[buffer->size++] = writer->pending & 0xFF;
+        writer->pending >>= 8;
+        writer->pending_bits -= 8;
+    }
+}
+
+/** Write any partial byte left in WRITER. */
+void bitwriter_flush(struct BitWriter *writer)
+{
+    if (writer->pending_bits > 0)
+        bitwriter_write(writer, 0, 8 - writer->pending_bits);
+}
+
+
+size_t lzw(size_t min_code_size, uint8_t const *in, size_t size, uint8_t **out)
+{
+    /* Same limits as unlzw. */
+    size_t const table_size = 4096;
+    /* The dictionary maps (prefix code, suffix byte) pairs to codes.  It's an
+     * open-addressed hash table; 5003 is prime and about 20% bigger than
+     * TABLE_SIZE, which keeps the probe chains short. */
+    size_t const hash_size = 5003;
+    int32_t keys[hash_size];
+    uint16_t codes[hash_size];
+
+    size_t code_size = min_code_size + 1;
+    uint16_t const cc = 1 << min_code_size;
+    uint16_t const eoi = cc + 1;
+    uint16_t next = cc + 2;
+
+    struct BitWriter output = {
+        .buffer = {.size = 0, .allocated = 0, .data = NULL},
+        .pending = 0,
+        .pending_bits = 0
+    };
+    memset(keys, -1, sizeof(keys));
+    bitwriter_write(&output, cc, code_size);
+
+    if (size == 0)
+        goto LZW_done;
+
+    uint16_t prefix = in[0];
+    for (size_t i = 1; i < size; ++i)
+    {
+        uint8_t const suffix = in[i];
+        int32_t const key = ((int32_t)prefix << 8) | suffix;
+        size_t h = (((size_t)suffix << 4) ^ prefix) % hash_size;
+        while (keys[h] != -1 && keys[h] != key)
+            h = (h + 1) % hash_size;
+        if (keys[h] == key)
+        {
+            prefix = codes[h];
+            continue;
+        }
+
+        bitwriter_write(&output, prefix, code_size);
+        /* The decoder builds its table one code behind us, so the code size
+         * check has to happen before the new entry is added to keep the two
+         * in step. */
+        if (next == (1 << code_size) && next < table_size)
+            code_size++;
+        if (next < table_size)
+        {
+            keys[h] = key;
+            codes[h] = next++;
+        }
+        else
+        {
+            bitwriter_write(&output, cc, code_size);
+            memset(keys, -1, sizeof(keys));
+            code_size = min_code_size + 1;
+            next = cc + 2;
+        }
+        prefix = suffix;
+    }
+    bitwriter_write(&output, prefix, code_size);
+    if (next == (1 << code_size) && next < table_size)
+        code_size++;
+
+LZW_done:
+    bitwriter_write(&output, eoi, code_size);
+    bitwriter_flush(&output);
+    *out = realloc(output.buffer.data, output.buffer.size);
+    return output.buffer.size;
+}
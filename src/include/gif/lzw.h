@@ -1,5 +1,5 @@
 /*
- * lzw.h -- LZW decoding declarations.
+ * lzw.h -- LZW encoding/decoding declarations.
  *
  * Copyright (C) 2022 Trevor Last
  *
@@ -25,10 +25,34 @@
 
 
 /**
- * Decompress LZW-compressed data from IN into OUT.  Returns the number of
- * bytes stored in OUT.
+ * Bit-level input stream.  Bits are read least-significant first.  STREAM has
+ * SIZE bytes, and bits past its end read as 0.
  */
-size_t unlzw(size_t min_code_size, uint8_t const *in, uint8_t **out);
+struct Bitstream
+{
+    uint8_t const *stream;
+    size_t size;
+    size_t byte;
+    size_t bit;
+};
+
+/** Read N bits from STREAM. */
+unsigned int bitstream_read(size_t n, struct Bitstream *stream);
+
+/**
+ * Decompress SIZE bytes of LZW-compressed data from IN into OUT.  Returns the
+ * number of bytes stored in OUT.  Decoding stops early, keeping what's been
+ * decoded so far, if IN runs out or holds an invalid code.
+ */
+size_t unlzw(
+    size_t min_code_size, uint8_t const *in, size_t size, uint8_t **out);
+
+/**
+ * Compress SIZE bytes of IN into OUT, using GIF-style variable length LZW
+ * codes.  Every byte of IN must be less than 2^MIN_CODE_SIZE.  Returns the
+ * number of bytes stored in OUT.
+ */
+size_t lzw(size_t min_code_size, uint8_t const *in, size_t size, uint8_t **out);
 
 
 #endif /* GIFVIEW_LZW_H */
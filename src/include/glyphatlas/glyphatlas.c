@@ -0,0 +1,291 @@
+/*
+ * glyphatlas.c -- Glyph atlas definitions.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "glyphatlas.h"
+#include "util.h"
+#include "stats/stats.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <SDL2/SDL_ttf.h>
+
+
+#define FIRST_GLYPH ' '
+#define LAST_GLYPH  '~'
+#define GLYPH_COUNT (LAST_GLYPH - FIRST_GLYPH + 1)
+
+/** Minimum width of the atlas texture. */
+static int const ATLAS_WIDTH = 512;
+/** Gap between packed glyphs, so filtering doesn't bleed between them. */
+static int const PADDING = 1;
+
+
+/** Where a character's glyphs are in the atlas texture. */
+struct Glyph
+{
+    SDL_Rect plain, outlined;
+    /** Distance to the next character's origin. */
+    int advance;
+};
+
+struct GlyphAtlas
+{
+    SDL_Renderer *renderer;
+    char *file;
+    int ptsize;
+    /** White glyphs; color mod picks the drawn color. */
+    SDL_Texture *texture;
+    size_t bytes;
+    /** Height of a line of plain text. */
+    int height;
+    struct Glyph glyphs[GLYPH_COUNT];
+    /** Next atlas in the cache. */
+    struct GlyphAtlas *next;
+};
+
+/** Every atlas built so far. */
+static struct GlyphAtlas *atlases = NULL;
+
+
+/** Glyph of the character at *TEXT, advancing *TEXT past the character. */
+struct Glyph const *
+_next_glyph(struct GlyphAtlas const *atlas, char const **text)
+{
+    unsigned char c = (unsigned char)*(*text)++;
+    if (c >= 0x80)
+    {
+        /* Skip the rest of a multi-byte character. */
+        while (((unsigned char)**text & 0xC0) == 0x80)
+            (*text)++;
+    }
+    if (c < FIRST_GLYPH || c > LAST_GLYPH)
+        c = '?';
+    return &atlas->glyphs[c - FIRST_GLYPH];
+}
+
+/** Rasterize every glyph of FILE at PTSIZE and upload them to RENDERER. */
+struct GlyphAtlas *
+_build_atlas(SDL_Renderer *renderer, char const *file, int ptsize)
+{
+    static SDL_Color const WHITE = {0xff, 0xff, 0xff, 0xff};
+
+    lock_ttf();
+    uint64_t const font_start = stats_now();
+    TTF_Font *font = TTF_OpenFont(file, ptsize);
+    stats_stage_end(STATS_STAGE_FONT_LOAD, font_start);
+    if (!font)
+    {
+        unlock_ttf();
+        return NULL;
+    }
+
+    struct GlyphAtlas *atlas = malloc(sizeof(*atlas));
+    size_t const file_length = strlen(file) + 1;
+    atlas->renderer = renderer;
+    atlas->file = malloc(file_length);
+    memcpy(atlas->file, file, file_length);
+    atlas->ptsize = ptsize;
+    atlas->height = TTF_FontHeight(font);
+
+    /* Plain glyphs first, since setting the outline changes the metrics. */
+    SDL_Surface *surfaces[2][GLYPH_COUNT];
+    for (int i = 0; i < GLYPH_COUNT; ++i)
+    {
+        int advance = 0;
+        TTF_GlyphMetrics(
+            font, FIRST_GLYPH + i, NULL, NULL, NULL, NULL, &advance);
+        atlas->glyphs[i].advance = advance;
+        surfaces[0][i] = TTF_RenderGlyph_Blended(font, FIRST_GLYPH + i, WHITE);
+    }
+    TTF_SetFontOutline(font, GLYPHATLAS_OUTLINE);
+    for (int i = 0; i < GLYPH_COUNT; ++i)
+        surfaces[1][i] = TTF_RenderGlyph_Blended(font, FIRST_GLYPH + i, WHITE);
+    TTF_CloseFont(font);
+    unlock_ttf();
+
+    /* Pack the glyphs into rows, left to right. */
+    int width = ATLAS_WIDTH;
+    for (int pass = 0; pass < 2; ++pass)
+        for (int i = 0; i < GLYPH_COUNT; ++i)
+            if (surfaces[pass][i] && surfaces[pass][i]->w > width)
+                width = surfaces[pass][i]->w;
+    int x = 0, y = 0, row_height = 0;
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (int i = 0; i < GLYPH_COUNT; ++i)
+        {
+            SDL_Surface const *surface = surfaces[pass][i];
+            SDL_Rect *rect = (
+                pass == 0? &atlas->glyphs[i].plain
+                : &atlas->glyphs[i].outlined);
+            *rect = (SDL_Rect){.x=0, .y=0, .w=0, .h=0};
+            if (!surface)
+                continue;
+            if (x + surface->w > width)
+            {
+                x = 0;
+                y += row_height + PADDING;
+                row_height = 0;
+            }
+            *rect = (SDL_Rect){.x=x, .y=y, .w=surface->w, .h=surface->h};
+            x += surface->w + PADDING;
+            if (surface->h > row_height)
+                row_height = surface->h;
+        }
+    }
+    int const height = y + row_height;
+
+    SDL_Surface *sheet = SDL_CreateRGBSurfaceWithFormat(
+        0, width, height, 32, SDL_PIXELFORMAT_ARGB8888);
+    if (!sheet)
+        error("SDL_CreateRGBSurfaceWithFormat -- %s\n", SDL_GetError());
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        for (int i = 0; i < GLYPH_COUNT; ++i)
+        {
+            SDL_Surface *surface = surfaces[pass][i];
+            if (!surface)
+                continue;
+            SDL_Rect rect = (
+                pass == 0? atlas->glyphs[i].plain : atlas->glyphs[i].outlined);
+            SDL_SetSurfaceBlendMode(surface, SDL_BLENDMODE_NONE);
+            if (sheet)
+                SDL_BlitSurface(surface, NULL, sheet, &rect);
+            SDL_FreeSurface(surface);
+        }
+    }
+
+    atlas->texture = NULL;
+    atlas->bytes = 0;
+    if (sheet)
+        atlas->texture = SDL_CreateTextureFromSurface(renderer, sheet);
+    if (atlas->texture)
+    {
+        SDL_SetTextureBlendMode(atlas->texture, SDL_BLENDMODE_BLEND);
+        atlas->bytes = (size_t)width * height * 4;
+        stats_count(STATS_COUNTER_TEXTURES_CREATED, 1);
+        stats_count(STATS_COUNTER_TEXTURE_BYTES, atlas->bytes);
+        stats_memory_add(STATS_MEMORY_UI_TEXTURES, atlas->bytes);
+    }
+    else if (sheet)
+        error("SDL_CreateTextureFromSurface -- %s\n", SDL_GetError());
+    SDL_FreeSurface(sheet);
+    return atlas;
+}
+
+
+struct GlyphAtlas *
+glyphatlas_get(SDL_Renderer *renderer, char const *file, int ptsize)
+{
+    for (struct GlyphAtlas *atlas = atlases; atlas; atlas = atlas->next)
+    {
+        if (atlas->renderer == renderer
+            && atlas->ptsize == ptsize
+            && strcmp(atlas->file, file) == 0)
+            return atlas;
+    }
+    struct GlyphAtlas *atlas = _build_atlas(renderer, file, ptsize);
+    if (atlas)
+    {
+        atlas->next = atlases;
+        atlases = atlas;
+    }
+    return atlas;
+}
+
+void glyphatlas_quit(void)
+{
+    while (atlases)
+    {
+        struct GlyphAtlas *next = atlases->next;
+        stats_memory_remove(STATS_MEMORY_UI_TEXTURES, atlases->bytes);
+        SDL_DestroyTexture(atlases->texture);
+        free(atlases->file);
+        free(atlases);
+        atlases = next;
+    }
+}
+
+SDL_Rect glyphatlas_measure(
+    struct GlyphAtlas const *atlas, char const *text, bool outlined)
+{
+    SDL_Rect rect = {.x=0, .y=0, .w=0, .h=0};
+    if (!atlas)
+        return rect;
+    int pen = 0;
+    while (*text)
+    {
+        struct Glyph const *glyph = _next_glyph(atlas, &text);
+        if (pen + glyph->plain.w > rect.w)
+            rect.w = pen + glyph->plain.w;
+        pen += glyph->advance;
+    }
+    if (pen > rect.w)
+        rect.w = pen;
+    rect.h = atlas->height;
+    if (outlined)
+    {
+        rect.w += 2 * GLYPHATLAS_OUTLINE;
+        rect.h += 2 * GLYPHATLAS_OUTLINE;
+    }
+    return rect;
+}
+
+void glyphatlas_draw(
+    struct GlyphAtlas const *atlas, char const *text, int x, int y,
+    SDL_Color color, bool outlined)
+{
+    if (!atlas || !atlas->texture)
+        return;
+    /* All outlines go down before any fill, same as blitting the plain text
+     * over the outlined text. */
+    SDL_SetTextureAlphaMod(atlas->texture, color.a);
+    if (outlined)
+    {
+        SDL_SetTextureColorMod(atlas->texture, 0x00, 0x00, 0x00);
+        int pen = x;
+        for (char const *c = text; *c;)
+        {
+            struct Glyph const *glyph = _next_glyph(atlas, &c);
+            SDL_Rect const dst = {
+                .x=pen, .y=y, .w=glyph->outlined.w, .h=glyph->outlined.h
+            };
+            if (dst.w > 0)
+                SDL_RenderCopy(
+                    atlas->renderer, atlas->texture, &glyph->outlined, &dst);
+            pen += glyph->advance;
+        }
+        x += GLYPHATLAS_OUTLINE;
+        y += GLYPHATLAS_OUTLINE;
+    }
+    SDL_SetTextureColorMod(atlas->texture, color.r, color.g, color.b);
+    int pen = x;
+    for (char const *c = text; *c;)
+    {
+        struct Glyph const *glyph = _next_glyph(atlas, &c);
+        SDL_Rect const dst = {
+            .x=pen, .y=y, .w=glyph->plain.w, .h=glyph->plain.h
+        };
+        if (dst.w > 0)
+            SDL_RenderCopy(
+                atlas->renderer, atlas->texture, &glyph->plain, &dst);
+        pen += glyph->advance;
+    }
+}
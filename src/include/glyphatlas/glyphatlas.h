@@ -0,0 +1,65 @@
+/*
+ * glyphatlas.h -- Glyph atlas declarations.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFVIEW_GLYPHATLAS_H
+#define GIFVIEW_GLYPHATLAS_H
+
+#include <stdbool.h>
+
+#include <SDL2/SDL.h>
+
+
+/** Width (in pixels) of the outline around outlined text. */
+#define GLYPHATLAS_OUTLINE  2
+
+/**
+ * Printable ASCII glyphs of one font at one size, rasterized once both plain
+ * and outlined, and packed into a single texture.  Defined in glyphatlas.c.
+ */
+struct GlyphAtlas;
+
+
+/**
+ * Get the atlas for the font FILE at PTSIZE on RENDERER, building it the first
+ * time it's asked for.  Atlases are shared, so callers must not free them.
+ * Returns NULL if the font can't be loaded.
+ */
+struct GlyphAtlas *
+glyphatlas_get(SDL_Renderer *renderer, char const *file, int ptsize);
+
+/** Free every atlas.  Must be called before their renderers are destroyed. */
+void glyphatlas_quit(void);
+
+/**
+ * Size of the UTF-8 string TEXT drawn with ATLAS.  Characters outside of
+ * printable ASCII are drawn as '?'.
+ */
+SDL_Rect glyphatlas_measure(
+    struct GlyphAtlas const *atlas, char const *text, bool outlined);
+
+/**
+ * Draw TEXT with its top-left corner at X,Y in COLOR.  If OUTLINED is set, the
+ * text gets a black GLYPHATLAS_OUTLINE-wide outline.
+ */
+void glyphatlas_draw(
+    struct GlyphAtlas const *atlas, char const *text, int x, int y,
+    SDL_Color color, bool outlined);
+
+
+#endif /* GIFVIEW_GLYPHATLAS_H */
@@ -0,0 +1,237 @@
+/*
+ * stats.c -- Performance statistics definitions.
+ *
+ * Everything is updated with atomic adds, so stages can be timed from any
+ * thread.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "stats.h"
+
+#include <math.h>
+#include <stdbool.h>
+
+#include <SDL2/SDL_atomic.h>
+#include <SDL2/SDL_timer.h>
+
+
+/** Accumulated timing for a stage. */
+struct StageTotal
+{
+    uint64_t calls;
+    uint64_t ticks;
+};
+
+/** How to print a stage. */
+struct StageInfo
+{
+    char const *name;
+    /** Nesting depth; nested stages are included in their parent's time. */
+    int depth;
+};
+
+static struct StageInfo const STAGE_INFO[STATS_STAGE_COUNT] = {
+    [STATS_STAGE_STARTUP] = {"startup (to first frame)", 0},
+    [STATS_STAGE_PARSE] = {"parse", 0},
+    [STATS_STAGE_FILE_READ] = {"file read", 1},
+    [STATS_STAGE_LZW] = {"lzw", 1},
+    [STATS_STAGE_DEINTERLACE] = {"deinterlace", 1},
+    [STATS_STAGE_COMPOSITE] = {"composite", 0},
+    [STATS_STAGE_TEXTURE_UPLOAD] = {"texture upload", 0},
+    [STATS_STAGE_FONT_LOAD] = {"font load", 0},
+    [STATS_STAGE_WINDOW_CREATE] = {"window create", 0},
+};
+
+static char const *const COUNTER_NAMES[STATS_COUNTER_COUNT] = {
+    [STATS_COUNTER_BYTES_READ] = "bytes read",
+    [STATS_COUNTER_BYTES_DECODED] = "bytes decoded",
+    [STATS_COUNTER_FRAMES_COMPOSITED] = "frames composited",
+    [STATS_COUNTER_TEXTURES_CREATED] = "textures created",
+    [STATS_COUNTER_TEXTURE_BYTES] = "texture bytes",
+    [STATS_COUNTER_FRAMES_DROPPED] = "frames dropped",
+    [STATS_COUNTER_FRAMES_DUPLICATED] = "frames duplicated",
+    [STATS_COUNTER_CACHE_HITS] = "frame cache hits",
+    [STATS_COUNTER_CACHE_MISSES] = "frame cache misses",
+    [STATS_COUNTER_FRAMES_DEDUPLICATED] = "frames deduplicated",
+};
+
+static char const *const MEMORY_NAMES[STATS_MEMORY_COUNT] = {
+    [STATS_MEMORY_PIXELS] = "decoded pixels",
+    [STATS_MEMORY_SURFACES] = "surfaces",
+    [STATS_MEMORY_FRAME_TEXTURES] = "frame textures",
+    [STATS_MEMORY_UI_TEXTURES] = "font and overlay textures",
+};
+
+/* Roughly powers of 2, with the last two being one and two 60Hz refreshes. */
+double const STATS_LATE_BUCKET_BOUNDS[STATS_LATE_BUCKETS] = {
+    1, 2, 4, 8, 16.7, 33.3, 100, INFINITY
+};
+
+static struct StageTotal stages[STATS_STAGE_COUNT];
+static uint64_t counters[STATS_COUNTER_COUNT];
+static struct StatsMemoryUsage memory[STATS_MEMORY_COUNT];
+
+/** Frame lateness accumulators, protected by pacing_lock. */
+static struct
+{
+    uint64_t count;
+    double sum_ms, sum_squares_ms, max_ms;
+    uint64_t histogram[STATS_LATE_BUCKETS];
+} pacing;
+static SDL_SpinLock pacing_lock = 0;
+
+
+uint64_t stats_now(void)
+{
+    return SDL_GetPerformanceCounter();
+}
+
+void stats_stage_end(enum StatsStage stage, uint64_t start)
+{
+    uint64_t const elapsed = SDL_GetPerformanceCounter() - start;
+    __atomic_fetch_add(&stages[stage].calls, 1, __ATOMIC_RELAXED);
+    __atomic_fetch_add(&stages[stage].ticks, elapsed, __ATOMIC_RELAXED);
+}
+
+void stats_count(enum StatsCounter counter, uint64_t n)
+{
+    __atomic_fetch_add(&counters[counter], n, __ATOMIC_RELAXED);
+}
+
+void stats_memory_add(enum StatsMemory category, size_t bytes)
+{
+    struct StatsMemoryUsage *const usage = &memory[category];
+    int64_t const current = __atomic_add_fetch(
+        &usage->current, (int64_t)bytes, __ATOMIC_RELAXED);
+    int64_t peak = __atomic_load_n(&usage->peak, __ATOMIC_RELAXED);
+    while (current > peak
+        && !__atomic_compare_exchange_n(
+            &usage->peak, &peak, current,
+            true, __ATOMIC_RELAXED, __ATOMIC_RELAXED))
+        ;
+}
+
+void stats_memory_remove(enum StatsMemory category, size_t bytes)
+{
+    __atomic_sub_fetch(
+        &memory[category].current, (int64_t)bytes, __ATOMIC_RELAXED);
+}
+
+struct StatsMemoryUsage stats_memory_usage(enum StatsMemory category)
+{
+    return (struct StatsMemoryUsage){
+        .current = __atomic_load_n(&memory[category].current, __ATOMIC_RELAXED),
+        .peak = __atomic_load_n(&memory[category].peak, __ATOMIC_RELAXED),
+    };
+}
+
+void stats_frame_presented(uint64_t scheduled, uint64_t presented)
+{
+    double const ms_per_tick = 1000.0 / SDL_GetPerformanceFrequency();
+    double late_ms = 0.0;
+    if (presented > scheduled)
+        late_ms = (presented - scheduled) * ms_per_tick;
+
+    size_t bucket = 0;
+    while (late_ms >= STATS_LATE_BUCKET_BOUNDS[bucket])
+        bucket++;
+
+    SDL_AtomicLock(&pacing_lock);
+    pacing.count++;
+    pacing.sum_ms += late_ms;
+    pacing.sum_squares_ms += late_ms * late_ms;
+    if (late_ms > pacing.max_ms)
+        pacing.max_ms = late_ms;
+    pacing.histogram[bucket]++;
+    SDL_AtomicUnlock(&pacing_lock);
+}
+
+struct StatsPacing stats_pacing(void)
+{
+    struct StatsPacing out = {
+        .dropped = __atomic_load_n(
+            &counters[STATS_COUNTER_FRAMES_DROPPED], __ATOMIC_RELAXED),
+        .duplicated = __atomic_load_n(
+            &counters[STATS_COUNTER_FRAMES_DUPLICATED], __ATOMIC_RELAXED),
+    };
+
+    SDL_AtomicLock(&pacing_lock);
+    out.presented = pacing.count;
+    out.max_late_ms = pacing.max_ms;
+    if (pacing.count > 0)
+    {
+        out.mean_late_ms = pacing.sum_ms / pacing.count;
+        double const variance = (
+            pacing.sum_squares_ms / pacing.count
+            - out.mean_late_ms * out.mean_late_ms);
+        out.jitter_ms = variance > 0.0? sqrt(variance) : 0.0;
+    }
+    for (size_t i = 0; i < STATS_LATE_BUCKETS; ++i)
+        out.histogram[i] = pacing.histogram[i];
+    SDL_AtomicUnlock(&pacing_lock);
+    return out;
+}
+
+void stats_print(FILE *file)
+{
+    double const ms_per_tick = 1000.0 / SDL_GetPerformanceFrequency();
+
+    fprintf(file, "%-28s %10s %12s\n", "stage", "calls", "time (ms)");
+    for (size_t i = 0; i < STATS_STAGE_COUNT; ++i)
+    {
+        struct StageInfo const *info = &STAGE_INFO[i];
+        fprintf(file, "%*s%-*s %10llu %12.3f\n",
+            2 * info->depth, "",
+            28 - 2 * info->depth, info->name,
+            (unsigned long long)stages[i].calls,
+            stages[i].ticks * ms_per_tick);
+    }
+
+    fputc('\n', file);
+    for (size_t i = 0; i < STATS_COUNTER_COUNT; ++i)
+    {
+        fprintf(file, "%-28s %23llu\n",
+            COUNTER_NAMES[i], (unsigned long long)counters[i]);
+    }
+
+    fprintf(file, "\n%-28s %11s %11s\n", "memory", "current KiB", "peak KiB");
+    for (size_t i = 0; i < STATS_MEMORY_COUNT; ++i)
+    {
+        struct StatsMemoryUsage const usage = stats_memory_usage(i);
+        fprintf(file, "%-28s %11.1f %11.1f\n",
+            MEMORY_NAMES[i], usage.current / 1024.0, usage.peak / 1024.0);
+    }
+
+    struct StatsPacing const p = stats_pacing();
+    if (p.presented == 0)
+        return;
+    fprintf(file, "\nframe pacing (%llu frames presented)\n",
+        (unsigned long long)p.presented);
+    fprintf(file, "  late by (ms): mean %.3f, jitter %.3f, max %.3f\n",
+        p.mean_late_ms, p.jitter_ms, p.max_late_ms);
+    double lower = 0.0;
+    for (size_t i = 0; i < STATS_LATE_BUCKETS; ++i)
+    {
+        double const upper = STATS_LATE_BUCKET_BOUNDS[i];
+        if (isinf(upper))
+            fprintf(file, "  %7.1f ms -        ", lower);
+        else
+            fprintf(file, "  %7.1f ms - %5.1f ms", lower, upper);
+        fprintf(file, " %12llu\n", (unsigned long long)p.histogram[i]);
+        lower = upper;
+    }
+}
@@ -0,0 +1,151 @@
+/*
+ * stats.h -- Performance statistics declarations.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFVIEW_STATS_H
+#define GIFVIEW_STATS_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+
+/** Timed stages. */
+enum StatsStage
+{
+    /** Time from startup until the first frame is presented. */
+    STATS_STAGE_STARTUP,
+    /** Total time spent in gif_from_file. */
+    STATS_STAGE_PARSE,
+    /** Reading data blocks from the file (part of PARSE). */
+    STATS_STAGE_FILE_READ,
+    /** LZW decompression (part of PARSE). */
+    STATS_STAGE_LZW,
+    /** Deinterlacing (part of PARSE). */
+    STATS_STAGE_DEINTERLACE,
+    /** Compositing graphics into frames. */
+    STATS_STAGE_COMPOSITE,
+    /** Uploading frames to textures. */
+    STATS_STAGE_TEXTURE_UPLOAD,
+    /** Opening fonts. */
+    STATS_STAGE_FONT_LOAD,
+    /** Creating the window and renderer. */
+    STATS_STAGE_WINDOW_CREATE,
+
+    STATS_STAGE_COUNT
+};
+
+/** Event counters. */
+enum StatsCounter
+{
+    STATS_COUNTER_BYTES_READ,
+    STATS_COUNTER_BYTES_DECODED,
+    STATS_COUNTER_FRAMES_COMPOSITED,
+    STATS_COUNTER_TEXTURES_CREATED,
+    STATS_COUNTER_TEXTURE_BYTES,
+    /** Frames that were replaced before ever being presented. */
+    STATS_COUNTER_FRAMES_DROPPED,
+    /** Presents that showed the same frame again. */
+    STATS_COUNTER_FRAMES_DUPLICATED,
+    /** Files whose frames were mapped from the on-disk frame cache. */
+    STATS_COUNTER_CACHE_HITS,
+    /** Files that had to be composited with the frame cache enabled. */
+    STATS_COUNTER_CACHE_MISSES,
+    /** Composited frames found to be the same as an earlier frame. */
+    STATS_COUNTER_FRAMES_DEDUPLICATED,
+
+    STATS_COUNTER_COUNT
+};
+
+/** Memory accounting categories. */
+enum StatsMemory
+{
+    /** Decoded GIF_Image pixel data. */
+    STATS_MEMORY_PIXELS,
+    /** SDL_Surfaces used while compositing frames. */
+    STATS_MEMORY_SURFACES,
+    /** Per-frame textures. */
+    STATS_MEMORY_FRAME_TEXTURES,
+    /** Text, menu and background textures. */
+    STATS_MEMORY_UI_TEXTURES,
+
+    STATS_MEMORY_COUNT
+};
+
+/** Current and peak bytes in a memory category. */
+struct StatsMemoryUsage
+{
+    int64_t current;
+    int64_t peak;
+};
+
+/** Number of buckets in the late-frame histogram. */
+#define STATS_LATE_BUCKETS  8
+
+/** Upper bounds (in milliseconds) of the late-frame histogram buckets. */
+extern double const STATS_LATE_BUCKET_BOUNDS[STATS_LATE_BUCKETS];
+
+/** Frame pacing summary. */
+struct StatsPacing
+{
+    /** Frames presented for the first time. */
+    uint64_t presented;
+    uint64_t dropped;
+    uint64_t duplicated;
+    /** Average time between a frame's scheduled and actual presentation. */
+    double mean_late_ms;
+    /** Standard deviation of the lateness. */
+    double jitter_ms;
+    double max_late_ms;
+    /** Count of frames in each STATS_LATE_BUCKET_BOUNDS bucket. */
+    uint64_t histogram[STATS_LATE_BUCKETS];
+};
+
+
+/** Get a timestamp, for passing to stats_stage_end. */
+uint64_t stats_now(void);
+
+/** Add the time elapsed since START to STAGE. */
+void stats_stage_end(enum StatsStage stage, uint64_t start);
+
+/** Add N to COUNTER. */
+void stats_count(enum StatsCounter counter, uint64_t n);
+
+/**
+ * Record that a frame scheduled to appear at SCHEDULED was first presented at
+ * PRESENTED.  Both are stats_now timestamps.
+ */
+void stats_frame_presented(uint64_t scheduled, uint64_t presented);
+
+/** Get a summary of the frame pacing so far. */
+struct StatsPacing stats_pacing(void);
+
+/** Account for BYTES newly allocated in CATEGORY. */
+void stats_memory_add(enum StatsMemory category, size_t bytes);
+
+/** Account for BYTES freed from CATEGORY. */
+void stats_memory_remove(enum StatsMemory category, size_t bytes);
+
+/** Get the current and peak usage of CATEGORY. */
+struct StatsMemoryUsage stats_memory_usage(enum StatsMemory category);
+
+/** Print the collected statistics to FILE. */
+void stats_print(FILE *file);
+
+
+#endif /* GIFVIEW_STATS_H */
@@ -0,0 +1,128 @@
+/*
+ * trace.c -- Trace event output definitions.
+ *
+ * Events are written as they happen rather than buffered, so a trace is still
+ * mostly usable if the program dies partway through (the viewers accept a
+ * truncated event array).
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "trace.h"
+#include "stats.h"
+#include "util.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <SDL2/SDL_mutex.h>
+#include <SDL2/SDL_thread.h>
+#include <SDL2/SDL_timer.h>
+
+
+static FILE *trace_file = NULL;
+/** Protects trace_file and first_event. */
+static SDL_mutex *trace_lock = NULL;
+/** Timestamps are relative to this. */
+static uint64_t epoch = 0;
+/** No comma is needed before the first event. */
+static bool first_event = true;
+
+
+/** Convert a stats_now timestamp to microseconds since the epoch. */
+double _to_microseconds(uint64_t ticks)
+{
+    return (double)(ticks - epoch) * 1e6 / SDL_GetPerformanceFrequency();
+}
+
+/** Write the start of an event, up to the args object. */
+void _begin_event(char const *name, char phase, double timestamp)
+{
+    fprintf(trace_file,
+        "%s\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":1,\"tid\":%lu",
+        first_event? "" : ",",
+        name, phase, timestamp, (unsigned long)SDL_ThreadID());
+    first_event = false;
+}
+
+
+void trace_open(char const *filename)
+{
+    errno = 0;
+    trace_file = fopen(filename, "w");
+    if (trace_file == NULL)
+        fatal("fopen: %s\n", strerror(errno));
+    trace_lock = SDL_CreateMutex();
+    if (trace_lock == NULL)
+        fatal("SDL_CreateMutex -- %s\n", SDL_GetError());
+    epoch = stats_now();
+    first_event = true;
+    fputs("{\"traceEvents\":[", trace_file);
+}
+
+void trace_close(void)
+{
+    if (!trace_file)
+        return;
+    fputs("\n],\"displayTimeUnit\":\"ms\"}\n", trace_file);
+    errno = 0;
+    if (fclose(trace_file))
+        error("fclose: %s\n", strerror(errno));
+    trace_file = NULL;
+    SDL_DestroyMutex(trace_lock);
+    trace_lock = NULL;
+}
+
+bool trace_enabled(void)
+{
+    return trace_file != NULL;
+}
+
+void trace_span(
+    char const *name, uint64_t start, long long frame, long long bytes)
+{
+    if (!trace_file)
+        return;
+    uint64_t const end = stats_now();
+
+    SDL_LockMutex(trace_lock);
+    _begin_event(name, 'X', _to_microseconds(start));
+    fprintf(trace_file, ",\"dur\":%.3f,\"args\":{",
+        _to_microseconds(end) - _to_microseconds(start));
+    if (frame != TRACE_NO_ARG)
+        fprintf(trace_file, "\"frame\":%lld", frame);
+    if (bytes != TRACE_NO_ARG)
+    {
+        fprintf(trace_file, "%s\"bytes\":%lld",
+            frame != TRACE_NO_ARG? "," : "", bytes);
+    }
+    fputs("}}", trace_file);
+    SDL_UnlockMutex(trace_lock);
+}
+
+void trace_instant(char const *name)
+{
+    if (!trace_file)
+        return;
+    uint64_t const now = stats_now();
+
+    SDL_LockMutex(trace_lock);
+    _begin_event(name, 'i', _to_microseconds(now));
+    fputs(",\"s\":\"t\"}", trace_file);
+    SDL_UnlockMutex(trace_lock);
+}
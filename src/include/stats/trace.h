@@ -0,0 +1,55 @@
+/*
+ * trace.h -- Trace event output declarations.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFVIEW_TRACE_H
+#define GIFVIEW_TRACE_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+
+/** Pass as FRAME or BYTES to trace_span to leave the argument out. */
+#define TRACE_NO_ARG    (-1)
+
+
+/**
+ * Start writing trace events to FILENAME, in the Chrome trace-event JSON
+ * format (viewable in Perfetto or chrome://tracing).  Until this is called,
+ * tracing is disabled and the other trace_* functions do nothing.
+ */
+void trace_open(char const *filename);
+
+/** Finish the trace file. */
+void trace_close(void);
+
+/** Returns true if trace events are being recorded. */
+bool trace_enabled(void);
+
+/**
+ * Record a span called NAME, from START (a stats_now timestamp) until now.
+ * FRAME and BYTES are attached as arguments unless they are TRACE_NO_ARG.
+ */
+void trace_span(
+    char const *name, uint64_t start, long long frame, long long bytes);
+
+/** Record an instantaneous event called NAME. */
+void trace_instant(char const *name);
+
+
+#endif /* GIFVIEW_TRACE_H */
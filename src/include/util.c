@@ -24,6 +24,14 @@
 #include <stdlib.h>
 #include <string.h>
 
+#include <SDL2/SDL.h>
+
+
+/** Held by lock_ttf.  Created the first time it's needed. */
+static SDL_mutex *ttf_lock = NULL;
+/** Held while creating TTF_LOCK. */
+static SDL_SpinLock ttf_lock_creation = 0;
+
 
 size_t efread(void *restrict ptr, size_t size, size_t n, FILE *restrict stream)
 {
@@ -39,6 +47,16 @@ size_t efread(void *restrict ptr, size_t size, size_t n, FILE *restrict stream)
     return value;
 }
 
+size_t efwrite(
+    void const *restrict ptr, size_t size, size_t n, FILE *restrict stream)
+{
+    errno = 0;
+    size_t value = fwrite(ptr, size, n, stream);
+    if (value != n)
+        fatal("%s\n", strerror(errno));
+    return value;
+}
+
 char *estrcat(char const *prefix, char const *suffix)
 {
     size_t prefix_len = strlen(prefix),
@@ -88,3 +106,19 @@ int sprintfa(char **restrict str, char const *restrict fmt, ...)
     va_end(ap2);
     return count;
 }
+
+void lock_ttf(void)
+{
+    SDL_AtomicLock(&ttf_lock_creation);
+    if (!ttf_lock)
+        ttf_lock = SDL_CreateMutex();
+    SDL_AtomicUnlock(&ttf_lock_creation);
+    if (!ttf_lock)
+        fatal("SDL_CreateMutex -- %s\n", SDL_GetError());
+    SDL_LockMutex(ttf_lock);
+}
+
+void unlock_ttf(void)
+{
+    SDL_UnlockMutex(ttf_lock);
+}
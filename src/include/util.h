@@ -41,6 +41,12 @@
  */
 size_t efread(void *restrict ptr, size_t size, size_t n, FILE *restrict stream);
 
+/**
+ * Error-checked fwrite.  If an error occurs, prints the error message and dies.
+ */
+size_t efwrite(
+    void const *restrict ptr, size_t size, size_t n, FILE *restrict stream);
+
 /**
  * Concatenate two strings, returning the result in a newly-allocated string.
  */
@@ -55,5 +61,15 @@ char *estrndup(char const *s, size_t n);
 /** Like sprintf, but mallocs a new string in STR. */
 int sprintfa(char **restrict str, char const *restrict fmt, ...);
 
+/**
+ * Hold the lock every SDL_ttf call has to be made under.  SDL_ttf isn't
+ * thread-safe, and fonts are used both by the UI and by files being loaded
+ * in the background.
+ */
+void lock_ttf(void);
+
+/** Release the lock taken by lock_ttf. */
+void unlock_ttf(void);
+
 
 #endif /* GIFVIEW_UTIL_H */
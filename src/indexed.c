@@ -0,0 +1,233 @@
+/*
+ * indexed.c -- Indexed frame storage definitions.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "indexed.h"
+#include "util.h"
+
+#include <string.h>
+
+
+/** Slots in the color lookup table.  A power of 2, well above 256. */
+#define TABLE_SIZE  1024
+
+/** Multiplier for indexed_hash's lanes.  Odd, with well-mixed bits. */
+#define HASH_PRIME  0x9E3779B97F4A7C15ull
+
+
+/** Slot to start looking for COLOR in the color lookup table. */
+size_t _color_slot(uint32_t color)
+{
+    return (color * 0x9E3779B1u) >> 22;
+}
+
+
+/** Mix the 64-bit word WORD into the hash LANE. */
+uint64_t _hash_word(uint64_t lane, uint64_t word)
+{
+    lane = (lane ^ word) * HASH_PRIME;
+    return lane ^ (lane >> 29);
+}
+
+/** Mix the SIZE bytes at DATA into the 4 hash lanes LANES. */
+void _hash_into_lanes(uint64_t lanes[4], uint8_t const *data, size_t size)
+{
+    /* The 4 lanes don't depend on each other, so their multiplies overlap in
+     * the pipeline, and vectorizing compilers can do them side by side. */
+    size_t i = 0;
+    for (; i + 32 <= size; i += 32)
+    {
+        uint64_t words[4];
+        memcpy(words, data + i, sizeof(words));
+        for (int k = 0; k < 4; ++k)
+            lanes[k] = _hash_word(lanes[k], words[k]);
+    }
+    for (; i + 8 <= size; i += 8)
+    {
+        uint64_t word;
+        memcpy(&word, data + i, 8);
+        lanes[0] = _hash_word(lanes[0], word);
+    }
+    if (i < size)
+    {
+        uint64_t word = 0;
+        memcpy(&word, data + i, size - i);
+        lanes[1] = _hash_word(lanes[1], word);
+    }
+}
+
+/** Bytes of pixel data in each row of FRAME. */
+size_t _row_bytes(SDL_Surface const *frame)
+{
+    return (size_t)frame->w * frame->format->BytesPerPixel;
+}
+
+SDL_Surface *indexed_from_rgba(SDL_Surface const *frame)
+{
+    /* Open-addressed table from colors to palette indices. */
+    uint32_t keys[TABLE_SIZE];
+    int16_t values[TABLE_SIZE];
+    for (size_t i = 0; i < TABLE_SIZE; ++i)
+        values[i] = -1;
+    SDL_Color colors[256];
+    int count = 0;
+
+    SDL_Surface *out = SDL_CreateRGBSurfaceWithFormat(
+        0, frame->w, frame->h, 8, SDL_PIXELFORMAT_INDEX8);
+    if (out == NULL)
+        fatal("SDL_CreateRGBSurfaceWithFormat -- %s\n", SDL_GetError());
+
+    /* Runs of one color are common, so skip the lookup for them. */
+    uint32_t last_color = 0;
+    int last_index = -1;
+    for (int y = 0; y < frame->h; ++y)
+    {
+        uint8_t const *row = (uint8_t const *)frame->pixels + y * frame->pitch;
+        uint8_t *out_row = (uint8_t *)out->pixels + y * out->pitch;
+        for (int x = 0; x < frame->w; ++x)
+        {
+            uint32_t color;
+            memcpy(&color, row + 4 * x, 4);
+            if (color != last_color || last_index < 0)
+            {
+                size_t slot = _color_slot(color);
+                while (values[slot] >= 0 && keys[slot] != color)
+                    slot = (slot + 1) % TABLE_SIZE;
+                if (values[slot] < 0)
+                {
+                    if (count == 256)
+                    {
+                        SDL_FreeSurface(out);
+                        return NULL;
+                    }
+                    keys[slot] = color;
+                    values[slot] = count;
+                    colors[count++] = (SDL_Color){
+                        row[4 * x], row[4 * x + 1], row[4 * x + 2],
+                        row[4 * x + 3]
+                    };
+                }
+                last_color = color;
+                last_index = values[slot];
+            }
+            out_row[x] = last_index;
+        }
+    }
+    SDL_SetPaletteColors(out->format->palette, colors, 0, count);
+    return out;
+}
+
+SDL_Surface *indexed_to_rgba(SDL_Surface const *frame)
+{
+    SDL_Surface *out = SDL_CreateRGBSurfaceWithFormat(
+        0, frame->w, frame->h, 32, SDL_PIXELFORMAT_RGBA32);
+    if (out == NULL)
+        fatal("SDL_CreateRGBSurfaceWithFormat -- %s\n", SDL_GetError());
+    if (frame->format->format == SDL_PIXELFORMAT_INDEX8)
+    {
+        SDL_Rect const all = {.x=0, .y=0, .w=frame->w, .h=frame->h};
+        indexed_expand_rect(frame, &all, out->pixels, out->pitch);
+    }
+    else
+    {
+        for (int y = 0; y < frame->h; ++y)
+        {
+            memcpy(
+                (uint8_t *)out->pixels + y * out->pitch,
+                (uint8_t const *)frame->pixels + y * frame->pitch,
+                (size_t)frame->w * 4);
+        }
+    }
+    return out;
+}
+
+void indexed_expand_rect(
+    SDL_Surface const *frame, SDL_Rect const *rect,
+    uint8_t *dst, size_t dst_pitch)
+{
+    /* Look each index up as a whole RGBA32 pixel. */
+    SDL_Palette const *palette = frame->format->palette;
+    uint32_t lookup[256] = {0};
+    for (int i = 0; i < palette->ncolors && i < 256; ++i)
+    {
+        SDL_Color const c = palette->colors[i];
+        uint8_t const bytes[4] = {c.r, c.g, c.b, c.a};
+        memcpy(&lookup[i], bytes, 4);
+    }
+    for (int y = 0; y < rect->h; ++y)
+    {
+        uint8_t const *row = (
+            (uint8_t const *)frame->pixels
+            + (size_t)(rect->y + y) * frame->pitch + rect->x);
+        uint8_t *out = dst + y * dst_pitch;
+        for (int x = 0; x < rect->w; ++x)
+            memcpy(out + 4 * x, &lookup[row[x]], 4);
+    }
+}
+
+uint64_t indexed_hash(SDL_Surface const *frame)
+{
+    uint64_t lanes[4] = {1, 2, 3, 4};
+    lanes[0] = _hash_word(
+        lanes[0], (uint64_t)frame->w << 32 | (uint32_t)frame->h);
+    lanes[1] = _hash_word(lanes[1], frame->format->format);
+    SDL_Palette const *palette = frame->format->palette;
+    if (palette)
+    {
+        _hash_into_lanes(
+            lanes, (uint8_t const *)palette->colors,
+            palette->ncolors * sizeof(*palette->colors));
+    }
+    size_t const row_bytes = _row_bytes(frame);
+    for (int y = 0; y < frame->h; ++y)
+    {
+        _hash_into_lanes(
+            lanes, (uint8_t const *)frame->pixels + y * frame->pitch,
+            row_bytes);
+    }
+    uint64_t hash = 0;
+    for (int k = 0; k < 4; ++k)
+        hash = _hash_word(hash, lanes[k]);
+    return hash;
+}
+
+bool indexed_same(SDL_Surface const *a, SDL_Surface const *b)
+{
+    if (a->w != b->w || a->h != b->h
+        || a->format->format != b->format->format)
+        return false;
+    SDL_Palette const *pa = a->format->palette;
+    SDL_Palette const *pb = b->format->palette;
+    if ((pa == NULL) != (pb == NULL))
+        return false;
+    if (pa
+        && (pa->ncolors != pb->ncolors
+            || memcmp(
+                pa->colors, pb->colors,
+                pa->ncolors * sizeof(*pa->colors)) != 0))
+        return false;
+    size_t const row_bytes = _row_bytes(a);
+    for (int y = 0; y < a->h; ++y)
+    {
+        if (memcmp(
+                (uint8_t const *)a->pixels + y * a->pitch,
+                (uint8_t const *)b->pixels + y * b->pitch, row_bytes) != 0)
+            return false;
+    }
+    return true;
+}
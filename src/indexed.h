@@ -0,0 +1,65 @@
+/*
+ * indexed.h -- Indexed frame storage declarations.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFVIEW_INDEXED_H
+#define GIFVIEW_INDEXED_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+
+/**
+ * Pack the RGBA32 surface FRAME into an INDEX8 surface, whose palette holds
+ * each distinct color (alpha included).  Returns NULL if FRAME has more than
+ * 256 colors.  Composited GIF frames usually fit, at a quarter of the size.
+ */
+SDL_Surface *indexed_from_rgba(SDL_Surface const *frame);
+
+/**
+ * Get a copy of FRAME as an RGBA32 surface.  FRAME may be INDEX8 (made by
+ * indexed_from_rgba) or RGBA32.
+ */
+SDL_Surface *indexed_to_rgba(SDL_Surface const *frame);
+
+/**
+ * Expand the RECT part of the INDEX8 surface FRAME to RGBA32 pixels in DST,
+ * whose rows are DST_PITCH bytes apart.
+ */
+void indexed_expand_rect(
+    SDL_Surface const *frame, SDL_Rect const *rect,
+    uint8_t *dst, size_t dst_pitch);
+
+/**
+ * Hash the pixels (and palette, if any) of FRAME, an INDEX8 or RGBA32
+ * surface.  Frames which indexed_same says are the same hash the same.
+ */
+uint64_t indexed_hash(SDL_Surface const *frame);
+
+/**
+ * Do A and B have the same size, format and pixels?  Since indexed_from_rgba
+ * numbers colors in the order they're first seen, the same RGBA32 frame always
+ * packs the same way.
+ */
+bool indexed_same(SDL_Surface const *a, SDL_Surface const *b);
+
+
+#endif /* GIFVIEW_INDEXED_H */
@@ -21,8 +21,19 @@
 #include "config.h"
 #include "util.h"
 
+#include <errno.h>
+#include <stdint.h>
 #include <string.h>
 
+#include <SDL2/SDL_atomic.h>
+#include <SDL2/SDL_thread.h>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
 
 extern struct Action actions[];
 extern size_t actions_count;
@@ -49,6 +60,9 @@ static struct KeyDef const default_keybinds[] = {
     {"quit", {SDLK_ESCAPE, 0}, {SDLK_q, 0}, UNBOUND},
     {"fullscreen_toggle", {SDLK_f}, UNBOUND, UNBOUND},
     {"show_player_state", {SDLK_o}, UNBOUND, UNBOUND},
+    {"next_file", {SDLK_RIGHT, 0}, {SDLK_n, 0}, UNBOUND},
+    {"previous_file", {SDLK_LEFT, 0}, {SDLK_n, KMOD_SHIFT}, UNBOUND},
+    {"montage_toggle", {SDLK_g, 0}, UNBOUND, UNBOUND},
     /* Zoom */
     {"zoom_in", {SDLK_UP, 0}, {SDLK_KP_PLUS, 0}, UNBOUND},
     {"zoom_out", {SDLK_DOWN, 0}, {SDLK_KP_MINUS,0}, UNBOUND},
@@ -75,6 +89,43 @@ static size_t const default_keybinds_count = (
     sizeof(default_keybinds) / sizeof(*default_keybinds));
 
 
+/** A binding in a KeyMap. */
+struct KeyMapEntry
+{
+    SDL_Keycode code;
+    /** Modifiers, normalized by _normalize_mods. */
+    Uint16 mods;
+    /** The bound action, or NULL if the entry is empty. */
+    struct Action *action;
+};
+
+/**
+ * Open-addressed hash table of every binding, keyed by keycode and
+ * modifiers, so key presses go straight to their actions.
+ */
+struct KeyMap
+{
+    /** Capacity minus one.  The capacity is a power of two. */
+    size_t mask;
+    struct KeyMapEntry *entries;
+};
+
+/** The keymap in use, or NULL before keybinds_init. */
+static struct KeyMap *keymap = NULL;
+
+/** keys.conf watcher state. */
+static struct
+{
+    SDL_Thread *thread;
+    int inotify_fd;
+    /** Written to, to stop the thread. */
+    int quit_pipe[2];
+    void (*on_change)(void);
+    /** Set from a change until the next reload. */
+    SDL_atomic_t pending;
+} watcher = {NULL, -1, {-1, -1}, NULL, {0}};
+
+
 /**
  * Parse an action string.  On success, PTR will be set to point to the
  * corresponding struct stored in the global `actions` array.  Returns 0 on
@@ -347,50 +398,160 @@ bool load_keysconf_at(char const *path)
     return success;
 }
 
-/** Return true if BIND matches EVENT. */
-bool keybind_ispressed(struct KeyBind const *bind, SDL_Keysym event)
+/** Modifiers of MOD that bindings care about, with left and right merged. */
+Uint16 _normalize_mods(Uint16 mod)
+{
+    Uint16 normalized = KMOD_NONE;
+    if (mod & KMOD_SHIFT)
+        normalized |= KMOD_SHIFT;
+    if (mod & KMOD_CTRL)
+        normalized |= KMOD_CTRL;
+    if (mod & KMOD_ALT)
+        normalized |= KMOD_ALT;
+    if (mod & KMOD_GUI)
+        normalized |= KMOD_GUI;
+    return normalized;
+}
+
+/** Hash of a key with normalized modifiers MODS. */
+size_t _hash_key(SDL_Keycode code, Uint16 mods)
+{
+    uint32_t hash = ((uint32_t)code ^ ((uint32_t)mods << 20)) * 0x9E3779B1u;
+    return hash ^ (hash >> 16);
+}
+
+/** Add a binding of KEY to ACTION to MAP, which must have room for it. */
+void _keymap_insert(
+    struct KeyMap *map, struct KeyBind const *key, struct Action *action)
+{
+    Uint16 const mods = _normalize_mods(key->modmask);
+    size_t i = _hash_key(key->code, mods) & map->mask;
+    for (; map->entries[i].action; i = (i + 1) & map->mask)
+    {
+        if (map->entries[i].code == key->code
+            && map->entries[i].mods == mods
+            && map->entries[i].action == action)
+            return;
+    }
+    map->entries[i] = (struct KeyMapEntry){
+        .code=key->code,
+        .mods=mods,
+        .action=action,
+    };
+}
+
+/** Build a keymap from the bindings in the global ACTIONS array. */
+struct KeyMap *_compile_keymap(void)
 {
-    if (bind == NULL || bind->code != event.sym)
-        return false;
-
-    if (bind->modmask == KMOD_NONE)
-        return event.mod == KMOD_NONE;
-
-    SDL_Keymod const othermask = KMOD_NUM | KMOD_CAPS | KMOD_MODE | KMOD_SCROLL;
-
-#define FILTERMASK(b, e, filter) ((b & filter) == (e & filter))
-    /* We can't just check if the masks are equal, because this would require
-     * the user to press the left AND right modifier keys.  This is probably not
-     * what the event specifiction actually wants, so we have to do some extra
-     * checks to handle this correctly.  Here we do the naive behaviour, which
-     * works fine if the event specifies that only left/right side should work.
-     */
-    bool shift = FILTERMASK(bind->modmask, event.mod, KMOD_SHIFT);
-    bool ctrl = FILTERMASK(bind->modmask, event.mod, KMOD_CTRL);
-    bool alt = FILTERMASK(bind->modmask, event.mod, KMOD_ALT);
-    bool meta = FILTERMASK(bind->modmask, event.mod, KMOD_GUI);
-    bool other = FILTERMASK(bind->modmask, event.mod, othermask);
-#undef FILTERMASK
-
-    /* The above booleans will require BOTH sides to be pressed if the event
-     * says that either side is fine, which is not what we want.  To do the
-     * Right Thing, we check here if the event spec says either side is fine,
-     * and check only that *one of* the sides is pressed. */
-    if ((bind->modmask & KMOD_SHIFT) == KMOD_SHIFT)
-        shift = event.mod & KMOD_SHIFT;
-    if ((bind->modmask & KMOD_CTRL) == KMOD_CTRL)
-        ctrl = event.mod & KMOD_CTRL;
-    if ((bind->modmask & KMOD_ALT) == KMOD_ALT)
-        alt = event.mod & KMOD_ALT;
-    if ((bind->modmask & KMOD_GUI) == KMOD_GUI)
-        meta = event.mod & KMOD_GUI;
-
-    return shift && ctrl && alt && meta && other;
+    size_t capacity = 16;
+    while (capacity < 2 * 3 * actions_count)
+        capacity *= 2;
+
+    struct KeyMap *map = malloc(sizeof(*map));
+    map->mask = capacity - 1;
+    map->entries = calloc(capacity, sizeof(*map->entries));
+    for (size_t i = 0; i < actions_count; ++i)
+    {
+        struct KeyBind const *const keys[] = {
+            actions[i].primary, actions[i].secondary, actions[i].tertiary
+        };
+        for (size_t k = 0; k < sizeof(keys) / sizeof(*keys); ++k)
+            if (keys[k])
+                _keymap_insert(map, keys[k], &actions[i]);
+    }
+    return map;
 }
 
+/** Free a keymap. */
+void _keymap_free(struct KeyMap *map)
+{
+    if (!map)
+        return;
+    free(map->entries);
+    free(map);
+}
+
+/** Get the local config root, or NULL if there isn't one.  Free it after. */
+char *_local_config_root(void)
+{
+    char *localconfig = estrdup(getenv("XDG_CONFIG_HOME"));
+    if (!localconfig)
+    {
+        char const *home = getenv("HOME");
+        if (home)
+            localconfig = estrcat(home, "/.config");
+    }
+    return localconfig;
+}
+
+#ifdef __linux__
+/**
+ * Wait for changes to keys.conf in the watched directories, and call
+ * watcher.on_change when there are some.  Runs until quit_pipe is written to.
+ */
+int _watch_keyconf(void *unused)
+{
+    char buffer[4096];
+    for (;;)
+    {
+        struct pollfd fds[2] = {
+            {.fd=watcher.inotify_fd, .events=POLLIN},
+            {.fd=watcher.quit_pipe[0], .events=POLLIN},
+        };
+        if (poll(fds, 2, -1) < 0)
+        {
+            if (errno == EINTR)
+                continue;
+            error("poll -- %s\n", strerror(errno));
+            break;
+        }
+        if (fds[1].revents)
+            break;
+
+        ssize_t const length = read(watcher.inotify_fd, buffer, sizeof(buffer));
+        if (length < 0)
+        {
+            if (errno == EINTR || errno == EAGAIN)
+                continue;
+            error("read -- %s\n", strerror(errno));
+            break;
+        }
+        bool changed = false;
+        for (   ssize_t i = 0;
+                i + (ssize_t)sizeof(struct inotify_event) <= length;)
+        {
+            struct inotify_event event;
+            memcpy(&event, buffer + i, sizeof(event));
+            char const *name = buffer + i + sizeof(event);
+            if (event.len && strcmp(name, "keys.conf") == 0)
+                changed = true;
+            i += sizeof(event) + event.len;
+        }
+        /* Editors can touch the file several times per save; only ask for
+         * one reload until it's done. */
+        if (changed && SDL_AtomicCAS(&watcher.pending, 0, 1))
+            watcher.on_change();
+    }
+    return 0;
+}
+
+/** Watch the directory PATH/gifview/ for keys.conf changes. */
+bool _watch_config_root(char const *path)
+{
+    static uint32_t const MASK = (
+        IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE);
+    char *dir = estrcat(path, GIFVIEW_CONFIG_DIR);
+    bool const watched = inotify_add_watch(watcher.inotify_fd, dir, MASK) >= 0;
+    free(dir);
+    return watched;
+}
+#endif
 
 void keybinds_init(void)
 {
+    /* Changes from here on need another reload. */
+    SDL_AtomicSet(&watcher.pending, 0);
+
     /* Clear any previously set keybinds. */
     for (size_t i = 0; i < actions_count; ++i)
     {
@@ -420,16 +581,69 @@ void keybinds_init(void)
     load_keysconf_at(GIFVIEW_GLOBAL_CONFIG_ROOT);
 
     /* ...And then the local config. */
-    char *localconfig = estrdup(getenv("XDG_CONFIG_HOME"));
-    if (!localconfig)
+    char *localconfig = _local_config_root();
+    if (localconfig)
+        load_keysconf_at(localconfig);
+    free(localconfig);
+
+    /* Swap the new keymap in only once it's complete. */
+    struct KeyMap *old = keymap;
+    keymap = _compile_keymap();
+    _keymap_free(old);
+}
+
+void keybinds_watch(void (*on_change)(void))
+{
+#ifdef __linux__
+    watcher.inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (watcher.inotify_fd < 0)
     {
-        char const *home = getenv("HOME");
-        if (home)
-            localconfig = estrcat(home, "/.config");
+        warn("inotify_init1 -- %s\n", strerror(errno));
+        return;
     }
+    bool watching = _watch_config_root(GIFVIEW_GLOBAL_CONFIG_ROOT);
+    char *localconfig = _local_config_root();
     if (localconfig)
-        load_keysconf_at(localconfig);
+        watching = _watch_config_root(localconfig) || watching;
     free(localconfig);
+
+    if (watching && pipe(watcher.quit_pipe) == 0)
+    {
+        watcher.on_change = on_change;
+        watcher.thread = SDL_CreateThread(
+            _watch_keyconf, "keys.conf watcher", NULL);
+        if (watcher.thread)
+            return;
+        error("SDL_CreateThread -- %s\n", SDL_GetError());
+        close(watcher.quit_pipe[0]);
+        close(watcher.quit_pipe[1]);
+    }
+    close(watcher.inotify_fd);
+    watcher.inotify_fd = -1;
+#else
+    (void)on_change;
+#endif
+}
+
+void keybinds_quit(void)
+{
+#ifdef __linux__
+    if (watcher.thread)
+    {
+        if (write(watcher.quit_pipe[1], "", 1) != 1)
+            error("write -- %s\n", strerror(errno));
+        SDL_WaitThread(watcher.thread, NULL);
+        watcher.thread = NULL;
+        close(watcher.quit_pipe[0]);
+        close(watcher.quit_pipe[1]);
+        close(watcher.inotify_fd);
+        watcher.inotify_fd = -1;
+    }
+#endif
+    _keymap_free(keymap);
+    keymap = NULL;
+    for (size_t i = 0; i < actions_count; ++i)
+        action_set_keybinds(&actions[i], UNBOUND, UNBOUND, UNBOUND);
 }
 
 void action_set_keybinds(
@@ -464,10 +678,17 @@ void action_set_keybinds(
     }
 }
 
-bool action_ispressed(struct Action action, SDL_Keysym event)
+void keybinds_dispatch(SDL_Keysym event, void *data)
 {
-    return (
-        keybind_ispressed(action.primary, event)
-        || keybind_ispressed(action.secondary, event)
-        || keybind_ispressed(action.tertiary, event));
+    if (!keymap)
+        return;
+    Uint16 const mods = _normalize_mods(event.mod);
+    for (   size_t i = _hash_key(event.sym, mods) & keymap->mask;
+            keymap->entries[i].action;
+            i = (i + 1) & keymap->mask)
+    {
+        struct KeyMapEntry const *entry = &keymap->entries[i];
+        if (entry->code == event.sym && entry->mods == mods)
+            entry->action->action(data);
+    }
 }
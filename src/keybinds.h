@@ -45,16 +45,33 @@ struct Action
 };
 
 
-/** Reset default keybinds, read keyconf files. */
+/**
+ * Reset default keybinds, read keyconf files, and compile them into the
+ * keymap used by keybinds_dispatch.  Call again to reload.
+ */
 void keybinds_init(void);
 
+/**
+ * Start watching the keys.conf files for changes.  ON_CHANGE is called from
+ * another thread when they change, and should arrange for keybinds_init to be
+ * called on the main thread.  It isn't called again until that's happened.
+ * Does nothing where file watching isn't supported.
+ */
+void keybinds_watch(void (*on_change)(void));
+
+/** Stop watching the keys.conf files and free the keybinds. */
+void keybinds_quit(void);
+
 /** Set ACTION's keybinds. */
 void action_set_keybinds(
     struct Action *action, struct KeyBind primary, struct KeyBind secondary,
     struct KeyBind tertiary);
 
-/** Return true if any of ACTION's KeyBinds matches EVENT. */
-bool action_ispressed(struct Action action, SDL_Keysym event);
+/**
+ * Call every action bound to EVENT with DATA.  Left and right modifiers are
+ * treated the same, and lock keys like Num Lock are ignored.
+ */
+void keybinds_dispatch(SDL_Keysym event, void *data);
 
 
 #endif /* GIFVIEW_KEYBINDS_H */
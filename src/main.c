@@ -19,13 +19,20 @@
  */
 
 #include "args.h"
+#include "dump.h"
+#include "framecache.h"
 #include "keybinds.h"
+#include "playlist.h"
 #include "sdlapp.h"
 #include "sdlgif.h"
+#include "stats/stats.h"
+#include "stats/trace.h"
 #include "viewer/viewer.h"
 
-#include <stdio.h>
+#include <math.h>
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
 
 #include <SDL2/SDL.h>
 #include <SDL_ttf.h>
@@ -43,17 +50,67 @@ enum UserEventCode
 {
     USEREVENTCODE_FRAMECHANGE,
     USEREVENTCODE_HIDEAPPTEXT,
+    USEREVENTCODE_RELOADKEYS,
+    USEREVENTCODE_THUMBNAILS,
+};
+
+
+/** Frame change scheduling state. */
+struct Scheduler
+{
+    /** One-shot timer for the next frame change, or 0 if none is pending. */
+    SDL_TimerID timer;
+    /**
+     * Incremented whenever the timer is replaced.  Timer events carry the
+     * generation they were scheduled in, so stale ones can be ignored.
+     */
+    uintptr_t generation;
 };
 
+static struct Scheduler scheduler = {0, 0};
+
+/** The files being viewed, or NULL in headless modes. */
+static struct Playlist *playlist = NULL;
+
 
 /** Temporarily display app state text. */
 void show_app_text_temporarily(struct App *app);
 
-/** Called every 10 milliseconds, to trigger frame changes in animated GIFs. */
+/**
+ * Replace the frame change timer with one that fires when the current frame
+ * should end.  Nothing is scheduled if the frame won't change on its own.
+ */
+void schedule_next_frame(struct App *app);
+
+/** Fires when the current frame should end, to trigger a frame change. */
 Uint32 timer_callback(Uint32 interval, void *param);
 /** Disables app text display. */
 Uint32 hideapptext_callback(Uint32 interval, void *param);
 
+/** Print GIF's comments and application extensions to INFO. */
+void print_gif_info(GIF const *gif, FILE *info);
+
+/**
+ * Show the file OFFSET files away from the current one in the playlist.  While
+ * the thumbnail grid is visible, the selection moves instead.
+ */
+void change_file(struct App *G, long offset);
+
+/**
+ * Get the playlist's current file, moving on by STEP past any that can't be
+ * opened.  Exits if none of them can.
+ */
+struct PreparedGIF const *current_or_next_file(long step);
+
+/** Show the thumbnail grid, with the current file selected. */
+void show_montage(struct App *G);
+
+/** Hide the thumbnail grid, and show the selected file. */
+void open_montage_selection(struct App *G);
+
+/** Called from thumbnail decoding threads when new thumbnails are ready. */
+void thumbnails_ready_callback(void);
+
 
 /* ===[ Action Callbacks ]=== */
 /* General */
@@ -70,6 +127,21 @@ void show_player_state(struct App *G)
 {
     app_show_state_overlay(G, !G->state_text_visible);
 }
+void montage_toggle(struct App *G)
+{
+    if (G->montage_visible)
+        open_montage_selection(G);
+    else
+        show_montage(G);
+}
+void next_file(struct App *G)
+{
+    change_file(G, 1);
+}
+void previous_file(struct App *G)
+{
+    change_file(G, -1);
+}
 
 /* Zoom */
 void zoom_in(struct App *G)
@@ -88,11 +160,17 @@ void zoom_default(struct App *G)
 /* Scroll */
 void scroll_up(struct App *G)
 {
-    viewer_shift_up(&G->view);
+    if (G->montage_visible)
+        montage_scroll(G->montage, 1);
+    else
+        viewer_shift_up(&G->view);
 }
 void scroll_down(struct App *G)
 {
-    viewer_shift_down(&G->view);
+    if (G->montage_visible)
+        montage_scroll(G->montage, -1);
+    else
+        viewer_shift_down(&G->view);
 }
 void scroll_right(struct App *G)
 {
@@ -160,6 +238,9 @@ struct Action actions[] = {
     {"quit", quit, NULL, NULL, NULL},
     {"fullscreen_toggle", fullscreen_toggle, NULL, NULL, NULL},
     {"show_player_state", show_player_state, NULL, NULL, NULL},
+    {"next_file", next_file, NULL, NULL, NULL},
+    {"previous_file", previous_file, NULL, NULL, NULL},
+    {"montage_toggle", montage_toggle, NULL, NULL, NULL},
     /* Zoom */
     {"zoom_in", zoom_in, NULL, NULL, NULL},
     {"zoom_out", zoom_out, NULL, NULL, NULL},
@@ -201,19 +282,119 @@ void show_app_text_temporarily(struct App *app)
         app);
 }
 
+void schedule_next_frame(struct App *app)
+{
+    if (scheduler.timer)
+        SDL_RemoveTimer(scheduler.timer);
+    scheduler.timer = 0;
+    scheduler.generation++;
+    /* Nothing's animating behind the thumbnail grid. */
+    if (app->montage_visible)
+        return;
+
+    double const wait = app_time_until_next_frame(app);
+    if (wait < 0.0)
+        return;
+    /* Round up, so the frame is always due by the time the timer fires. */
+    Uint32 const milliseconds = ceil(wait * 10.0);
+    scheduler.timer = SDL_AddTimer(
+        milliseconds > 0? milliseconds : 1,
+        timer_callback,
+        (void *)scheduler.generation);
+}
+
+void print_gif_info(GIF const *gif, FILE *info)
+{
+    for (LinkedList *node = gif->comments; node != NULL; node = node->next)
+        fprintf(info, "Comment: '%s'\n", (char const *)node->data);
+
+    for (LinkedList *node = gif->app_extensions; node; node = node->next)
+    {
+        struct GIF_ApplicationExt const *ext = node->data;
+        fprintf(info, "App Extension: %.8s%.3s (%zu data bytes)\n",
+            ext->appid, ext->auth_code, ext->data_size);
+    }
+}
+
+void change_file(struct App *G, long offset)
+{
+    long const count = playlist_count(playlist);
+    if (G->montage_visible)
+    {
+        long const index = (
+            ((long)montage_selected(G->montage) + offset % count) % count);
+        montage_select(G->montage, index < 0? index + count : index);
+        return;
+    }
+    if (count < 2)
+        return;
+    playlist_move(playlist, offset);
+    struct PreparedGIF const *gif = current_or_next_file(offset < 0? -1 : 1);
+    print_gif_info(&gif->gif, stdout);
+    app_load(G, gif, playlist_path(playlist));
+    playlist_release_current(playlist, graphiclist_resident_bytes(G->images));
+}
+
+struct PreparedGIF const *current_or_next_file(long step)
+{
+    for (size_t tried = 0; tried < playlist_count(playlist); ++tried)
+    {
+        struct PreparedGIF const *gif = playlist_current(playlist);
+        if (gif)
+            return gif;
+        playlist_move(playlist, step);
+    }
+    fatal("none of the files could be opened\n");
+}
+
+void show_montage(struct App *G)
+{
+    if (!G->montage)
+    {
+        G->montage = montage_new(
+            G->renderer, playlist, thumbnails_ready_callback);
+        montage_resize(G->montage, G->width, G->height);
+    }
+    montage_select(G->montage, playlist_index(playlist));
+    G->montage_visible = true;
+}
+
+void open_montage_selection(struct App *G)
+{
+    G->montage_visible = false;
+    long const offset = (
+        (long)montage_selected(G->montage) - (long)playlist_index(playlist));
+    if (offset != 0)
+        change_file(G, offset);
+}
+
+void thumbnails_ready_callback(void)
+{
+    SDL_Event event = {
+        .type = SDL_USEREVENT,
+        .user = {
+            .code = USEREVENTCODE_THUMBNAILS,
+            .data1 = NULL,
+            .data2 = NULL,
+            .type = SDL_USEREVENT
+        }
+    };
+    SDL_PushEvent(&event);
+}
+
 Uint32 timer_callback(Uint32 interval, void *param)
 {
     SDL_Event event = {
         .type = SDL_USEREVENT,
         .user = {
             .code = USEREVENTCODE_FRAMECHANGE,
-            .data1 = NULL,
+            .data1 = param,
             .data2 = NULL,
             .type = SDL_USEREVENT
         }
     };
     SDL_PushEvent(&event);
-    return interval;
+    return 0;
 }
 
 Uint32 hideapptext_callback(Uint32 interval, void *param)
@@ -231,23 +412,37 @@ Uint32 hideapptext_callback(Uint32 interval, void *param)
     return 0;
 }
 
+/** Called from the keys.conf watcher thread when a keys.conf changes. */
+void keyconf_changed_callback(void)
+{
+    SDL_Event event = {
+        .type = SDL_USEREVENT,
+        .user = {
+            .code = USEREVENTCODE_RELOADKEYS,
+            .data1 = NULL,
+            .data2 = NULL,
+            .type = SDL_USEREVENT
+        }
+    };
+    SDL_PushEvent(&event);
+}
+
 
 int MAIN(int argc, char *argv[])
 {
-    char const *const filename = parse_args(argc, argv);
-    GIF gif = gif_from_file(filename);
-
-    for (LinkedList *node = gif.comments; node != NULL; node = node->next)
-        printf("Comment: '%s'\n", (char const *)node->data);
+    uint64_t const startup = stats_now();
+    struct Arguments const args = parse_args(argc, argv);
+    if (args.trace_file)
+        trace_open(args.trace_file);
 
-    for (LinkedList *node = gif.app_extensions; node != NULL; node = node->next)
+    bool const headless = args.dump_dir || args.y4m;
+    if (headless && args.file_count != 1)
     {
-        struct GIF_ApplicationExt const *ext = node->data;
-        printf("App Extension: %.8s%.3s (%zu data bytes)\n",
-            ext->appid, ext->auth_code, ext->data_size);
+        fprintf(stderr, "--dump-frames and --y4m take exactly one FILE\n");
+        return EXIT_FAILURE;
     }
 
-    SDL_Init(SDL_INIT_VIDEO | SDL_INIT_TIMER);
+    SDL_Init(headless? 0 : SDL_INIT_VIDEO | SDL_INIT_TIMER);
     if (TTF_Init() != 0)
     {
         SDL_Log("TTF_Init failed: %s\n", TTF_GetError());
@@ -255,77 +450,200 @@ int MAIN(int argc, char *argv[])
         return EXIT_FAILURE;
     }
 
-    struct App *G = app_new(&gif, filename);
+    if (headless)
+    {
+        /* stdout carries the video in y4m mode. */
+        FILE *info = args.y4m? stderr : stdout;
+        if (args.dump_dir)
+        {
+            GIF gif = gif_from_file(args.files[0]);
+            print_gif_info(&gif, info);
+            dump_frames(gif, args.dump_dir);
+            gif_free(gif);
+        }
+        if (args.y4m)
+        {
+            /* The video is decoded as it's written, rather than parsing the
+             * whole file first. */
+            GIF const *gif;
+            struct GIF_Reader *reader = gif_read_begin(args.files[0], &gif);
+            stream_y4m(reader, gif, args.fps, stdout);
+            /* Comments can come after any graphic, so print them last. */
+            if (!args.dump_dir)
+                print_gif_info(gif, info);
+            gif_read_end(reader);
+        }
+        sdlgif_quit();
+        TTF_Quit();
+        SDL_Quit();
+        trace_close();
+        if (args.stats)
+            stats_print(stderr);
+        return EXIT_SUCCESS;
+    }
+
+    if (args.cache)
+        framecache_enable();
+    playlist = playlist_new(args.files, args.file_count);
+    struct PreparedGIF const *gif = current_or_next_file(1);
+    print_gif_info(&gif->gif, stdout);
+    struct App *G = app_new(
+        gif, playlist_path(playlist), args.vsync, args.software);
+    playlist_release_current(playlist, graphiclist_resident_bytes(G->images));
+    playlist_start_prefetch(playlist);
+    if (args.montage)
+        show_montage(G);
 
     keybinds_init();
+    keybinds_watch(keyconf_changed_callback);
 
-    SDL_TimerID frame_update_timer = SDL_AddTimer(10, timer_callback, NULL);
+    schedule_next_frame(G);
 
     bool screen_dirty = true;
+    bool first_frame = true;
     while (G->view.running)
     {
         if (screen_dirty)
         {
             imagetransform_clamp(
-                &G->view.transform, gif.width, gif.height, G->width, G->height);
+                &G->view.transform, G->image_width, G->image_height,
+                G->width, G->height);
             app_clear_screen(G);
             app_draw(G);
             screen_dirty = false;
+            if (first_frame)
+            {
+                stats_stage_end(STATS_STAGE_STARTUP, startup);
+                first_frame = false;
+            }
         }
 
         SDL_Event event;
         SDL_WaitEvent(&event);
-        switch (event.type)
+
+        bool reschedule = false;
+        /* Handle everything that's queued up before drawing again, so a burst
+         * of events only costs one present. */
+        do
         {
-        case SDL_QUIT:
-            viewer_quit(&G->view);
-            break;
+            /* Catch playback up before handling anything that might change
+             * it.  With vsync, catch up to the refresh we'll present on. */
+            uint64_t const sync_start = stats_now();
+            if (app_sync_playback(G, app_next_refresh(G)))
+                screen_dirty = true;
 
-        case SDL_USEREVENT:
-            switch (event.user.code)
+            switch (event.type)
             {
-            case USEREVENTCODE_FRAMECHANGE:
-                if (app_timer_increment(G))
+            case SDL_QUIT:
+                viewer_quit(&G->view);
+                break;
+
+            case SDL_USEREVENT:
+                switch (event.user.code)
+                {
+                case USEREVENTCODE_FRAMECHANGE:
+                    if ((uintptr_t)event.user.data1 == scheduler.generation)
+                    {
+                        scheduler.timer = 0;
+                        reschedule = true;
+                        trace_span(
+                            "timer tick", sync_start, G->frame_index,
+                            TRACE_NO_ARG);
+                    }
+                    break;
+                case USEREVENTCODE_HIDEAPPTEXT:
+                    app_show_state_overlay(G, false);
                     screen_dirty = true;
+                    break;
+                case USEREVENTCODE_RELOADKEYS:
+                    keybinds_init();
+                    break;
+                case USEREVENTCODE_THUMBNAILS:
+                    if (G->montage_visible)
+                        screen_dirty = true;
+                    break;
+                }
+                break;
+
+            case SDL_RENDER_TARGETS_RESET:
+                /* Render target textures lost their contents. */
+                G->overlay_dirty = true;
+                graphiclist_drop_mips(G->images);
+                screen_dirty = true;
+                break;
+
+            case SDL_WINDOWEVENT:
+                screen_dirty = true;
+                if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
+                    app_resize(G, event.window.data1, event.window.data2);
                 break;
-            case USEREVENTCODE_HIDEAPPTEXT:
-                app_show_state_overlay(G, false);
+
+            case SDL_KEYDOWN:
                 screen_dirty = true;
+                reschedule = true;
+                keybinds_dispatch(event.key.keysym, G);
+                break;
+
+            case SDL_MOUSEBUTTONDOWN:
+                if (G->montage_visible
+                    && event.button.button == SDL_BUTTON_LEFT)
+                {
+                    size_t index;
+                    if (montage_cell_at(
+                            G->montage, event.button.x, event.button.y,
+                            &index))
+                    {
+                        montage_select(G->montage, index);
+                        open_montage_selection(G);
+                        reschedule = true;
+                    }
+                    screen_dirty = true;
+                }
+                break;
+
+            case SDL_MOUSEWHEEL:
+                if (G->montage_visible)
+                {
+                    montage_scroll(G->montage, -event.wheel.y);
+                    screen_dirty = true;
+                }
+                break;
+
+            case SDL_MOUSEMOTION:
+                if (!G->montage_visible
+                    && (event.motion.state & SDL_BUTTON_LMASK))
+                {
+                    viewer_translate(
+                        &G->view, event.motion.xrel, event.motion.yrel);
+                    screen_dirty = true;
+                }
                 break;
             }
-            break;
-
-        case SDL_WINDOWEVENT:
-            screen_dirty = true;
-            if (event.window.event == SDL_WINDOWEVENT_SIZE_CHANGED)
-                app_resize(G, event.window.data1, event.window.data2);
-            break;
-
-        case SDL_KEYDOWN:
-            screen_dirty = true;
-            for (size_t i = 0; i < actions_count; ++i)
-                if (action_ispressed(actions[i], event.key.keysym))
-                    actions[i].action(G);
-            break;
-
-        case SDL_MOUSEMOTION:
-            if (event.motion.state & SDL_BUTTON_LMASK)
+            /* The menu isn't shown over the thumbnail grid. */
+            if ((!G->montage_visible
+                    || event.type == SDL_RENDER_TARGETS_RESET)
+                && menu_handle_event(G->menu, event))
             {
-                viewer_translate(&G->view, event.motion.xrel, event.motion.yrel);
                 screen_dirty = true;
+                reschedule = true;
             }
-            break;
-        }
-        if (menu_handle_event(G->menu, event))
-            screen_dirty = true;
+        } while (SDL_PollEvent(&event));
+        if (reschedule)
+            schedule_next_frame(G);
     }
 
-    SDL_RemoveTimer(frame_update_timer);
+    if (scheduler.timer)
+        SDL_RemoveTimer(scheduler.timer);
+    keybinds_quit();
     app_free(G);
+    playlist_free(playlist);
+    framecache_quit();
+    sdlgif_quit();
     TTF_Quit();
     SDL_Quit();
 
-    gif_free(gif);
-
+    trace_close();
+    if (args.stats)
+        stats_print(stderr);
     return EXIT_SUCCESS;
 }
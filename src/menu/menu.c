@@ -21,6 +21,7 @@
 #include "font.h"
 #include "menubutton.h"
 #include "util.h"
+#include "stats/stats.h"
 
 #include <SDL2/SDL_ttf.h>
 
@@ -41,11 +42,91 @@ struct Menu
     size_t items_count, items_size;
     struct MenuButton **items;
     bool is_visible;
+    /**
+     * The menu as last drawn, or NULL if it hasn't been drawn yet or the
+     * renderer can't draw to textures.
+     */
+    SDL_Texture *cache;
+    /** Does CACHE need to be redrawn? */
+    bool cache_dirty;
+    /** Can the menu be drawn into CACHE? */
+    bool can_cache;
 };
 
 void _on_changed(Menu *);
 
 
+/** Free MENU's cache texture. */
+void _destroy_cache(Menu *menu)
+{
+    if (!menu->cache)
+        return;
+    int w = 0, h = 0;
+    SDL_QueryTexture(menu->cache, NULL, NULL, &w, &h);
+    stats_memory_remove(STATS_MEMORY_UI_TEXTURES, (size_t)w * h * 4);
+    SDL_DestroyTexture(menu->cache);
+    menu->cache = NULL;
+}
+
+/** Draw the menu, offset by (dx, dy). */
+void _draw_contents(Menu *menu, int dx, int dy)
+{
+    SDL_Rect const rect = {
+        .x=menu->rect.x + dx, .y=menu->rect.y + dy,
+        .w=menu->rect.w, .h=menu->rect.h
+    };
+    SDL_SetRenderDrawColor(
+        menu->renderer,
+        FILL_COLOR.r, FILL_COLOR.g, FILL_COLOR.b, FILL_COLOR.a);
+    SDL_RenderFillRect(menu->renderer, &rect);
+
+    SDL_SetRenderDrawColor(
+        menu->renderer,
+        OUTLINE_COLOR.r, OUTLINE_COLOR.g, OUTLINE_COLOR.b, OUTLINE_COLOR.a);
+    SDL_RenderDrawRect(menu->renderer, &rect);
+
+    for (size_t i = 0; i < menu->items_count; ++i)
+        menubutton_draw(menu->items[i], dx, dy);
+}
+
+/**
+ * Redraw the menu into its cache texture, (re)creating the texture if the
+ * menu's size changed.  Leaves the cache NULL if it can't be drawn to.
+ */
+void _redraw_cache(Menu *menu)
+{
+    menu->cache_dirty = false;
+    if (!menu->can_cache)
+        return;
+
+    int w = 0, h = 0;
+    if (menu->cache)
+        SDL_QueryTexture(menu->cache, NULL, NULL, &w, &h);
+    if (w != menu->rect.w || h != menu->rect.h)
+    {
+        _destroy_cache(menu);
+        menu->cache = SDL_CreateTexture(
+            menu->renderer, SDL_PIXELFORMAT_ARGB8888,
+            SDL_TEXTUREACCESS_TARGET, menu->rect.w, menu->rect.h);
+        if (!menu->cache)
+        {
+            error("SDL_CreateTexture -- %s\n", SDL_GetError());
+            menu->can_cache = false;
+            return;
+        }
+        size_t const bytes = (size_t)menu->rect.w * menu->rect.h * 4;
+        stats_count(STATS_COUNTER_TEXTURES_CREATED, 1);
+        stats_count(STATS_COUNTER_TEXTURE_BYTES, bytes);
+        stats_memory_add(STATS_MEMORY_UI_TEXTURES, bytes);
+    }
+
+    SDL_Texture *const target = SDL_GetRenderTarget(menu->renderer);
+    SDL_SetRenderTarget(menu->renderer, menu->cache);
+    _draw_contents(menu, -menu->rect.x, -menu->rect.y);
+    SDL_SetRenderTarget(menu->renderer, target);
+}
+
+
 
 Menu *menu_new(SDL_Renderer *R)
 {
@@ -61,6 +142,12 @@ Menu *menu_new(SDL_Renderer *R)
     menu->items_size = 0;
     menu->items = NULL;
     menu->is_visible = false;
+    menu->cache = NULL;
+    menu->cache_dirty = true;
+    SDL_RendererInfo info;
+    menu->can_cache = (
+        SDL_GetRendererInfo(R, &info) == 0
+        && (info.flags & SDL_RENDERER_TARGETTEXTURE));
     return menu;
 }
 
@@ -70,6 +157,7 @@ void menu_free(Menu *menu)
     for (size_t i = 0; i < menu->items_count; ++i)
         menubutton_free(menu->items[i]);
     free(menu->items);
+    _destroy_cache(menu);
     free(menu);
 }
 
@@ -78,19 +166,12 @@ void menu_draw(Menu *menu)
 {
     if (!menu->is_visible)
         return;
-
-    SDL_SetRenderDrawColor(
-        menu->renderer,
-        FILL_COLOR.r, FILL_COLOR.g, FILL_COLOR.b, FILL_COLOR.a);
-    SDL_RenderFillRect(menu->renderer, &menu->rect);
-
-    SDL_SetRenderDrawColor(
-        menu->renderer,
-        OUTLINE_COLOR.r, OUTLINE_COLOR.g, OUTLINE_COLOR.b, OUTLINE_COLOR.a);
-    SDL_RenderDrawRect(menu->renderer, &menu->rect);
-
-    for (size_t i = 0; i < menu->items_count; ++i)
-        menubutton_draw(menu->items[i]);
+    if (menu->cache_dirty)
+        _redraw_cache(menu);
+    if (menu->cache)
+        SDL_RenderCopy(menu->renderer, menu->cache, NULL, &menu->rect);
+    else
+        _draw_contents(menu, 0, 0);
 }
 
 
@@ -99,6 +180,12 @@ bool menu_handle_event(Menu *menu, SDL_Event event)
     static bool is_show_click = false;
     bool handled = false;
 
+    if (event.type == SDL_RENDER_TARGETS_RESET)
+    {
+        menu->cache_dirty = true;
+        return menu->is_visible;
+    }
+
     if (!menu->is_visible)
     {
         switch (event.type)
@@ -145,7 +232,8 @@ void menu_add_button(Menu *menu, MenuButton *button)
     if (menu->items_count + 1 >= menu->items_size)
     {
         menu->items_size += 10;
-        menu->items = realloc(menu->items, menu->items_size);
+        menu->items = realloc(
+            menu->items, menu->items_size * sizeof(*menu->items));
     }
     menu->items[menu->items_count++] = button;
     signal_connect(menubutton_signal_changed(button), bind(_on_changed, menu));
@@ -166,7 +254,7 @@ void menu_move_to(Menu *menu, int x, int y)
 
 
 
-/** Recalculate menu rect. */
+/** Recalculate menu rect, and have the cache redrawn. */
 void _on_changed(Menu *menu)
 {
     SDL_Rect textrect = {.x=0, .y=0, .w=0, .h=0};
@@ -192,4 +280,5 @@ void _on_changed(Menu *menu)
 
     menu->rect.w = textrect.w + 2 * PADDING + 2 * BORDER;
     menu->rect.h = textrect.h + 2 * PADDING + 2 * BORDER;
+    menu->cache_dirty = true;
 }
@@ -20,6 +20,9 @@
 #include "menubutton.h"
 #include "font.h"
 #include "util.h"
+#include "glyphatlas/glyphatlas.h"
+
+#include <string.h>
 
 #include <SDL2/SDL_ttf.h>
 
@@ -28,16 +31,20 @@ static int const INNER_PADDING = 3;
 static SDL_Color const TEXT_COLOR = {.r=0x00, .g=0x00, .b=0x00, .a=0xFF};
 static SDL_Color const HOVERED_COLOR = {.r=0x7F, .g=0x7F, .b=0x7F, .a=0xFF};
 
+/** Longest label (in bytes, including the NUL) a button holds. */
+#define MAX_LABEL_LENGTH    64
+
 
 struct MenuButton
 {
     /* Rect for overlap detection. */
     SDL_Rect rect;
-    /* Rect for pasting the texture. x & y are synced with RECT, offset by
+    /* Rect for drawing the label. x & y are synced with RECT, offset by
      * INNER_PADDING */
     SDL_Rect visrect;
     SDL_Renderer *renderer;
-    SDL_Texture *text;
+    struct GlyphAtlas *atlas;
+    char label[MAX_LABEL_LENGTH];
     bool is_hovered;
     BoundFunction on_click;
     Signal *signal_changed;
@@ -56,7 +63,9 @@ menubutton_new(char const *label, BoundFunction on_click, SDL_Renderer *R)
     };
     btn->visrect = (SDL_Rect){.x=INNER_PADDING, .y=INNER_PADDING, .w=0, .h=0};
     btn->renderer = R;
-    btn->text = NULL;
+    btn->atlas = glyphatlas_get(R, DEFAULT_FONT_PATH, DEFAULT_FONT_SIZE);
+    if (!btn->atlas)
+        error("Failed to load font: %s\n", TTF_GetError());
     btn->is_hovered = false;
     btn->on_click = on_click;
     btn->signal_changed = signal_new();
@@ -68,21 +77,26 @@ menubutton_new(char const *label, BoundFunction on_click, SDL_Renderer *R)
 
 void menubutton_free(MenuButton *btn)
 {
-    SDL_DestroyTexture(btn->text);
     free(btn);
 }
 
 
-void menubutton_draw(MenuButton *btn)
+void menubutton_draw(MenuButton *btn, int dx, int dy)
 {
     if (btn->is_hovered)
     {
+        SDL_Rect const rect = {
+            .x=btn->rect.x + dx, .y=btn->rect.y + dy,
+            .w=btn->rect.w, .h=btn->rect.h
+        };
         SDL_SetRenderDrawColor(
             btn->renderer,
             HOVERED_COLOR.r, HOVERED_COLOR.g, HOVERED_COLOR.b, HOVERED_COLOR.a);
-        SDL_RenderFillRect(btn->renderer, &btn->rect);
+        SDL_RenderFillRect(btn->renderer, &rect);
     }
-    SDL_RenderCopy(btn->renderer, btn->text, NULL, &btn->visrect);
+    glyphatlas_draw(
+        btn->atlas, btn->label, btn->visrect.x + dx, btn->visrect.y + dy,
+        TEXT_COLOR, false);
 }
 
 
@@ -96,6 +110,7 @@ bool menubutton_handle_event(MenuButton *btn, SDL_Event event)
         if (is_hovered != btn->is_hovered)
         {
             btn->is_hovered = is_hovered;
+            signal_emit(btn->signal_changed);
             return true;
         }
         break;}
@@ -142,24 +157,14 @@ SDL_Rect menubutton_get_rect(MenuButton *btn)
 
 void menubutton_set_label(MenuButton *btn, char const *label)
 {
-    TTF_Font *font = TTF_OpenFont(DEFAULT_FONT_PATH, DEFAULT_FONT_SIZE);
-    SDL_Surface *surface = TTF_RenderUTF8_Blended(font, label, TEXT_COLOR);
-    if (!surface)
-        error("TTF_RenderUTF8_Blended -- %s\n", TTF_GetError());
-    TTF_CloseFont(font);
-
-    int width = surface? surface->w : 0;
-    int height = surface? surface->h : 0;
-
-    btn->rect.w = width + 2 * INNER_PADDING;
-    btn->rect.h = height + 2 * INNER_PADDING;
-    btn->visrect.w = width;
-    btn->visrect.h = height;
-    btn->text = SDL_CreateTextureFromSurface(btn->renderer, surface);
-    if (!btn->text)
-        error("SDL_CreateTextureFromSurface -- %s\n", SDL_GetError());
-
-    SDL_FreeSurface(surface);
+    strncpy(btn->label, label, MAX_LABEL_LENGTH - 1);
+    btn->label[MAX_LABEL_LENGTH - 1] = '\0';
+    SDL_Rect const size = glyphatlas_measure(btn->atlas, btn->label, false);
+
+    btn->rect.w = size.w + 2 * INNER_PADDING;
+    btn->rect.h = size.h + 2 * INNER_PADDING;
+    btn->visrect.w = size.w;
+    btn->visrect.h = size.h;
     signal_emit(btn->signal_changed);
 }
 
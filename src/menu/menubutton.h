@@ -35,7 +35,8 @@ MenuButton *
 menubutton_new(char const *label, BoundFunction on_click, SDL_Renderer *R);
 void menubutton_free(MenuButton *btn);
 
-void menubutton_draw(MenuButton *btn);
+/** Draw BTN, offset by (dx, dy). */
+void menubutton_draw(MenuButton *btn, int dx, int dy);
 bool menubutton_handle_event(MenuButton *btn, SDL_Event event);
 
 void menubutton_translate(MenuButton *btn, int dx, int dy);
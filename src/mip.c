@@ -0,0 +1,123 @@
+/*
+ * mip.c -- Mipmap downscaling definitions.
+ *
+ * Each output channel is the rounded average of a 2x2 block,
+ * (a + b + c + d + 2) >> 2, computed in 16-bit integers so the SSE2 and
+ * scalar paths produce identical output.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "mip.h"
+
+#if __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+/**
+ * Downscale output pixels [X0, (WIDTH+1)/2) from the 2x2 blocks spanning ROW0
+ * and ROW1.  The last column is repeated if WIDTH is odd.
+ */
+void _downscale_row_scalar(
+    uint8_t const *row0, uint8_t const *row1, int x0, int width, uint8_t *out)
+{
+    for (int x = x0; x < (width + 1) / 2; ++x)
+    {
+        int const left = 4 * (2 * x);
+        int const right = 2 * x + 1 < width? left + 4 : left;
+        for (int c = 0; c < 4; ++c)
+        {
+            out[4 * x + c] = (
+                row0[left + c] + row0[right + c]
+                + row1[left + c] + row1[right + c] + 2) >> 2;
+        }
+    }
+}
+
+
+#if __SSE2__
+/** Average the 2x2 blocks of 4 pixels from each of A and B into 2 pixels. */
+__m128i _average_blocks_sse2(__m128i a, __m128i b)
+{
+    __m128i const zero = _mm_setzero_si128();
+    /* Vertical sums, one 16-bit lane per channel. */
+    __m128i const lo = _mm_add_epi16(
+        _mm_unpacklo_epi8(a, zero), _mm_unpacklo_epi8(b, zero));
+    __m128i const hi = _mm_add_epi16(
+        _mm_unpackhi_epi8(a, zero), _mm_unpackhi_epi8(b, zero));
+    /* Each 64-bit half holds one pixel, so pairing halves sums
+     * horizontally. */
+    __m128i const sum = _mm_add_epi16(
+        _mm_unpacklo_epi64(lo, hi), _mm_unpackhi_epi64(lo, hi));
+    return _mm_srli_epi16(_mm_add_epi16(sum, _mm_set1_epi16(2)), 2);
+}
+
+/**
+ * Downscale as many whole groups of 4 output pixels (8 input pixels) as fit.
+ * Returns the number of output pixels done.
+ */
+int _downscale_row_sse2(
+    uint8_t const *row0, uint8_t const *row1, int width, uint8_t *out)
+{
+    int x = 0;
+    for (; 2 * x + 8 <= width; x += 4)
+    {
+        uint8_t const *const p0 = row0 + 8 * x;
+        uint8_t const *const p1 = row1 + 8 * x;
+        __m128i const a = _average_blocks_sse2(
+            _mm_loadu_si128((__m128i const *)p0),
+            _mm_loadu_si128((__m128i const *)p1));
+        __m128i const b = _average_blocks_sse2(
+            _mm_loadu_si128((__m128i const *)(p0 + 16)),
+            _mm_loadu_si128((__m128i const *)(p1 + 16)));
+        _mm_storeu_si128((__m128i *)(out + 4 * x), _mm_packus_epi16(a, b));
+    }
+    return x;
+}
+#endif
+
+
+void mip_downscale_rgba(
+    uint8_t const *restrict src, size_t src_pitch, int width, int height,
+    uint8_t *restrict dst, size_t dst_pitch)
+{
+#if __SSE2__
+    for (int row = 0; row < height; row += 2)
+    {
+        uint8_t const *const row0 = src + row * src_pitch;
+        uint8_t const *const row1 = row + 1 < height? row0 + src_pitch : row0;
+        uint8_t *const out = dst + (row / 2) * dst_pitch;
+        int const done = _downscale_row_sse2(row0, row1, width, out);
+        _downscale_row_scalar(row0, row1, done, width, out);
+    }
+#else
+    mip_downscale_rgba_scalar(src, src_pitch, width, height, dst, dst_pitch);
+#endif
+}
+
+void mip_downscale_rgba_scalar(
+    uint8_t const *restrict src, size_t src_pitch, int width, int height,
+    uint8_t *restrict dst, size_t dst_pitch)
+{
+    for (int row = 0; row < height; row += 2)
+    {
+        uint8_t const *const row0 = src + row * src_pitch;
+        uint8_t const *const row1 = row + 1 < height? row0 + src_pitch : row0;
+        _downscale_row_scalar(
+            row0, row1, 0, width, dst + (row / 2) * dst_pitch);
+    }
+}
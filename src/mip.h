@@ -0,0 +1,44 @@
+/*
+ * mip.h -- Mipmap downscaling declarations.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFVIEW_MIP_H
+#define GIFVIEW_MIP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ * Halve a WIDTH x HEIGHT RGBA32 image, with rows SRC_PITCH bytes apart, by
+ * averaging each 2x2 block.  DST gets ((WIDTH+1)/2) x ((HEIGHT+1)/2) pixels,
+ * with rows DST_PITCH bytes apart.  The last row and column are repeated if
+ * HEIGHT or WIDTH is odd.  Uses SSE2 where available, which gives the same
+ * output as mip_downscale_rgba_scalar.
+ */
+void mip_downscale_rgba(
+    uint8_t const *restrict src, size_t src_pitch, int width, int height,
+    uint8_t *restrict dst, size_t dst_pitch);
+
+/** Portable version of mip_downscale_rgba. */
+void mip_downscale_rgba_scalar(
+    uint8_t const *restrict src, size_t src_pitch, int width, int height,
+    uint8_t *restrict dst, size_t dst_pitch);
+
+
+#endif /* GIFVIEW_MIP_H */
@@ -0,0 +1,549 @@
+/*
+ * montage.c -- Thumbnail grid definitions.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "montage.h"
+#include "mip.h"
+#include "sdlgif.h"
+#include "util.h"
+#include "gif/gif.h"
+#include "stats/stats.h"
+#include "stats/trace.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+
+/** Most threads to decode thumbnails on. */
+#define MAX_WORKERS 8
+
+/** Gap around each thumbnail (in pixels). */
+static int const CELL_PADDING = 6;
+/** Size of a grid cell (in pixels). */
+static int const CELL_SIZE = MONTAGE_THUMBNAIL_SIZE + 2 * CELL_PADDING;
+/**
+ * Thumbnails are kept for cells up to this many screens away from the visible
+ * ones, so scrolling back and forth doesn't decode them again.
+ */
+static size_t const KEEP_SCREENS = 4;
+
+/** Color behind the grid. */
+static uint8_t const BACKGROUND_COLOR[3] = {0x30, 0x30, 0x30};
+/** Color of cells whose thumbnails aren't ready. */
+static uint8_t const PLACEHOLDER_COLOR[3] = {0x48, 0x48, 0x48};
+/** Color of the cross drawn over cells whose files couldn't be opened. */
+static uint8_t const ERROR_COLOR[3] = {0xC0, 0x40, 0x40};
+/** Color of the selected cell's border. */
+static uint8_t const SELECTION_COLOR[3] = {0xE0, 0xE0, 0xE0};
+
+
+/** How far along a cell's thumbnail is. */
+enum ThumbnailState
+{
+    THUMBNAIL_PENDING,
+    THUMBNAIL_DECODING,
+    /** Decoded into SURFACE, but not uploaded yet. */
+    THUMBNAIL_READY,
+    /** Uploaded into TEXTURE. */
+    THUMBNAIL_SHOWN,
+    /** The file has no image to show. */
+    THUMBNAIL_EMPTY,
+    /** The file couldn't be opened or parsed. */
+    THUMBNAIL_FAILED,
+};
+
+/** A cell's thumbnail. */
+struct Thumbnail
+{
+    enum ThumbnailState state;
+    SDL_Surface *surface;
+    SDL_Texture *texture;
+    int width, height;
+};
+
+struct Montage
+{
+    SDL_Renderer *renderer;
+    struct Playlist const *playlist;
+    struct Thumbnail *cells;
+    size_t count;
+    int width, height;
+    /** Number of cells in each row. */
+    int columns;
+    /** Distance (in pixels) scrolled down from the top of the grid. */
+    int scroll;
+    size_t selected;
+    /** Cells from first_visible up to (not including) last_visible. */
+    size_t first_visible, last_visible;
+    /** Held while using the cells or visible range. */
+    SDL_mutex *lock;
+    /** Signalled when the visible range changes. */
+    SDL_cond *wake;
+    bool quitting;
+    SDL_Thread *workers[MAX_WORKERS];
+    int worker_count;
+    void (*on_ready)(void);
+    /** Set once on_ready has been called, until the next draw. */
+    SDL_atomic_t ready_pending;
+};
+
+
+/** FrameCallback which shrinks the first frame into a thumbnail surface. */
+void _shrink_first_frame(SDL_Surface *frame, size_t delay, void *userdata)
+{
+    SDL_Surface **thumbnail = userdata;
+    if (*thumbnail || frame->w == 0 || frame->h == 0)
+        return;
+
+    /* Halve with the box filter until the frame fits. */
+    int width = frame->w, height = frame->h;
+    uint8_t const *pixels = frame->pixels;
+    size_t pitch = frame->pitch;
+    uint8_t *buffer = NULL;
+    while (width > MONTAGE_THUMBNAIL_SIZE || height > MONTAGE_THUMBNAIL_SIZE)
+    {
+        int const half_width = (width + 1) / 2;
+        int const half_height = (height + 1) / 2;
+        uint8_t *half = malloc((size_t)half_width * half_height * 4);
+        mip_downscale_rgba(
+            pixels, pitch, width, height, half, (size_t)half_width * 4);
+        free(buffer);
+        buffer = half;
+        pixels = half;
+        pitch = (size_t)half_width * 4;
+        width = half_width;
+        height = half_height;
+    }
+
+    *thumbnail = SDL_CreateRGBSurfaceWithFormat(
+        0, width, height, 32, SDL_PIXELFORMAT_RGBA32);
+    if (*thumbnail)
+    {
+        for (int y = 0; y < height; ++y)
+        {
+            memcpy(
+                (uint8_t *)(*thumbnail)->pixels + y * (*thumbnail)->pitch,
+                pixels + y * pitch, (size_t)width * 4);
+        }
+        stats_memory_add(STATS_MEMORY_SURFACES, (size_t)width * height * 4);
+    }
+    else
+        error("SDL_CreateRGBSurfaceWithFormat -- %s\n", SDL_GetError());
+    free(buffer);
+}
+
+/**
+ * Make a thumbnail of the GIF at PATH in THUMBNAIL, which is NULL if it has no
+ * images.  Only the file's first image is decoded.  Returns false if PATH
+ * can't be opened or parsed.
+ */
+bool _make_thumbnail(char const *path, SDL_Surface **thumbnail)
+{
+    uint64_t const start = stats_now();
+    *thumbnail = NULL;
+    GIF gif;
+    if (gif_try_first_image_from_file(path, &gif) != GIF_OK)
+        return false;
+    sdlgif_composite_frames(gif, _shrink_first_frame, thumbnail);
+    gif_free(gif);
+    trace_span("thumbnail", start, TRACE_NO_ARG, TRACE_NO_ARG);
+    return true;
+}
+
+/** Free THUMBNAIL's surface and texture, returning it to THUMBNAIL_PENDING. */
+void _drop_thumbnail(struct Thumbnail *thumbnail)
+{
+    size_t const bytes = (size_t)thumbnail->width * thumbnail->height * 4;
+    if (thumbnail->surface)
+    {
+        stats_memory_remove(STATS_MEMORY_SURFACES, bytes);
+        SDL_FreeSurface(thumbnail->surface);
+        thumbnail->surface = NULL;
+    }
+    if (thumbnail->texture)
+    {
+        stats_memory_remove(STATS_MEMORY_UI_TEXTURES, bytes);
+        SDL_DestroyTexture(thumbnail->texture);
+        thumbnail->texture = NULL;
+    }
+    thumbnail->state = THUMBNAIL_PENDING;
+}
+
+/** Upload THUMBNAIL's surface, freeing it. */
+void _upload_thumbnail(SDL_Renderer *renderer, struct Thumbnail *thumbnail)
+{
+    size_t const bytes = (size_t)thumbnail->width * thumbnail->height * 4;
+    thumbnail->texture = SDL_CreateTextureFromSurface(
+        renderer, thumbnail->surface);
+    stats_memory_remove(STATS_MEMORY_SURFACES, bytes);
+    SDL_FreeSurface(thumbnail->surface);
+    thumbnail->surface = NULL;
+    if (!thumbnail->texture)
+    {
+        error("SDL_CreateTextureFromSurface -- %s\n", SDL_GetError());
+        thumbnail->state = THUMBNAIL_EMPTY;
+        return;
+    }
+    SDL_SetTextureBlendMode(thumbnail->texture, SDL_BLENDMODE_BLEND);
+    stats_count(STATS_COUNTER_TEXTURES_CREATED, 1);
+    stats_count(STATS_COUNTER_TEXTURE_BYTES, bytes);
+    stats_memory_add(STATS_MEMORY_UI_TEXTURES, bytes);
+    thumbnail->state = THUMBNAIL_SHOWN;
+}
+
+/**
+ * Pick the next cell to decode a thumbnail for, storing it in INDEX.  Visible
+ * cells come first, then those up to a screen above or below.  Returns false
+ * if there's nothing to do.  MONTAGE's lock must be held.
+ */
+bool _next_job(struct Montage const *montage, size_t *index)
+{
+    for (size_t i = montage->first_visible; i < montage->last_visible; ++i)
+    {
+        if (montage->cells[i].state == THUMBNAIL_PENDING)
+        {
+            *index = i;
+            return true;
+        }
+    }
+    size_t const screen = montage->last_visible - montage->first_visible;
+    for (size_t d = 1; d <= screen; ++d)
+    {
+        size_t const below = montage->last_visible - 1 + d;
+        if (below < montage->count
+            && montage->cells[below].state == THUMBNAIL_PENDING)
+        {
+            *index = below;
+            return true;
+        }
+        if (d <= montage->first_visible
+            && montage->cells[montage->first_visible - d].state
+                == THUMBNAIL_PENDING)
+        {
+            *index = montage->first_visible - d;
+            return true;
+        }
+    }
+    return false;
+}
+
+/** Background thread which decodes thumbnails near the visible cells. */
+int _thumbnail_worker(void *data)
+{
+    struct Montage *montage = data;
+    SDL_LockMutex(montage->lock);
+    while (!montage->quitting)
+    {
+        size_t index;
+        if (!_next_job(montage, &index))
+        {
+            SDL_CondWait(montage->wake, montage->lock);
+            continue;
+        }
+        montage->cells[index].state = THUMBNAIL_DECODING;
+        SDL_UnlockMutex(montage->lock);
+        SDL_Surface *surface;
+        bool const parsed = _make_thumbnail(
+            playlist_path_at(montage->playlist, index), &surface);
+        SDL_LockMutex(montage->lock);
+
+        struct Thumbnail *thumbnail = &montage->cells[index];
+        thumbnail->surface = surface;
+        thumbnail->state = (
+            surface? THUMBNAIL_READY
+            : parsed? THUMBNAIL_EMPTY
+            : THUMBNAIL_FAILED);
+        if (surface)
+        {
+            thumbnail->width = surface->w;
+            thumbnail->height = surface->h;
+        }
+        if (SDL_AtomicCAS(&montage->ready_pending, 0, 1))
+            montage->on_ready();
+    }
+    SDL_UnlockMutex(montage->lock);
+    return 0;
+}
+
+/** Total number of rows in the grid. */
+int _row_count(struct Montage const *montage)
+{
+    return (montage->count + montage->columns - 1) / montage->columns;
+}
+
+/** Keep the scroll position within the grid. */
+void _clamp_scroll(struct Montage *montage)
+{
+    int const max_scroll = _row_count(montage) * CELL_SIZE - montage->height;
+    if (montage->scroll > max_scroll)
+        montage->scroll = max_scroll;
+    if (montage->scroll < 0)
+        montage->scroll = 0;
+}
+
+/** Recalculate which cells are visible, and wake the workers to decode them. */
+void _update_visible(struct Montage *montage)
+{
+    size_t const columns = montage->columns;
+    size_t const first_row = montage->scroll / CELL_SIZE;
+    size_t const last_row = (
+        (montage->scroll + montage->height + CELL_SIZE - 1) / CELL_SIZE);
+    SDL_LockMutex(montage->lock);
+    montage->first_visible = first_row * columns;
+    montage->last_visible = last_row * columns;
+    if (montage->first_visible > montage->count)
+        montage->first_visible = montage->count;
+    if (montage->last_visible > montage->count)
+        montage->last_visible = montage->count;
+    SDL_CondBroadcast(montage->wake);
+    SDL_UnlockMutex(montage->lock);
+}
+
+/** Position of cell INDEX in the window. */
+SDL_Rect _cell_rect(struct Montage const *montage, size_t index)
+{
+    int const margin = (montage->width - montage->columns * CELL_SIZE) / 2;
+    return (SDL_Rect){
+        .x = margin + (int)(index % montage->columns) * CELL_SIZE,
+        .y = (int)(index / montage->columns) * CELL_SIZE - montage->scroll,
+        .w = CELL_SIZE,
+        .h = CELL_SIZE,
+    };
+}
+
+/** Draw cell INDEX.  MONTAGE's lock must be held. */
+void _draw_cell(struct Montage *montage, size_t index)
+{
+    SDL_Rect const cell = _cell_rect(montage, index);
+    SDL_Rect box = {
+        .x = cell.x + CELL_PADDING,
+        .y = cell.y + CELL_PADDING,
+        .w = MONTAGE_THUMBNAIL_SIZE,
+        .h = MONTAGE_THUMBNAIL_SIZE,
+    };
+
+    if (index == montage->selected)
+    {
+        SDL_Rect border = {
+            .x = box.x - CELL_PADDING / 2,
+            .y = box.y - CELL_PADDING / 2,
+            .w = box.w + CELL_PADDING,
+            .h = box.h + CELL_PADDING,
+        };
+        SDL_SetRenderDrawColor(
+            montage->renderer,
+            SELECTION_COLOR[0], SELECTION_COLOR[1], SELECTION_COLOR[2], 0xFF);
+        SDL_RenderDrawRect(montage->renderer, &border);
+        border.x++;
+        border.y++;
+        border.w -= 2;
+        border.h -= 2;
+        SDL_RenderDrawRect(montage->renderer, &border);
+    }
+
+    struct Thumbnail *thumbnail = &montage->cells[index];
+    if (thumbnail->state == THUMBNAIL_READY)
+        _upload_thumbnail(montage->renderer, thumbnail);
+    if (thumbnail->state != THUMBNAIL_SHOWN)
+    {
+        SDL_SetRenderDrawColor(
+            montage->renderer,
+            PLACEHOLDER_COLOR[0], PLACEHOLDER_COLOR[1], PLACEHOLDER_COLOR[2],
+            0xFF);
+        SDL_RenderFillRect(montage->renderer, &box);
+        if (thumbnail->state == THUMBNAIL_FAILED)
+        {
+            SDL_SetRenderDrawColor(
+                montage->renderer,
+                ERROR_COLOR[0], ERROR_COLOR[1], ERROR_COLOR[2], 0xFF);
+            SDL_RenderDrawLine(
+                montage->renderer, box.x, box.y,
+                box.x + box.w - 1, box.y + box.h - 1);
+            SDL_RenderDrawLine(
+                montage->renderer, box.x + box.w - 1, box.y,
+                box.x, box.y + box.h - 1);
+        }
+        return;
+    }
+
+    /* Fit the thumbnail to the box, keeping its aspect ratio. */
+    if (thumbnail->width * box.h > thumbnail->height * box.w)
+    {
+        int const height = box.w * thumbnail->height / thumbnail->width;
+        box.y += (box.h - height) / 2;
+        box.h = height;
+    }
+    else
+    {
+        int const width = box.h * thumbnail->width / thumbnail->height;
+        box.x += (box.w - width) / 2;
+        box.w = width;
+    }
+    SDL_RenderCopy(montage->renderer, thumbnail->texture, NULL, &box);
+}
+
+
+struct Montage *montage_new(
+    SDL_Renderer *renderer, struct Playlist const *playlist,
+    void (*on_ready)(void))
+{
+    struct Montage *montage = malloc(sizeof(*montage));
+    montage->renderer = renderer;
+    montage->playlist = playlist;
+    montage->count = playlist_count(playlist);
+    montage->cells = malloc(montage->count * sizeof(*montage->cells));
+    for (size_t i = 0; i < montage->count; ++i)
+    {
+        montage->cells[i] = (struct Thumbnail){
+            .state = THUMBNAIL_PENDING,
+            .surface = NULL,
+            .texture = NULL,
+            .width = 0,
+            .height = 0,
+        };
+    }
+    montage->width = 0;
+    montage->height = 0;
+    montage->columns = 1;
+    montage->scroll = 0;
+    montage->selected = 0;
+    montage->first_visible = 0;
+    montage->last_visible = 0;
+    montage->lock = SDL_CreateMutex();
+    montage->wake = SDL_CreateCond();
+    if (!montage->lock || !montage->wake)
+        fatal("SDL_CreateMutex -- %s\n", SDL_GetError());
+    montage->quitting = false;
+    montage->on_ready = on_ready;
+    SDL_AtomicSet(&montage->ready_pending, 0);
+
+    int const cpus = SDL_GetCPUCount();
+    montage->worker_count = 0;
+    for (int i = 0; i < cpus && i < MAX_WORKERS; ++i)
+    {
+        SDL_Thread *thread = SDL_CreateThread(
+            _thumbnail_worker, "thumbnail", montage);
+        if (!thread)
+        {
+            warn("SDL_CreateThread -- %s\n", SDL_GetError());
+            break;
+        }
+        montage->workers[montage->worker_count++] = thread;
+    }
+    if (montage->worker_count == 0)
+        fatal("no threads to decode thumbnails on\n");
+    return montage;
+}
+
+void montage_free(struct Montage *montage)
+{
+    SDL_LockMutex(montage->lock);
+    montage->quitting = true;
+    SDL_CondBroadcast(montage->wake);
+    SDL_UnlockMutex(montage->lock);
+    for (int i = 0; i < montage->worker_count; ++i)
+        SDL_WaitThread(montage->workers[i], NULL);
+
+    for (size_t i = 0; i < montage->count; ++i)
+        _drop_thumbnail(&montage->cells[i]);
+    free(montage->cells);
+    SDL_DestroyCond(montage->wake);
+    SDL_DestroyMutex(montage->lock);
+    free(montage);
+}
+
+void montage_resize(struct Montage *montage, int width, int height)
+{
+    montage->width = width;
+    montage->height = height;
+    montage->columns = width / CELL_SIZE;
+    if (montage->columns < 1)
+        montage->columns = 1;
+    _clamp_scroll(montage);
+    _update_visible(montage);
+}
+
+void montage_scroll(struct Montage *montage, int rows)
+{
+    montage->scroll += rows * CELL_SIZE;
+    _clamp_scroll(montage);
+    _update_visible(montage);
+}
+
+void montage_select(struct Montage *montage, size_t index)
+{
+    montage->selected = index;
+    int const top = (int)(index / montage->columns) * CELL_SIZE;
+    if (top < montage->scroll)
+        montage->scroll = top;
+    else if (top + CELL_SIZE > montage->scroll + montage->height)
+        montage->scroll = top + CELL_SIZE - montage->height;
+    _clamp_scroll(montage);
+    _update_visible(montage);
+}
+
+size_t montage_selected(struct Montage const *montage)
+{
+    return montage->selected;
+}
+
+bool montage_cell_at(
+    struct Montage const *montage, int x, int y, size_t *index)
+{
+    int const margin = (montage->width - montage->columns * CELL_SIZE) / 2;
+    if (x < margin || y < 0)
+        return false;
+    int const column = (x - margin) / CELL_SIZE;
+    if (column >= montage->columns)
+        return false;
+    size_t const row = (y + montage->scroll) / CELL_SIZE;
+    size_t const cell = row * montage->columns + column;
+    if (cell >= montage->count)
+        return false;
+    *index = cell;
+    return true;
+}
+
+void montage_draw(struct Montage *montage)
+{
+    uint64_t const start = stats_now();
+    SDL_AtomicSet(&montage->ready_pending, 0);
+    SDL_SetRenderDrawColor(
+        montage->renderer,
+        BACKGROUND_COLOR[0], BACKGROUND_COLOR[1], BACKGROUND_COLOR[2], 0xFF);
+    SDL_RenderClear(montage->renderer);
+
+    SDL_LockMutex(montage->lock);
+    /* Forget thumbnails far from view, so memory use doesn't grow with the
+     * number of files. */
+    size_t const keep = KEEP_SCREENS * (
+        montage->last_visible - montage->first_visible);
+    for (size_t i = 0; i < montage->count; ++i)
+    {
+        bool const distant = (
+            i + keep < montage->first_visible
+            || i >= montage->last_visible + keep);
+        enum ThumbnailState const state = montage->cells[i].state;
+        if (distant && (state == THUMBNAIL_READY || state == THUMBNAIL_SHOWN))
+            _drop_thumbnail(&montage->cells[i]);
+    }
+    for (size_t i = montage->first_visible; i < montage->last_visible; ++i)
+        _draw_cell(montage, i);
+    SDL_UnlockMutex(montage->lock);
+    trace_span("montage_draw", start, TRACE_NO_ARG, TRACE_NO_ARG);
+}
@@ -0,0 +1,80 @@
+/*
+ * montage.h -- Thumbnail grid declarations.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFVIEW_MONTAGE_H
+#define GIFVIEW_MONTAGE_H
+
+#include "playlist.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include <SDL2/SDL.h>
+
+
+/** Largest side of a thumbnail (in pixels). */
+#define MONTAGE_THUMBNAIL_SIZE  128
+
+/**
+ * A grid of thumbnails of every file in a playlist, one file per cell.  Each
+ * thumbnail is the file's first frame, decoded on a pool of background threads
+ * as it scrolls into view.  Defined in montage.c.
+ */
+struct Montage;
+
+
+/**
+ * Create a montage of PLAYLIST's files, drawn with RENDERER.  ON_READY is
+ * called from a background thread when new thumbnails are ready to be drawn.
+ * It isn't called again until the montage has been drawn.
+ */
+struct Montage *montage_new(
+    SDL_Renderer *renderer, struct Playlist const *playlist,
+    void (*on_ready)(void));
+
+/** Stop decoding thumbnails and free a montage. */
+void montage_free(struct Montage *montage);
+
+/** Lay the grid out to fill a WIDTH x HEIGHT window. */
+void montage_resize(struct Montage *montage, int width, int height);
+
+/** Scroll ROWS rows down the grid (or up, if negative). */
+void montage_scroll(struct Montage *montage, int rows);
+
+/** Select file INDEX, scrolling so its cell is visible. */
+void montage_select(struct Montage *montage, size_t index);
+
+/** Index of the selected file. */
+size_t montage_selected(struct Montage const *montage);
+
+/**
+ * Find the file whose cell is at X,Y in the window.  Returns false if there
+ * isn't one there.
+ */
+bool montage_cell_at(
+    struct Montage const *montage, int x, int y, size_t *index);
+
+/**
+ * Draw the visible cells.  Thumbnails which aren't ready yet are drawn as
+ * placeholders.
+ */
+void montage_draw(struct Montage *montage);
+
+
+#endif /* GIFVIEW_MONTAGE_H */
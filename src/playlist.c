@@ -0,0 +1,606 @@
+/*
+ * playlist.c -- Playlist definitions.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "playlist.h"
+#include "framecache.h"
+#include "indexed.h"
+#include "sdlgif.h"
+#include "util.h"
+#include "stats/stats.h"
+#include "stats/trace.h"
+
+#include <errno.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+
+#include <dirent.h>
+#include <sys/stat.h>
+
+
+/** Number of background threads preparing files. */
+#define WORKER_COUNT    2
+
+/** Furthest (in files) from the current file to prefetch. */
+static size_t const PREFETCH_RADIUS = 4;
+
+
+/** How far along a file is in being prepared. */
+enum EntryState
+{
+    ENTRY_IDLE,
+    ENTRY_LOADING,
+    ENTRY_READY,
+    /** The file couldn't be opened or parsed.  It isn't tried again. */
+    ENTRY_FAILED,
+    /** The current file, which was released once it was uploaded. */
+    ENTRY_SHOWN,
+};
+
+/** A file in a playlist. */
+struct Entry
+{
+    char *path;
+    enum EntryState state;
+    /** The prepared file if STATE is ENTRY_READY, otherwise NULL. */
+    struct PreparedGIF *prepared;
+};
+
+struct Playlist
+{
+    struct Entry *entries;
+    size_t count;
+    /** Index of the current file. */
+    size_t current;
+    /**
+     * Files further than this from the current one aren't prefetched.  Shrinks
+     * when the budget runs out, so evicted files aren't loaded straight back.
+     */
+    size_t radius;
+    /**
+     * Bytes used by prepared files, and by the shown file (SHOWN_BYTES of
+     * them).
+     */
+    size_t bytes;
+    size_t shown_bytes;
+    /** Held while using anything above. */
+    SDL_mutex *lock;
+    /** Signalled when there might be something new to prefetch. */
+    SDL_cond *wake;
+    /** Signalled when a file finishes being prepared. */
+    SDL_cond *loaded;
+    bool quitting;
+    SDL_Thread *workers[WORKER_COUNT];
+};
+
+/** Growable list of paths, used while creating a playlist. */
+struct PathList
+{
+    char **paths;
+    size_t count, size;
+};
+
+
+/** Add PATH to LIST, which takes ownership of it. */
+void _add_path(struct PathList *list, char *path)
+{
+    if (list->count == list->size)
+    {
+        list->size = list->size? 2 * list->size : 16;
+        list->paths = realloc(list->paths, list->size * sizeof(*list->paths));
+    }
+    list->paths[list->count++] = path;
+}
+
+/** qsort comparator for paths. */
+int _compare_paths(void const *a, void const *b)
+{
+    return strcmp(*(char *const *)a, *(char *const *)b);
+}
+
+/**
+ * Add PATH to LIST.  If PATH is a directory, the .gif files in it are added
+ * instead, sorted by name.
+ */
+void _collect_paths(struct PathList *list, char const *path)
+{
+    struct stat info;
+    if (stat(path, &info) != 0 || !S_ISDIR(info.st_mode))
+    {
+        _add_path(list, estrdup(path));
+        return;
+    }
+
+    DIR *dir = opendir(path);
+    if (!dir)
+    {
+        error("opendir: %s -- %s\n", path, strerror(errno));
+        return;
+    }
+    size_t const first = list->count;
+    struct dirent const *entry;
+    while ((entry = readdir(dir)) != NULL)
+    {
+        size_t const length = strlen(entry->d_name);
+        if (length < 4 || strcasecmp(entry->d_name + length - 4, ".gif") != 0)
+            continue;
+        char *file = NULL;
+        sprintfa(&file, "%s/%s", path, entry->d_name);
+        if (stat(file, &info) != 0 || !S_ISREG(info.st_mode))
+        {
+            free(file);
+            continue;
+        }
+        _add_path(list, file);
+    }
+    closedir(dir);
+    qsort(
+        list->paths + first, list->count - first, sizeof(*list->paths),
+        _compare_paths);
+}
+
+/** State passed to _keep_frame. */
+struct FrameKeeper
+{
+    struct PreparedGIF *prepared;
+    size_t size;
+    /** indexed_hash of each kept frame. */
+    uint64_t *hashes;
+    /**
+     * Open-addressed hash table of the indices of distinct frames, keyed by
+     * their hashes.  Empty slots hold SIZE_MAX.  TABLE_SIZE is a power of 2.
+     */
+    size_t *table;
+    size_t table_size;
+    size_t distinct_count;
+};
+
+/** Double the size of KEEPER's table of distinct frames. */
+void _grow_frame_table(struct FrameKeeper *keeper)
+{
+    free(keeper->table);
+    keeper->table_size = keeper->table_size? 2 * keeper->table_size : 64;
+    keeper->table = malloc(keeper->table_size * sizeof(*keeper->table));
+    for (size_t i = 0; i < keeper->table_size; ++i)
+        keeper->table[i] = SIZE_MAX;
+    struct PreparedGIF const *prepared = keeper->prepared;
+    for (size_t i = 0; i < prepared->frame_count; ++i)
+    {
+        if (prepared->sources[i] != i)
+            continue;
+        size_t slot = keeper->hashes[i] & (keeper->table_size - 1);
+        while (keeper->table[slot] != SIZE_MAX)
+            slot = (slot + 1) & (keeper->table_size - 1);
+        keeper->table[slot] = i;
+    }
+}
+
+/**
+ * FrameCallback which adds a copy of FRAME to a PreparedGIF, packed to 8 bits
+ * per pixel if it fits in 256 colors.  If an earlier frame has the same
+ * pixels, its copy is shared instead.
+ */
+void _keep_frame(SDL_Surface *frame, size_t delay, void *userdata)
+{
+    struct FrameKeeper *keeper = userdata;
+    struct PreparedGIF *prepared = keeper->prepared;
+    if (prepared->frame_count == keeper->size)
+    {
+        keeper->size = keeper->size? 2 * keeper->size : 16;
+        prepared->frames = realloc(
+            prepared->frames, keeper->size * sizeof(*prepared->frames));
+        prepared->sources = realloc(
+            prepared->sources, keeper->size * sizeof(*prepared->sources));
+        prepared->delays = realloc(
+            prepared->delays, keeper->size * sizeof(*prepared->delays));
+        keeper->hashes = realloc(
+            keeper->hashes, keeper->size * sizeof(*keeper->hashes));
+    }
+    if (2 * (keeper->distinct_count + 1) > keeper->table_size)
+        _grow_frame_table(keeper);
+
+    SDL_Surface *copy = indexed_from_rgba(frame);
+    if (!copy)
+        copy = SDL_DuplicateSurface(frame);
+    if (!copy)
+        fatal("SDL_DuplicateSurface -- %s\n", SDL_GetError());
+    uint64_t const hash = indexed_hash(copy);
+    size_t slot = hash & (keeper->table_size - 1);
+    for (; keeper->table[slot] != SIZE_MAX;
+        slot = (slot + 1) & (keeper->table_size - 1))
+    {
+        size_t const source = keeper->table[slot];
+        if (keeper->hashes[source] != hash
+            || !indexed_same(prepared->frames[source], copy))
+            continue;
+        stats_count(STATS_COUNTER_FRAMES_DEDUPLICATED, 1);
+        SDL_FreeSurface(copy);
+
+        /* Showing the same frame twice in a row is the same as showing it
+         * once for longer. */
+        size_t const last = prepared->frame_count - 1;
+        if (prepared->sources[last] == source)
+        {
+            prepared->delays[last] += delay;
+            return;
+        }
+        prepared->frames[prepared->frame_count] = prepared->frames[source];
+        prepared->frames[source]->refcount++;
+        prepared->sources[prepared->frame_count] = source;
+        prepared->delays[prepared->frame_count] = delay;
+        keeper->hashes[prepared->frame_count] = hash;
+        prepared->frame_count++;
+        return;
+    }
+
+    size_t const bytes = (size_t)copy->pitch * copy->h;
+    stats_memory_add(STATS_MEMORY_SURFACES, bytes);
+    prepared->bytes += bytes;
+    keeper->table[slot] = prepared->frame_count;
+    keeper->distinct_count++;
+    prepared->frames[prepared->frame_count] = copy;
+    prepared->sources[prepared->frame_count] = prepared->frame_count;
+    prepared->delays[prepared->frame_count] = delay;
+    keeper->hashes[prepared->frame_count] = hash;
+    prepared->frame_count++;
+}
+
+/**
+ * Parse and composite the GIF at PATH, or map its frames from the frame cache
+ * if they're there.  Returns NULL if PATH can't be opened or parsed.
+ */
+struct PreparedGIF *_prepare(char const *path)
+{
+    uint64_t const start = stats_now();
+    struct PreparedGIF *prepared = malloc(sizeof(*prepared));
+    SDL_AtomicSet(&prepared->references, 1);
+    if (framecache_load(path, prepared))
+        return prepared;
+
+    if (gif_try_from_file(path, &prepared->gif) != GIF_OK)
+    {
+        error("couldn't open '%s' -- skipping it\n", path);
+        free(prepared);
+        return NULL;
+    }
+    prepared->mapping = NULL;
+    prepared->mapping_size = 0;
+    prepared->frames = NULL;
+    prepared->sources = NULL;
+    prepared->delays = NULL;
+    prepared->frame_count = 0;
+    prepared->bytes = 0;
+
+    struct FrameKeeper keeper = {
+        .prepared = prepared,
+        .size = 0,
+        .hashes = NULL,
+        .table = NULL,
+        .table_size = 0,
+        .distinct_count = 0,
+    };
+    sdlgif_composite_frames(prepared->gif, _keep_frame, &keeper);
+    free(keeper.hashes);
+    free(keeper.table);
+    /* Only the frames are needed from here on. */
+    gif_free_graphics(&prepared->gif);
+    trace_span("prepare file", start, TRACE_NO_ARG, prepared->bytes);
+    framecache_store(path, prepared);
+    return prepared;
+}
+
+/** Free a PreparedGIF, once nothing references it. */
+void _free_prepared(struct PreparedGIF *prepared)
+{
+    if (prepared->mapping)
+    {
+        framecache_release(prepared);
+        free(prepared);
+        return;
+    }
+    for (size_t i = 0; i < prepared->frame_count; ++i)
+    {
+        SDL_Surface *frame = prepared->frames[i];
+        if (prepared->sources[i] == i)
+        {
+            stats_memory_remove(
+                STATS_MEMORY_SURFACES, (size_t)frame->pitch * frame->h);
+        }
+        SDL_FreeSurface(frame);
+    }
+    free(prepared->frames);
+    free(prepared->sources);
+    free(prepared->delays);
+    gif_free(prepared->gif);
+    free(prepared);
+}
+
+/** Distance (in files, either way around) from the current file to INDEX. */
+size_t _distance(struct Playlist const *playlist, size_t index)
+{
+    size_t const forward = (
+        (index + playlist->count - playlist->current) % playlist->count);
+    size_t const backward = (playlist->count - forward) % playlist->count;
+    return forward < backward? forward : backward;
+}
+
+/** Forget ENTRY's prepared file. */
+void _evict(struct Playlist *playlist, struct Entry *entry)
+{
+    playlist->bytes -= entry->prepared->bytes;
+    playlist_unref_prepared(entry->prepared);
+    entry->prepared = NULL;
+    entry->state = ENTRY_IDLE;
+}
+
+/**
+ * Evict the furthest prepared files until PLAYLIST is within budget.  The
+ * current file and its neighbours are always kept.
+ */
+void _enforce_budget(struct Playlist *playlist)
+{
+    while (playlist->bytes > PLAYLIST_BUDGET_BYTES)
+    {
+        struct Entry *furthest = NULL;
+        size_t furthest_distance = 1;
+        for (size_t i = 0; i < playlist->count; ++i)
+        {
+            size_t const distance = _distance(playlist, i);
+            if (playlist->entries[i].state == ENTRY_READY
+                && distance > furthest_distance)
+            {
+                furthest = &playlist->entries[i];
+                furthest_distance = distance;
+            }
+        }
+        if (!furthest)
+            break;
+        _evict(playlist, furthest);
+        if (playlist->radius > furthest_distance - 1)
+            playlist->radius = furthest_distance - 1;
+    }
+}
+
+/** Store ENTRY's newly PREPARED file, or mark it failed if that's NULL. */
+void _finish_loading(
+    struct Playlist *playlist, struct Entry *entry,
+    struct PreparedGIF *prepared)
+{
+    entry->prepared = prepared;
+    if (prepared)
+    {
+        entry->state = ENTRY_READY;
+        playlist->bytes += prepared->bytes;
+        _enforce_budget(playlist);
+    }
+    else
+        entry->state = ENTRY_FAILED;
+    SDL_CondBroadcast(playlist->loaded);
+}
+
+/**
+ * Get the nearest file to the current one which should be prefetched, or
+ * NULL if there aren't any.
+ */
+struct Entry *_next_to_prefetch(struct Playlist *playlist)
+{
+    for (size_t distance = 0;
+            distance <= playlist->radius && 2 * distance <= playlist->count;
+            ++distance)
+    {
+        /* Neighbours are always worth having, whatever the budget says. */
+        if (distance > 1 && playlist->bytes >= PLAYLIST_BUDGET_BYTES)
+            break;
+        size_t const after = (playlist->current + distance) % playlist->count;
+        size_t const before = (
+            (playlist->current + playlist->count - distance % playlist->count)
+            % playlist->count);
+        if (playlist->entries[after].state == ENTRY_IDLE)
+            return &playlist->entries[after];
+        if (playlist->entries[before].state == ENTRY_IDLE)
+            return &playlist->entries[before];
+    }
+    return NULL;
+}
+
+/** Background thread which prepares files near the current one. */
+int _prefetch_worker(void *data)
+{
+    struct Playlist *playlist = data;
+    SDL_LockMutex(playlist->lock);
+    while (!playlist->quitting)
+    {
+        struct Entry *entry = _next_to_prefetch(playlist);
+        if (!entry)
+        {
+            SDL_CondWait(playlist->wake, playlist->lock);
+            continue;
+        }
+        entry->state = ENTRY_LOADING;
+        SDL_UnlockMutex(playlist->lock);
+        struct PreparedGIF *prepared = _prepare(entry->path);
+        SDL_LockMutex(playlist->lock);
+        _finish_loading(playlist, entry, prepared);
+    }
+    SDL_UnlockMutex(playlist->lock);
+    return 0;
+}
+
+
+struct Playlist *playlist_new(char *const *paths, size_t count)
+{
+    struct PathList list = {.paths = NULL, .count = 0, .size = 0};
+    for (size_t i = 0; i < count; ++i)
+        _collect_paths(&list, paths[i]);
+    if (list.count == 0)
+        fatal("no GIF files found\n");
+
+    struct Playlist *playlist = malloc(sizeof(*playlist));
+    playlist->entries = malloc(list.count * sizeof(*playlist->entries));
+    for (size_t i = 0; i < list.count; ++i)
+    {
+        playlist->entries[i] = (struct Entry){
+            .path = list.paths[i],
+            .state = ENTRY_IDLE,
+            .prepared = NULL,
+        };
+    }
+    free(list.paths);
+    playlist->count = list.count;
+    playlist->current = 0;
+    playlist->radius = PREFETCH_RADIUS;
+    playlist->bytes = 0;
+    playlist->shown_bytes = 0;
+    playlist->lock = SDL_CreateMutex();
+    playlist->wake = SDL_CreateCond();
+    playlist->loaded = SDL_CreateCond();
+    if (!playlist->lock || !playlist->wake || !playlist->loaded)
+        fatal("SDL_CreateMutex -- %s\n", SDL_GetError());
+    playlist->quitting = false;
+    for (size_t i = 0; i < WORKER_COUNT; ++i)
+        playlist->workers[i] = NULL;
+    return playlist;
+}
+
+void playlist_start_prefetch(struct Playlist *playlist)
+{
+    /* A single file has nothing to prefetch. */
+    if (playlist->count < 2)
+        return;
+    for (size_t i = 0; i < WORKER_COUNT; ++i)
+    {
+        if (playlist->workers[i])
+            continue;
+        playlist->workers[i] = SDL_CreateThread(
+            _prefetch_worker, "prefetch", playlist);
+        if (!playlist->workers[i])
+            error("SDL_CreateThread -- %s\n", SDL_GetError());
+    }
+}
+
+void playlist_free(struct Playlist *playlist)
+{
+    SDL_LockMutex(playlist->lock);
+    playlist->quitting = true;
+    SDL_CondBroadcast(playlist->wake);
+    SDL_UnlockMutex(playlist->lock);
+    for (size_t i = 0; i < WORKER_COUNT; ++i)
+        if (playlist->workers[i])
+            SDL_WaitThread(playlist->workers[i], NULL);
+
+    for (size_t i = 0; i < playlist->count; ++i)
+    {
+        if (playlist->entries[i].prepared)
+            playlist_unref_prepared(playlist->entries[i].prepared);
+        free(playlist->entries[i].path);
+    }
+    free(playlist->entries);
+    SDL_DestroyCond(playlist->loaded);
+    SDL_DestroyCond(playlist->wake);
+    SDL_DestroyMutex(playlist->lock);
+    free(playlist);
+}
+
+size_t playlist_count(struct Playlist const *playlist)
+{
+    return playlist->count;
+}
+
+char const *playlist_path(struct Playlist const *playlist)
+{
+    return playlist->entries[playlist->current].path;
+}
+
+char const *playlist_path_at(struct Playlist const *playlist, size_t index)
+{
+    return playlist->entries[index].path;
+}
+
+size_t playlist_index(struct Playlist const *playlist)
+{
+    return playlist->current;
+}
+
+struct PreparedGIF const *playlist_current(struct Playlist *playlist)
+{
+    SDL_LockMutex(playlist->lock);
+    struct Entry *entry = &playlist->entries[playlist->current];
+    while (entry->state == ENTRY_LOADING)
+        SDL_CondWait(playlist->loaded, playlist->lock);
+    if (entry->state == ENTRY_IDLE || entry->state == ENTRY_SHOWN)
+    {
+        playlist->bytes -= playlist->shown_bytes;
+        playlist->shown_bytes = 0;
+        entry->state = ENTRY_LOADING;
+        SDL_UnlockMutex(playlist->lock);
+        struct PreparedGIF *prepared = _prepare(entry->path);
+        SDL_LockMutex(playlist->lock);
+        _finish_loading(playlist, entry, prepared);
+    }
+    struct PreparedGIF const *prepared = entry->prepared;
+    SDL_UnlockMutex(playlist->lock);
+    return prepared;
+}
+
+void playlist_release_current(struct Playlist *playlist, size_t resident_bytes)
+{
+    SDL_LockMutex(playlist->lock);
+    struct Entry *entry = &playlist->entries[playlist->current];
+    if (entry->state == ENTRY_READY)
+    {
+        _evict(playlist, entry);
+        entry->state = ENTRY_SHOWN;
+        playlist->shown_bytes = resident_bytes;
+        playlist->bytes += resident_bytes;
+        _enforce_budget(playlist);
+    }
+    SDL_UnlockMutex(playlist->lock);
+}
+
+void playlist_unref_prepared(struct PreparedGIF *prepared)
+{
+    if (SDL_AtomicDecRef(&prepared->references))
+        _free_prepared(prepared);
+}
+
+void playlist_move(struct Playlist *playlist, long offset)
+{
+    SDL_LockMutex(playlist->lock);
+    struct Entry *shown = &playlist->entries[playlist->current];
+    if (shown->state == ENTRY_SHOWN)
+    {
+        shown->state = ENTRY_IDLE;
+        playlist->bytes -= playlist->shown_bytes;
+        playlist->shown_bytes = 0;
+    }
+    long const count = playlist->count;
+    long const index = ((long)playlist->current + offset % count) % count;
+    playlist->current = index < 0? index + count : index;
+    playlist->radius = PREFETCH_RADIUS;
+    for (size_t i = 0; i < playlist->count; ++i)
+    {
+        if (playlist->entries[i].state == ENTRY_READY
+            && _distance(playlist, i) > PREFETCH_RADIUS)
+            _evict(playlist, &playlist->entries[i]);
+    }
+    SDL_CondBroadcast(playlist->wake);
+    SDL_UnlockMutex(playlist->lock);
+}
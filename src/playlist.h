@@ -0,0 +1,135 @@
+/*
+ * playlist.h -- Playlist declarations.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFVIEW_PLAYLIST_H
+#define GIFVIEW_PLAYLIST_H
+
+#include "gif/gif.h"
+
+#include <stddef.h>
+
+#include <SDL2/SDL.h>
+
+
+/**
+ * Most bytes of prefetched files, plus whatever the shown file keeps in
+ * memory (see playlist_release_current), to keep around.
+ */
+#define PLAYLIST_BUDGET_BYTES   ((size_t)512 * 1024 * 1024)
+
+/** A GIF that's been parsed and composited, ready to be shown. */
+struct PreparedGIF
+{
+    /**
+     * The parsed file.  Its graphics are freed once they've been composited
+     * into FRAMES.
+     */
+    GIF gif;
+    /**
+     * The composited frames.  INDEX8 if they fit in 256 colors (see
+     * indexed_from_rgba), otherwise RGBA32.  Frames with the same pixels as an
+     * earlier one share its surface, and a run of the same frame is merged
+     * into one, with the run's total delay.
+     */
+    SDL_Surface **frames;
+    /**
+     * Index of the first frame with the same pixels as each frame, which is
+     * the frame's own index if there's none before it.
+     */
+    size_t *sources;
+    /** Delay of each frame (in 100ths of a second). */
+    size_t *delays;
+    size_t frame_count;
+    /** Bytes of memory used by FRAMES. */
+    size_t bytes;
+    /**
+     * The frame cache file FRAMES point into, or NULL if they don't point
+     * into one.  Frames loaded from the cache only have GIF's size, not its
+     * blocks.
+     */
+    void *mapping;
+    size_t mapping_size;
+    /**
+     * Held by the playlist, and by the frame cache while it writes FRAMES out.
+     * See playlist_unref_prepared.
+     */
+    SDL_atomic_t references;
+};
+
+/**
+ * The files being viewed.  Files near the current one are prepared ahead of
+ * time on background threads.  Defined in playlist.c.
+ */
+struct Playlist;
+
+
+/**
+ * Create a playlist of the COUNT files in PATHS.  Directories are replaced by
+ * the .gif files in them, sorted by name.  Exits if no files are found.
+ * Nothing is prefetched until playlist_start_prefetch is called.
+ */
+struct Playlist *playlist_new(char *const *paths, size_t count);
+
+/**
+ * Start preparing files near the current one in the background.  Called once
+ * the first file is up, so prefetching doesn't hold it back.
+ */
+void playlist_start_prefetch(struct Playlist *playlist);
+
+/** Stop prefetching and free a playlist, along with its prepared files. */
+void playlist_free(struct Playlist *playlist);
+
+/** Number of files in PLAYLIST. */
+size_t playlist_count(struct Playlist const *playlist);
+
+/** Path of the current file. */
+char const *playlist_path(struct Playlist const *playlist);
+
+/** Path of file INDEX. */
+char const *playlist_path_at(struct Playlist const *playlist, size_t index);
+
+/** Index of the current file. */
+size_t playlist_index(struct Playlist const *playlist);
+
+/**
+ * Get the current file, waiting for it to be prepared if it isn't yet.  It
+ * stays valid until the playlist moves to another file.  Returns NULL if the
+ * file couldn't be opened or parsed.
+ */
+struct PreparedGIF const *playlist_current(struct Playlist *playlist);
+
+/**
+ * Free the current file's frames once they've been uploaded, so they aren't
+ * held in memory twice.  The file is prepared again if it's needed again.
+ * RESIDENT_BYTES of memory which the uploaded file still uses are counted
+ * against the prefetch budget until the playlist moves on.
+ */
+void playlist_release_current(struct Playlist *playlist, size_t resident_bytes);
+
+/** Drop a reference to PREPARED, freeing it along with the last one. */
+void playlist_unref_prepared(struct PreparedGIF *prepared);
+
+/**
+ * Move OFFSET files forward (or backward, if negative) through PLAYLIST,
+ * wrapping around at the ends, and start prefetching around the new file.
+ */
+void playlist_move(struct Playlist *playlist, long offset);
+
+
+#endif /* GIFVIEW_PLAYLIST_H */
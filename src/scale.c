@@ -0,0 +1,473 @@
+/*
+ * scale.c -- Software image scaling definitions.
+ *
+ * Bilinear weights are 7-bit fixed point, so every intermediate fits in a
+ * signed 16-bit lane and the SSE2 and scalar paths produce identical output:
+ *
+ *   top    = p00 + (((p01 - p00) * wx) >> 7)
+ *   bottom = p10 + (((p11 - p10) * wx) >> 7)
+ *   out    = top + (((bottom - top) * wy) >> 7)
+ *
+ * Sample positions are pixel-centre aligned.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "scale.h"
+#include "util.h"
+
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+/** Outputs with at least this many pixels are scaled in parallel. */
+static int const SCALE_THREAD_MIN_PIXELS = 512 * 512;
+
+/** Most worker threads to start. */
+#define SCALE_MAX_WORKERS   7
+
+/** Bilinear weight for an exact hit on the second sample. */
+#define WEIGHT_ONE  128
+
+
+/** Everything needed to scale one band of rows. */
+struct ScaleJob
+{
+    uint8_t const *src;
+    size_t src_pitch;
+    int src_width, src_height;
+    SDL_Rect to, clip;
+    uint8_t *dst;
+    size_t dst_pitch;
+    bool simd;
+    bool bilinear;
+    /** For each output column, the (first) source column to sample. */
+    int *columns;
+    /** For each output column, the bilinear weight of the second sample. */
+    int16_t *weights;
+};
+
+/** Worker threads, which scale bands of rows in parallel. */
+static struct
+{
+    bool started;
+    int workers;
+    SDL_Thread *threads[SCALE_MAX_WORKERS];
+    /** Posted once per worker to start a job, or to quit. */
+    SDL_sem *start;
+    /** Posted by each worker when it's done with a job. */
+    SDL_sem *done;
+    bool quit;
+    struct ScaleJob const *job;
+    int bands;
+    /** Next band to be claimed. */
+    int next_band;
+} pool = {.started = false};
+
+
+/** Can SRC pixels be scaled to TO pixels by a whole-number factor? */
+bool _is_whole_ratio(int src, int to)
+{
+    return to % src == 0 || src % to == 0;
+}
+
+/**
+ * Get the source sample for output position I (relative to the start of the
+ * scaled image) along an axis scaled from SRC to TO pixels.  For bilinear
+ * sampling, *WEIGHT is set to the weight of sample+1.
+ */
+int _sample(int i, int src, int to, bool bilinear, int16_t *weight)
+{
+    if (!bilinear)
+    {
+        *weight = 0;
+        return (int64_t)i * src / to;
+    }
+    /* Pixel centres, in 128ths of a source pixel. */
+    int64_t position = (
+        (2 * (int64_t)i + 1) * src * WEIGHT_ONE / (2 * (int64_t)to)
+        - WEIGHT_ONE / 2);
+    if (position < 0)
+        position = 0;
+    int sample = position / WEIGHT_ONE;
+    *weight = position % WEIGHT_ONE;
+    /* Never read past the last pixel; sample the pair ending at it. */
+    if (sample >= src - 1)
+    {
+        sample = src - 2;
+        *weight = WEIGHT_ONE;
+    }
+    return sample;
+}
+
+/** Bilinearly sample the 2x2 block at P0 (and P1, the row below). */
+void _bilinear_pixel_scalar(
+    uint8_t const *p0, uint8_t const *p1, int wx, int wy, uint8_t *out)
+{
+    for (int c = 0; c < 4; ++c)
+    {
+        int const top = p0[c] + (((p0[c + 4] - p0[c]) * wx) >> 7);
+        int const bottom = p1[c] + (((p1[c + 4] - p1[c]) * wx) >> 7);
+        out[c] = top + (((bottom - top) * wy) >> 7);
+    }
+}
+
+/** Scale output columns [X0, clip width) of a row, sampling ROW0 and ROW1. */
+void _row_scalar(
+    struct ScaleJob const *job, uint8_t const *row0, uint8_t const *row1,
+    int wy, int x0, uint8_t *out)
+{
+    if (job->bilinear)
+    {
+        for (int x = x0; x < job->clip.w; ++x)
+        {
+            _bilinear_pixel_scalar(
+                row0 + 4 * job->columns[x], row1 + 4 * job->columns[x],
+                job->weights[x], wy, out + 4 * x);
+        }
+    }
+    else
+    {
+        for (int x = x0; x < job->clip.w; ++x)
+            memcpy(out + 4 * x, row0 + 4 * job->columns[x], 4);
+    }
+}
+
+
+#if __SSE2__
+/** Bilinear version of _row_sse2. */
+int _bilinear_row_sse2(
+    struct ScaleJob const *job, uint8_t const *row0, uint8_t const *row1,
+    int wy, uint8_t *out)
+{
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const vwy = _mm_set1_epi16(wy);
+    int x = 0;
+    for (; x < job->clip.w; ++x)
+    {
+        int const column = job->columns[x];
+        /* [p00 p01] and [p10 p11], one 16-bit lane per channel. */
+        __m128i const a = _mm_unpacklo_epi8(
+            _mm_loadl_epi64((__m128i const *)(row0 + 4 * column)), zero);
+        __m128i const b = _mm_unpacklo_epi8(
+            _mm_loadl_epi64((__m128i const *)(row1 + 4 * column)), zero);
+        /* Blend [p00 p10] towards [p01 p11] to get [top bottom]. */
+        __m128i const left = _mm_unpacklo_epi64(a, b);
+        __m128i const right = _mm_unpackhi_epi64(a, b);
+        __m128i const h = _mm_add_epi16(left, _mm_srai_epi16(
+            _mm_mullo_epi16(
+                _mm_sub_epi16(right, left), _mm_set1_epi16(job->weights[x])),
+            7));
+        __m128i const v = _mm_add_epi16(h, _mm_srai_epi16(
+            _mm_mullo_epi16(_mm_sub_epi16(_mm_srli_si128(h, 8), h), vwy), 7));
+        int32_t const pixel = _mm_cvtsi128_si32(_mm_packus_epi16(v, v));
+        memcpy(out + 4 * x, &pixel, 4);
+    }
+    return x;
+}
+
+/**
+ * Nearest-neighbour version of _row_sse2, for whole-number upscales by K.
+ * Each source pixel is splatted over its run of K outputs, 4 at a time.
+ */
+int _upscale_row_sse2(
+    struct ScaleJob const *job, uint8_t const *row, int k, uint8_t *out)
+{
+    int const width = job->clip.w;
+    /* Finish any run cut off by the clip edge the slow way. */
+    int x = 0;
+    for (; x < width && (job->clip.x - job->to.x + x) % k != 0; ++x)
+        memcpy(out + 4 * x, row + 4 * job->columns[x], 4);
+
+    int const span = k < 4? 4 : k;
+    for (; x + span <= width; x += k)
+    {
+        int32_t value;
+        memcpy(&value, row + 4 * job->columns[x], 4);
+        __m128i const pixel = _mm_set1_epi32(value);
+        uint8_t *const run = out + 4 * x;
+        int j = 0;
+        for (; j + 4 <= k; j += 4)
+            _mm_storeu_si128((__m128i *)(run + 4 * j), pixel);
+        /* Runs that aren't a multiple of 4 get an overlapping store; for runs
+         * shorter than 4 that spills into the next run, which is rewritten
+         * straight after. */
+        if (j < k)
+            _mm_storeu_si128((__m128i *)(run + 4 * (k < 4? 0 : k - 4)), pixel);
+    }
+    return x;
+}
+
+/**
+ * Nearest-neighbour version of _row_sse2, for whole-number downscales by K,
+ * which take every Kth source pixel.  Halving picks them out of two loads with
+ * a shuffle; larger factors load just the 4 pixels needed and interleave them.
+ */
+int _scale_downscale_row_sse2(
+    struct ScaleJob const *job, uint8_t const *row, int k, uint8_t *out)
+{
+    /* Source pixels past the first that 4 outputs read. */
+    int const reach = k == 2? 7 : 3 * k;
+    int x = 0;
+    for (; x + 4 <= job->clip.w; x += 4)
+    {
+        int const column = job->columns[x];
+        if (column + reach >= job->src_width)
+            break;
+        uint8_t const *const p = row + 4 * column;
+        __m128i pixels;
+        if (k == 2)
+        {
+            __m128 const a = _mm_loadu_ps((float const *)p);
+            __m128 const b = _mm_loadu_ps((float const *)(p + 16));
+            pixels = _mm_castps_si128(
+                _mm_shuffle_ps(a, b, _MM_SHUFFLE(2, 0, 2, 0)));
+        }
+        else
+        {
+            int32_t v[4];
+            for (int j = 0; j < 4; ++j)
+                memcpy(&v[j], p + 4 * j * k, 4);
+            __m128i const lo = _mm_unpacklo_epi32(
+                _mm_cvtsi32_si128(v[0]), _mm_cvtsi32_si128(v[1]));
+            __m128i const hi = _mm_unpacklo_epi32(
+                _mm_cvtsi32_si128(v[2]), _mm_cvtsi32_si128(v[3]));
+            pixels = _mm_unpacklo_epi64(lo, hi);
+        }
+        _mm_storeu_si128((__m128i *)(out + 4 * x), pixels);
+    }
+    return x;
+}
+
+/**
+ * Scale as much of a row as the SIMD kernels handle, returning the number of
+ * output columns done.
+ */
+int _row_sse2(
+    struct ScaleJob const *job, uint8_t const *row0, uint8_t const *row1,
+    int wy, uint8_t *out)
+{
+    if (job->bilinear)
+        return _bilinear_row_sse2(job, row0, row1, wy, out);
+    else if (job->to.w % job->src_width == 0 && job->to.w > job->src_width)
+        return _upscale_row_sse2(
+            job, row0, job->to.w / job->src_width, out);
+    else if (job->src_width % job->to.w == 0 && job->src_width > job->to.w)
+        return _scale_downscale_row_sse2(
+            job, row0, job->src_width / job->to.w, out);
+    return 0;
+}
+#endif
+
+
+/** Scale rows [FIRST, LAST) of JOB's clip. */
+void _scale_band(struct ScaleJob const *job, int first, int last)
+{
+    int previous_row = -1;
+    for (int y = first; y < last; ++y)
+    {
+        uint8_t *const out = job->dst + (size_t)y * job->dst_pitch;
+        int16_t wy;
+        int const row = _sample(
+            job->clip.y - job->to.y + y, job->src_height, job->to.h,
+            job->bilinear, &wy);
+
+        /* Upscaled rows repeat, so copy the one we just did. */
+        if (!job->bilinear && row == previous_row)
+        {
+            memcpy(out, out - job->dst_pitch, (size_t)job->clip.w * 4);
+            continue;
+        }
+        previous_row = row;
+
+        uint8_t const *const row0 = job->src + (size_t)row * job->src_pitch;
+        uint8_t const *const row1 = (
+            job->bilinear? row0 + job->src_pitch : row0);
+        int done = 0;
+#if __SSE2__
+        if (job->simd)
+            done = _row_sse2(job, row0, row1, wy, out);
+#endif
+        _row_scalar(job, row0, row1, wy, done, out);
+    }
+}
+
+/** Worker thread body: scale bands until told to quit. */
+int _worker(void *data)
+{
+    (void)data;
+    for (;;)
+    {
+        SDL_SemWait(pool.start);
+        if (pool.quit)
+            return 0;
+        int band;
+        while (
+            (band = __atomic_fetch_add(&pool.next_band, 1, __ATOMIC_ACQ_REL))
+            < pool.bands)
+        {
+            struct ScaleJob const *const job = pool.job;
+            _scale_band(
+                job,
+                (int64_t)job->clip.h * band / pool.bands,
+                (int64_t)job->clip.h * (band + 1) / pool.bands);
+        }
+        SDL_SemPost(pool.done);
+    }
+}
+
+/** Start the worker threads, if the machine has cores to spare. */
+void _start_pool(void)
+{
+    pool.started = true;
+    pool.quit = false;
+    pool.workers = SDL_GetCPUCount() - 1;
+    if (pool.workers > SCALE_MAX_WORKERS)
+        pool.workers = SCALE_MAX_WORKERS;
+    if (pool.workers <= 0)
+    {
+        pool.workers = 0;
+        return;
+    }
+    pool.start = SDL_CreateSemaphore(0);
+    pool.done = SDL_CreateSemaphore(0);
+    for (int i = 0; i < pool.workers; ++i)
+    {
+        pool.threads[i] = SDL_CreateThread(_worker, "scale", NULL);
+        if (pool.threads[i] == NULL)
+        {
+            warn("SDL_CreateThread -- %s\n", SDL_GetError());
+            pool.workers = i;
+            break;
+        }
+    }
+}
+
+/** Scale JOB, on the worker threads if it's big enough to be worth it. */
+void _run(struct ScaleJob *job, bool threaded)
+{
+    int const src_w = job->src_width, src_h = job->src_height;
+    job->bilinear = (
+        src_w >= 2 && src_h >= 2
+        && !(_is_whole_ratio(src_w, job->to.w)
+            && _is_whole_ratio(src_h, job->to.h)));
+    job->columns = malloc(job->clip.w * sizeof(*job->columns));
+    job->weights = malloc(job->clip.w * sizeof(*job->weights));
+    for (int x = 0; x < job->clip.w; ++x)
+    {
+        job->columns[x] = _sample(
+            job->clip.x - job->to.x + x, src_w, job->to.w, job->bilinear,
+            &job->weights[x]);
+    }
+
+    if (threaded && !pool.started)
+        _start_pool();
+    if (threaded
+        && pool.workers > 0
+        && (int64_t)job->clip.w * job->clip.h >= SCALE_THREAD_MIN_PIXELS)
+    {
+        pool.job = job;
+        pool.bands = pool.workers + 1;
+        __atomic_store_n(&pool.next_band, 0, __ATOMIC_RELEASE);
+        for (int i = 0; i < pool.workers; ++i)
+            SDL_SemPost(pool.start);
+        int band;
+        while (
+            (band = __atomic_fetch_add(&pool.next_band, 1, __ATOMIC_ACQ_REL))
+            < pool.bands)
+        {
+            _scale_band(
+                job,
+                (int64_t)job->clip.h * band / pool.bands,
+                (int64_t)job->clip.h * (band + 1) / pool.bands);
+        }
+        for (int i = 0; i < pool.workers; ++i)
+            SDL_SemWait(pool.done);
+    }
+    else
+        _scale_band(job, 0, job->clip.h);
+
+    free(job->columns);
+    free(job->weights);
+}
+
+
+void scale_image(
+    uint8_t const *restrict src, size_t src_pitch,
+    int src_width, int src_height,
+    SDL_Rect const *to, SDL_Rect const *clip,
+    uint8_t *restrict dst, size_t dst_pitch)
+{
+    if (src_width <= 0 || src_height <= 0 || clip->w <= 0 || clip->h <= 0)
+        return;
+    struct ScaleJob job = {
+        .src = src,
+        .src_pitch = src_pitch,
+        .src_width = src_width,
+        .src_height = src_height,
+        .to = *to,
+        .clip = *clip,
+        .dst = dst,
+        .dst_pitch = dst_pitch,
+        .simd = true,
+    };
+    _run(&job, true);
+}
+
+void scale_image_scalar(
+    uint8_t const *restrict src, size_t src_pitch,
+    int src_width, int src_height,
+    SDL_Rect const *to, SDL_Rect const *clip,
+    uint8_t *restrict dst, size_t dst_pitch)
+{
+    if (src_width <= 0 || src_height <= 0 || clip->w <= 0 || clip->h <= 0)
+        return;
+    struct ScaleJob job = {
+        .src = src,
+        .src_pitch = src_pitch,
+        .src_width = src_width,
+        .src_height = src_height,
+        .to = *to,
+        .clip = *clip,
+        .dst = dst,
+        .dst_pitch = dst_pitch,
+        .simd = false,
+    };
+    _run(&job, false);
+}
+
+void scale_quit(void)
+{
+    if (!pool.started)
+        return;
+    pool.quit = true;
+    for (int i = 0; i < pool.workers; ++i)
+        SDL_SemPost(pool.start);
+    for (int i = 0; i < pool.workers; ++i)
+        SDL_WaitThread(pool.threads[i], NULL);
+    if (pool.start)
+        SDL_DestroySemaphore(pool.start);
+    if (pool.done)
+        SDL_DestroySemaphore(pool.done);
+    pool.start = NULL;
+    pool.done = NULL;
+    pool.started = false;
+}
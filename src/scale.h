@@ -0,0 +1,57 @@
+/*
+ * scale.h -- Software image scaling declarations.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFVIEW_SCALE_H
+#define GIFVIEW_SCALE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <SDL2/SDL.h>
+
+
+/**
+ * Scale the SRC_WIDTH x SRC_HEIGHT image SRC, which has 32-bit pixels and rows
+ * SRC_PITCH bytes apart, to fill TO.  Only the part of the result inside CLIP
+ * (which must lie within TO) is written.  It goes to DST, which starts at
+ * CLIP's top left corner and has rows DST_PITCH bytes apart.
+ *
+ * Whole-number scale factors (eg. 3x or 1/2x) use nearest-neighbour sampling,
+ * and anything else is bilinear.  Large outputs are split into bands of rows
+ * which are scaled in parallel.  Uses SSE2 where available, which gives the
+ * same output as scale_image_scalar.
+ */
+void scale_image(
+    uint8_t const *restrict src, size_t src_pitch,
+    int src_width, int src_height,
+    SDL_Rect const *to, SDL_Rect const *clip,
+    uint8_t *restrict dst, size_t dst_pitch);
+
+/** Portable, single-threaded version of scale_image. */
+void scale_image_scalar(
+    uint8_t const *restrict src, size_t src_pitch,
+    int src_width, int src_height,
+    SDL_Rect const *to, SDL_Rect const *clip,
+    uint8_t *restrict dst, size_t dst_pitch);
+
+/** Stop scale_image's worker threads, if any were started. */
+void scale_quit(void);
+
+
+#endif /* GIFVIEW_SCALE_H */
@@ -21,9 +21,15 @@
 #include "config.h"
 #include "font.h"
 #include "util.h"
+#include "scale.h"
 #include "gif/gif.h"
+#include "stats/stats.h"
+#include "stats/trace.h"
 
 #include <math.h>
+#include <stdio.h>
+
+#include <SDL_ttf.h>
 
 
 /** Size (in pixels) of background grid squares. */
@@ -33,6 +39,18 @@ static int const BACKGROUND_GRID_SIZE = 8;
 static uint8_t const BACKGROUND_GRID_COLOR_A[3] = {0x64, 0x64, 0x64};
 /** Color for odd-numbered background grid squares. */
 static uint8_t const BACKGROUND_GRID_COLOR_B[3] = {0x90, 0x90, 0x90};
+/**
+ * Size (in pixels) of the background texture, which is tiled to fill the
+ * window.  Must be a multiple of twice the grid size so the pattern lines up
+ * across tiles.
+ */
+static int const BACKGROUND_TILE_SIZE = 16 * BACKGROUND_GRID_SIZE;
+
+/** Refresh rate to assume when the display doesn't report one. */
+static int const FALLBACK_REFRESH_RATE = 60;
+
+/** Minimum time between updates of the frame pacing overlay text. */
+static double const PACING_TEXT_INTERVAL_SECONDS = 0.25;
 
 
 /** Get transformed rect for the current frame. */
@@ -49,11 +67,90 @@ SDL_Rect _get_current_frame_rect(struct App const *app)
     return rect;
 }
 
-/** Generate the background grid texture. */
+/** Destroy a UI TEXTURE (if it isn't NULL), updating memory accounting. */
+void _destroy_ui_texture(SDL_Texture *texture)
+{
+    if (!texture)
+        return;
+    int w = 0, h = 0;
+    SDL_QueryTexture(texture, NULL, NULL, &w, &h);
+    stats_memory_remove(STATS_MEMORY_UI_TEXTURES, (size_t)w * h * 4);
+    SDL_DestroyTexture(texture);
+}
+
+/** Destroy the software scaler's target texture, if there is one. */
+void _destroy_frame_target(struct App const *app)
+{
+    if (!app->frame_target)
+        return;
+    stats_memory_remove(
+        STATS_MEMORY_FRAME_TEXTURES,
+        (size_t)app->frame_target_width * app->frame_target_height * 4);
+    SDL_DestroyTexture(app->frame_target);
+}
+
+/**
+ * Draw IMG stretched to POSITION with the software scaler.  Only the visible
+ * part is scaled, into a streaming texture which is then copied 1:1, since
+ * the software renderer is fast at that and slow at stretching.
+ */
+void _draw_frame_software(
+    struct App *app, struct SDLGraphic const *img, SDL_Rect const *position)
+{
+    SDL_Rect const window = {0, 0, app->width, app->height};
+    SDL_Rect clip;
+    if (!SDL_IntersectRect(position, &window, &clip))
+        return;
+
+    if (app->frame_target == NULL
+        || app->frame_target_width != app->width
+        || app->frame_target_height != app->height)
+    {
+        _destroy_frame_target(app);
+        app->frame_target = SDL_CreateTexture(
+            app->renderer, SDL_PIXELFORMAT_ARGB8888,
+            SDL_TEXTUREACCESS_STREAMING, app->width, app->height);
+        if (app->frame_target == NULL)
+        {
+            error("SDL_CreateTexture -- %s\n", SDL_GetError());
+            return;
+        }
+        SDL_SetTextureBlendMode(app->frame_target, SDL_BLENDMODE_BLEND);
+        app->frame_target_width = app->width;
+        app->frame_target_height = app->height;
+        stats_count(STATS_COUNTER_TEXTURES_CREATED, 1);
+        stats_memory_add(
+            STATS_MEMORY_FRAME_TEXTURES,
+            (size_t)app->width * app->height * 4);
+    }
+
+    uint64_t const start = stats_now();
+    void *pixels;
+    int pitch;
+    if (SDL_LockTexture(app->frame_target, &clip, &pixels, &pitch) != 0)
+    {
+        error("SDL_LockTexture -- %s\n", SDL_GetError());
+        return;
+    }
+    scale_image(
+        img->surface->pixels, img->surface->pitch, img->width, img->height,
+        position, &clip, pixels, pitch);
+    SDL_UnlockTexture(app->frame_target);
+    trace_span(
+        "software scale", start, app->frame_index,
+        (long long)clip.w * clip.h * 4);
+    SDL_RenderCopy(app->renderer, app->frame_target, &clip, &clip);
+}
+
+/**
+ * Generate the background grid texture.  This is a single tile of the grid,
+ * so it doesn't depend on the window size.
+ */
 void _generate_bg_grid(struct App *app)
 {
     SDL_Surface *grid_surf = SDL_CreateRGBSurfaceWithFormat(
-        0, app->width, app->height, 32, SDL_PIXELFORMAT_RGBA32);
+        0, BACKGROUND_TILE_SIZE, BACKGROUND_TILE_SIZE, 32,
+        SDL_PIXELFORMAT_RGBA32);
 
     Uint32 const grid_color_a = SDL_MapRGB(
         grid_surf->format,
@@ -67,10 +164,13 @@ void _generate_bg_grid(struct App *app)
         BACKGROUND_GRID_COLOR_B[2]);
 
     SDL_FillRect(grid_surf, NULL, grid_color_a);
-    for (int y = 0; y < (app->height/BACKGROUND_GRID_SIZE+1); ++y)
+    for (int y = 0; y < BACKGROUND_TILE_SIZE / BACKGROUND_GRID_SIZE; ++y)
     {
         int const initial_x = (y % 2 == 1)? 0 : BACKGROUND_GRID_SIZE;
-        for (int x = initial_x; x < app->width; x += BACKGROUND_GRID_SIZE*2)
+        for (
+            int x = initial_x;
+            x < BACKGROUND_TILE_SIZE;
+            x += BACKGROUND_GRID_SIZE * 2)
         {
             SDL_Rect const rect = {
                 .h = BACKGROUND_GRID_SIZE,
@@ -81,33 +181,179 @@ void _generate_bg_grid(struct App *app)
             SDL_FillRect(grid_surf, &rect, grid_color_b);
         }
     }
-    SDL_DestroyTexture(app->bg_texture);
+    _destroy_ui_texture(app->bg_texture);
     app->bg_texture = SDL_CreateTextureFromSurface(app->renderer, grid_surf);
+    stats_memory_add(
+        STATS_MEMORY_UI_TEXTURES, (size_t)grid_surf->w * grid_surf->h * 4);
+    stats_count(STATS_COUNTER_TEXTURES_CREATED, 1);
+    stats_count(
+        STATS_COUNTER_TEXTURE_BYTES, (uint64_t)grid_surf->w * grid_surf->h * 4);
     SDL_FreeSurface(grid_surf);
 }
 
 /** Returns true if the app is on the final frame, false otherwise. */
 bool _is_app_on_final_frame(struct App const *app)
 {
-    return app->current_frame->next == app->images;
+    return app->frame_index + 1 == app->frame_count;
+}
+
+/** Get the playback position (in 100ths of a second) at time NOW. */
+double _playback_position(struct App const *app, uint64_t now)
+{
+    double const length = app->frame_starts[app->frame_count];
+    double position = app->anchor_position;
+    if (viewer_should_timer_increment(&app->view))
+        position += (
+            (double)(now - app->anchor_time) * 100.0
+            / SDL_GetPerformanceFrequency() * app->view.playback_speed);
+    if (length <= 0)
+        return 0;
+    else if (app->view.looping)
+    {
+        position = fmod(position, length);
+        return position < 0? position + length : position;
+    }
+    else if (position < 0)
+        return 0;
+    else
+        return position < length? position : length;
+}
+
+/** Get the index of the frame showing at POSITION. */
+size_t _frame_at(struct App const *app, double position)
+{
+    /* Find the last frame starting at or before POSITION. */
+    size_t lo = 0, hi = app->frame_count;
+    while (hi - lo > 1)
+    {
+        size_t const mid = lo + (hi - lo) / 2;
+        if (app->frame_starts[mid] <= position)
+            lo = mid;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+/** Restart the playback clock from POSITION. */
+void _anchor_playback(struct App *app, double position)
+{
+    app->anchor_position = position;
+    app->anchor_time = stats_now();
+}
+
+/** Show frame INDEX, which should have been shown at SCHEDULED. */
+void _set_frame(struct App *app, size_t index, uint64_t scheduled)
+{
+    app->frame_index = index;
+    app->current_frame = app->frames[index];
+    app->frame_scheduled = scheduled;
+    app->frame_presented = false;
+}
+
+/** Draw app overlay text, each line under the last. */
+void _draw_overlay_lines(struct App const *app)
+{
+    int y = 0;
+    textrenderer_draw(app->paused_text, 0, y);
+    y += app->paused_text->rect.h;
+    textrenderer_draw(app->looping_text, 0, y);
+    y += app->looping_text->rect.h;
+    textrenderer_draw(app->playback_speed_text, 0, y);
+    y += app->playback_speed_text->rect.h;
+    textrenderer_draw(app->pacing_text, 0, y);
+}
+
+/** Have the overlay text redrawn before it's next shown. */
+void _on_overlay_changed(struct App *app)
+{
+    app->overlay_dirty = true;
+}
+
+/**
+ * Redraw the overlay text into overlay_texture, (re)creating the texture if
+ * the text's size changed.
+ */
+void _redraw_overlay(struct App *app)
+{
+    app->overlay_dirty = false;
+    if (!app->can_cache_overlay)
+        return;
+
+    struct TextRenderer const *const lines[] = {
+        app->paused_text, app->looping_text, app->playback_speed_text,
+        app->pacing_text,
+    };
+    int width = 0, height = 0;
+    for (size_t i = 0; i < sizeof(lines) / sizeof(*lines); ++i)
+    {
+        if (lines[i]->rect.w > width)
+            width = lines[i]->rect.w;
+        height += lines[i]->rect.h;
+    }
+    if (width == 0 || height == 0)
+        return;
+
+    int w = 0, h = 0;
+    if (app->overlay_texture)
+        SDL_QueryTexture(app->overlay_texture, NULL, NULL, &w, &h);
+    if (w != width || h != height)
+    {
+        _destroy_ui_texture(app->overlay_texture);
+        app->overlay_texture = SDL_CreateTexture(
+            app->renderer, SDL_PIXELFORMAT_ARGB8888,
+            SDL_TEXTUREACCESS_TARGET, width, height);
+        if (app->overlay_texture == NULL)
+        {
+            error("SDL_CreateTexture -- %s\n", SDL_GetError());
+            app->can_cache_overlay = false;
+            return;
+        }
+        SDL_SetTextureBlendMode(app->overlay_texture, SDL_BLENDMODE_BLEND);
+        stats_memory_add(STATS_MEMORY_UI_TEXTURES, (size_t)width * height * 4);
+        stats_count(STATS_COUNTER_TEXTURES_CREATED, 1);
+        stats_count(STATS_COUNTER_TEXTURE_BYTES, (uint64_t)width * height * 4);
+    }
+
+    SDL_Texture *const target = SDL_GetRenderTarget(app->renderer);
+    SDL_SetRenderTarget(app->renderer, app->overlay_texture);
+    SDL_SetRenderDrawColor(app->renderer, 0x00, 0x00, 0x00, 0x00);
+    SDL_RenderClear(app->renderer);
+    _draw_overlay_lines(app);
+    SDL_SetRenderTarget(app->renderer, target);
 }
 
-/** Draw app overlay text. */
-void _draw_text_overlay(struct App const *app)
+/**
+ * Draw app overlay text.  It's drawn from overlay_texture, which is only
+ * redrawn when the text changes.
+ */
+void _draw_text_overlay(struct App *app)
 {
-    SDL_Rect moved_looping_rect = app->looping_text->rect;
-    moved_looping_rect.y += app->paused_text->rect.h;
-    SDL_Rect moved_playback_speed_rect = app->playback_speed_text->rect;
-    moved_playback_speed_rect.y += moved_looping_rect.y + moved_looping_rect.h;
-    SDL_RenderCopy(
-        app->renderer, app->paused_text->texture,
-        NULL, &app->paused_text->rect);
-    SDL_RenderCopy(
-        app->renderer, app->looping_text->texture,
-        NULL, &moved_looping_rect);
-    SDL_RenderCopy(
-        app->renderer, app->playback_speed_text->texture,
-        NULL, &moved_playback_speed_rect);
+    if (app->overlay_dirty)
+        _redraw_overlay(app);
+    if (app->overlay_texture && app->can_cache_overlay)
+    {
+        SDL_Rect rect = {.x=0, .y=0};
+        SDL_QueryTexture(app->overlay_texture, NULL, NULL, &rect.w, &rect.h);
+        SDL_RenderCopy(app->renderer, app->overlay_texture, NULL, &rect);
+    }
+    else
+        _draw_overlay_lines(app);
+}
+
+/** Update the frame pacing overlay text. */
+void _update_pacing_text(struct App *app)
+{
+    struct StatsPacing const pacing = stats_pacing();
+    char str[TEXTRENDERER_MAX_LENGTH];
+    snprintf(
+        str, sizeof(str),
+        "Late %.1f ms (jitter %.1f)  Dropped %llu  Duplicated %llu",
+        pacing.mean_late_ms, pacing.jitter_ms,
+        (unsigned long long)pacing.dropped,
+        (unsigned long long)pacing.duplicated);
+    textrenderer_set_text(app->pacing_text, str);
+    app->pacing_text_updated = stats_now();
 }
 
 
@@ -129,41 +375,129 @@ void menu_cb_toggle_looping(void *data)
     app_set_looping(app, !app->view.looping);
 }
 
-struct App *app_new(GIF const *gif, char const *path)
+/** Set the window title to show PATH. */
+void _set_window_title(struct App *app, char const *path)
 {
-    struct App *app = malloc(sizeof(struct App));
-
     char *windowtitle = NULL;
     sprintfa(&windowtitle, "%s - %s", GIFVIEW_PROGRAM_NAME, path);
+    SDL_SetWindowTitle(app->window, windowtitle);
+    free(windowtitle);
+}
+
+/** Upload the frames of GIF and start playing them from the beginning. */
+void _load_frames(struct App *app, struct PreparedGIF const *gif)
+{
+    app->image_width = gif->gif.width;
+    app->image_height = gif->gif.height;
+    app->images = graphiclist_new_from_frames(
+        app->renderer, gif->frames, gif->sources, gif->delays,
+        gif->frame_count, app->software);
+    app->frame_count = 0;
+    GraphicList curr = app->images;
+    do
+    {
+        app->frame_count++;
+        curr = curr->next;
+    } while (curr != app->images);
+    app->frames = malloc(app->frame_count * sizeof(*app->frames));
+    app->frame_starts = malloc(
+        (app->frame_count + 1) * sizeof(*app->frame_starts));
+    app->frame_starts[0] = 0;
+    for (size_t i = 0; i < app->frame_count; ++i, curr = curr->next)
+    {
+        struct SDLGraphic const *const img = curr->data;
+        app->frames[i] = curr;
+        app->frame_starts[i + 1] = app->frame_starts[i] + img->delay;
+    }
+    _set_frame(app, 0, stats_now());
+    _anchor_playback(app, 0);
+}
+
+/** Free the frames uploaded by _load_frames. */
+void _free_frames(struct App const *app)
+{
+    graphiclist_free(app->images);
+    free(app->frames);
+    free(app->frame_starts);
+}
+
+
+struct App *app_new(
+    struct PreparedGIF const *gif, char const *path, bool vsync,
+    bool software)
+{
+    struct App *app = malloc(sizeof(struct App));
+
+    uint64_t const window_start = stats_now();
     app->window = SDL_CreateWindow(
-        windowtitle,
+        GIFVIEW_PROGRAM_NAME,
         SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
-        gif->width, gif->height,
+        gif->gif.width, gif->gif.height,
         SDL_WINDOW_RESIZABLE);
-    free(windowtitle);
     if (app->window == NULL)
         fatal("Failed to create window: %s\n", SDL_GetError());
+    _set_window_title(app, path);
 
+    Uint32 const renderer_flags = (
+        software? SDL_RENDERER_SOFTWARE : SDL_RENDERER_ACCELERATED);
     app->renderer = SDL_CreateRenderer(
-        app->window, -1, SDL_RENDERER_ACCELERATED);
+        app->window, -1,
+        renderer_flags | (vsync? SDL_RENDERER_PRESENTVSYNC : 0));
+    if (app->renderer == NULL && vsync)
+        app->renderer = SDL_CreateRenderer(app->window, -1, renderer_flags);
     if (app->renderer == NULL)
         fatal("Failed to create renderer -- %s\n", SDL_GetError());
 
-    app->bg_texture = NULL;
+    /* Software and offscreen renderers can't wait for the vertical blank, in
+     * which case we just present as soon as frames are due. */
+    SDL_RendererInfo info;
+    app->vsync = (
+        vsync
+        && SDL_GetRendererInfo(app->renderer, &info) == 0
+        && (info.flags & SDL_RENDERER_PRESENTVSYNC));
+    if (vsync && !app->vsync)
+        warn("vsync unavailable, presenting frames when they're due\n");
+    SDL_DisplayMode mode;
+    int refresh_rate = FALLBACK_REFRESH_RATE;
+    if (SDL_GetWindowDisplayMode(app->window, &mode) == 0
+        && mode.refresh_rate > 0)
+        refresh_rate = mode.refresh_rate;
+    app->refresh_period = SDL_GetPerformanceFrequency() / refresh_rate;
+    app->last_present = stats_now();
+    stats_stage_end(STATS_STAGE_WINDOW_CREATE, window_start);
 
-    app->paused_text = textrenderer_new(DEFAULT_FONT_PATH, DEFAULT_FONT_SIZE);
-    if (app->paused_text->font == NULL)
-        error("Failed to load font: %s\n", TTF_GetError());
-    app->looping_text = textrenderer_new(DEFAULT_FONT_PATH, DEFAULT_FONT_SIZE);
-    if (app->looping_text->font == NULL)
+    app->bg_texture = NULL;
+    app->software = software;
+    app->frame_target = NULL;
+    app->frame_target_width = 0;
+    app->frame_target_height = 0;
+
+    struct GlyphAtlas *atlas = glyphatlas_get(
+        app->renderer, DEFAULT_FONT_PATH, DEFAULT_FONT_SIZE);
+    if (atlas == NULL)
         error("Failed to load font: %s\n", TTF_GetError());
-    app->playback_speed_text = textrenderer_new(DEFAULT_FONT_PATH, DEFAULT_FONT_SIZE);
-    if (app->playback_speed_text->font == NULL)
-        SDL_Log("Failed to load font: %s\n", TTF_GetError());
-    textrenderer_set_text(app->paused_text, app->renderer, "Paused ?");
-    textrenderer_set_text(app->looping_text, app->renderer, "Looping ?");
-    textrenderer_set_text(
-        app->playback_speed_text, app->renderer, "Playback Speed ?");
+    app->paused_text = textrenderer_new(atlas);
+    app->looping_text = textrenderer_new(atlas);
+    app->playback_speed_text = textrenderer_new(atlas);
+    app->pacing_text = textrenderer_new(atlas);
+    textrenderer_set_text(app->paused_text, "Paused ?");
+    textrenderer_set_text(app->looping_text, "Looping ?");
+    textrenderer_set_text(app->playback_speed_text, "Playback Speed ?");
+    app->overlay_texture = NULL;
+    app->overlay_dirty = true;
+    app->can_cache_overlay = (
+        SDL_GetRendererInfo(app->renderer, &info) == 0
+        && (info.flags & SDL_RENDERER_TARGETTEXTURE));
+    signal_connect(
+        app->paused_text->signal_changed, bind(_on_overlay_changed, app));
+    signal_connect(
+        app->looping_text->signal_changed, bind(_on_overlay_changed, app));
+    signal_connect(
+        app->playback_speed_text->signal_changed,
+        bind(_on_overlay_changed, app));
+    signal_connect(
+        app->pacing_text->signal_changed, bind(_on_overlay_changed, app));
+    _update_pacing_text(app);
 
     SDL_GetWindowSize(app->window, &app->width, &app->height);
 
@@ -178,17 +512,15 @@ struct App *app_new(GIF const *gif, char const *path)
     app->view.transform.offset_y = 0;
     app->view.transform.zoom = 1.0;
 
-    app->images = graphiclist_new_from_gif(app->renderer, *gif);
-    app->current_frame = app->images;
-    app->timer = 0;
-    app->full_time = 0;
-    for (GraphicList curr = app->images; curr->next != app->images; curr = curr->next)
-    {
-        struct SDLGraphic const *const img = curr->data;
-        app->full_time += img->delay;
-    }
+    app->view.paused = false;
+    app->view.looping = true;
+    app->view.playback_speed = 1.0;
+
+    _load_frames(app, gif);
     app->state_text_visible = false;
     app->is_fullscreen = false;
+    app->montage = NULL;
+    app->montage_visible = false;
 
     app->menu = menu_new(app->renderer);
     app->pause_btn = menubutton_new(
@@ -214,16 +546,33 @@ struct App *app_new(GIF const *gif, char const *path)
 
 void app_free(struct App const *app)
 {
-    graphiclist_free(app->images);
+    _free_frames(app);
     textrenderer_free(app->paused_text);
     textrenderer_free(app->looping_text);
     textrenderer_free(app->playback_speed_text);
+    textrenderer_free(app->pacing_text);
     menu_free(app->menu);
-    SDL_DestroyTexture(app->bg_texture);
+    if (app->montage)
+        montage_free(app->montage);
+    glyphatlas_quit();
+    _destroy_ui_texture(app->bg_texture);
+    _destroy_ui_texture(app->overlay_texture);
+    _destroy_frame_target(app);
+    scale_quit();
     SDL_DestroyRenderer(app->renderer);
     SDL_DestroyWindow(app->window);
 }
 
+void app_load(
+    struct App *app, struct PreparedGIF const *gif, char const *path)
+{
+    _free_frames(app);
+    _load_frames(app, gif);
+    _set_window_title(app, path);
+    viewer_zoom_reset(&app->view);
+    viewer_transform_reset(&app->view);
+}
+
 void app_clear_screen(struct App *app)
 {
     if (app->is_fullscreen)
@@ -232,56 +581,149 @@ void app_clear_screen(struct App *app)
         SDL_RenderFillRect(app->renderer, NULL);
     }
     else
-        SDL_RenderCopy(app->renderer, app->bg_texture, NULL, NULL);
+    {
+        SDL_Rect tile = {
+            .x = 0,
+            .y = 0,
+            .w = BACKGROUND_TILE_SIZE,
+            .h = BACKGROUND_TILE_SIZE
+        };
+        for (tile.y = 0; tile.y < app->height; tile.y += tile.h)
+            for (tile.x = 0; tile.x < app->width; tile.x += tile.w)
+                SDL_RenderCopy(app->renderer, app->bg_texture, NULL, &tile);
+    }
 }
 
-bool app_timer_increment(struct App *app)
+bool app_sync_playback(struct App *app, uint64_t when)
 {
-    if (!viewer_should_timer_increment(&app->view))
+    /* With no delays anywhere, there's no sensible way to animate. */
+    if (!viewer_should_timer_increment(&app->view)
+        || app->frame_starts[app->frame_count] == 0)
+        return false;
+    double const position = _playback_position(app, when);
+    size_t const index = _frame_at(app, position);
+    if (index == app->frame_index)
         return false;
-    bool advanced = false;
-    app->timer = fmod(app->timer + app->view.playback_speed, app->full_time);
+
+    /* Count the outgoing frame if it never made it to the screen, along with
+     * any we skipped over entirely.  Zero-delay frames aren't meant to be
+     * seen, so skipping them doesn't count. */
+    uint64_t dropped = app->frame_presented? 0 : 1;
     for (
-        struct SDLGraphic const *image = app->current_frame->data;
-        app->timer >= image->delay;
-        image = app->current_frame->data)
+        size_t i = (app->frame_index + 1) % app->frame_count;
+        i != index;
+        i = (i + 1) % app->frame_count)
     {
-        if (_is_app_on_final_frame(app) && !app->view.looping)
-            break;
-        else
-        {
-            app_next_frame(app);
-            advanced = true;
-        }
+        if (app->frame_starts[i + 1] > app->frame_starts[i])
+            dropped++;
+    }
+    if (dropped)
+        stats_count(STATS_COUNTER_FRAMES_DROPPED, dropped);
+
+    /* The frame became due when the position crossed its start, which may
+     * well have been before we got woken up. */
+    uint64_t scheduled = when;
+    if (app->view.playback_speed > 0.0)
+    {
+        double const late_seconds = (
+            (position - app->frame_starts[index])
+            / app->view.playback_speed / 100.0);
+        uint64_t const late = late_seconds * SDL_GetPerformanceFrequency();
+        if (late < when)
+            scheduled = when - late;
     }
-    return advanced;
+    _set_frame(app, index, scheduled);
+    return true;
+}
+
+uint64_t app_next_refresh(struct App const *app)
+{
+    uint64_t const now = stats_now();
+    if (!app->vsync || app->refresh_period == 0 || now < app->last_present)
+        return now;
+    /* Refreshes follow on from the last present at a steady rate. */
+    uint64_t const periods = (
+        (now - app->last_present) / app->refresh_period + 1);
+    return app->last_present + periods * app->refresh_period;
+}
+
+double app_time_until_next_frame(struct App const *app)
+{
+    if (!viewer_should_timer_increment(&app->view)
+        || app->view.playback_speed <= 0.0
+        || app->frame_starts[app->frame_count] == 0
+        || app->frame_count == 1)
+        return -1.0;
+
+    double const position = _playback_position(app, stats_now());
+    size_t const index = _frame_at(app, position);
+    if (index + 1 == app->frame_count && !app->view.looping)
+        return -1.0;
+    double const remaining = app->frame_starts[index + 1] - position;
+    return (remaining > 0.0? remaining : 0.0) / app->view.playback_speed;
 }
 
 void app_next_frame(struct App *app)
 {
-    struct SDLGraphic const *const image = app->current_frame->data;
-    app->timer -= image->delay;
-    app->current_frame = app->current_frame->next;
+    if (!app->frame_presented)
+        stats_count(STATS_COUNTER_FRAMES_DROPPED, 1);
+    size_t const index = (app->frame_index + 1) % app->frame_count;
+    _set_frame(app, index, stats_now());
+    _anchor_playback(app, app->frame_starts[index]);
 }
 
 void app_previous_frame(struct App *app)
 {
-    GraphicList current = app->current_frame;
-    /* TODO: Switch to doubly-linked lists to simplify. */
-    while (app->current_frame->next != current)
-        app_next_frame(app);
-    app->timer = 0;
+    size_t const index = (
+        (app->frame_index + app->frame_count - 1) % app->frame_count);
+    _set_frame(app, index, stats_now());
+    _anchor_playback(app, app->frame_starts[index]);
 }
 
 void app_draw(struct App *app)
 {
-    struct SDLGraphic const *const img = app->current_frame->data;
+    uint64_t const start = stats_now();
+    if (app->montage_visible)
+    {
+        montage_draw(app->montage);
+        SDL_RenderPresent(app->renderer);
+        app->last_present = stats_now();
+        trace_span("app_draw", start, TRACE_NO_ARG, TRACE_NO_ARG);
+        return;
+    }
+
+    struct SDLGraphic *img = app->current_frame->data;
+    if (img->same_as)
+        img = img->same_as;
     SDL_Rect const position = _get_current_frame_rect(app);
-    SDL_RenderCopy(app->renderer, img->texture, NULL, &position);
+    if (img->surface)
+        _draw_frame_software(app, img, &position);
+    else
+        graphic_draw(img, app->renderer, &position, app->view.transform.zoom);
     menu_draw(app->menu);
     if (app->state_text_visible)
+    {
+        double const since_update = (
+            (double)(stats_now() - app->pacing_text_updated)
+            / SDL_GetPerformanceFrequency());
+        if (since_update >= PACING_TEXT_INTERVAL_SECONDS)
+            _update_pacing_text(app);
         _draw_text_overlay(app);
+    }
+    trace_span("app_draw", start, app->frame_index, TRACE_NO_ARG);
+
+    uint64_t const present_start = stats_now();
     SDL_RenderPresent(app->renderer);
+    app->last_present = stats_now();
+    trace_span("present", present_start, app->frame_index, TRACE_NO_ARG);
+
+    if (!app->frame_presented)
+    {
+        stats_frame_presented(app->frame_scheduled, stats_now());
+        app->frame_presented = true;
+    }
+    else if (!app->view.paused)
+        stats_count(STATS_COUNTER_FRAMES_DUPLICATED, 1);
 }
 
 void app_resize(struct App *app, int width, int height)
@@ -289,7 +731,8 @@ void app_resize(struct App *app, int width, int height)
     app->width  = width;
     app->height = height;
     viewer_transform_reset(&app->view);
-    _generate_bg_grid(app);
+    if (app->montage)
+        montage_resize(app->montage, width, height);
 }
 
 void app_show_state_overlay(struct App *app, bool visible)
@@ -299,33 +742,33 @@ void app_show_state_overlay(struct App *app, bool visible)
 
 void app_set_paused(struct App *app, bool paused)
 {
+    _anchor_playback(app, _playback_position(app, stats_now()));
     app->view.paused = paused;
     menubutton_set_label(app->pause_btn, paused? "Unpause" : "Pause");
     textrenderer_set_text(
         app->paused_text,
-        app->renderer,
         app->view.paused? "paused TRUE" : "paused FALSE");
 }
 
 void app_set_looping(struct App *app, bool looping)
 {
+    _anchor_playback(app, _playback_position(app, stats_now()));
     app->view.looping = looping;
     menubutton_set_label(
         app->looping_btn,
         looping? "Looping: ON" : "Looping: OFF");
     textrenderer_set_text(
         app->looping_text,
-        app->renderer,
         app->view.looping? "looping TRUE" : "looping FALSE");
 }
 
 void app_set_playback_speed(struct App *app, double playback_speed)
 {
+    _anchor_playback(app, _playback_position(app, stats_now()));
     app->view.playback_speed = playback_speed;
-    char *str = NULL;
-    sprintfa(&str, "Playback Speed %#g", app->view.playback_speed);
-    textrenderer_set_text(app->playback_speed_text, app->renderer, str);
-    free(str);
+    char str[TEXTRENDERER_MAX_LENGTH];
+    snprintf(str, sizeof(str), "Playback Speed %#g", app->view.playback_speed);
+    textrenderer_set_text(app->playback_speed_text, str);
 }
 
 void app_set_fullscreen(struct App *app, bool value)
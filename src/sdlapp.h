@@ -22,6 +22,8 @@
 
 #include "sdlgif.h"
 #include "fontrenderer.h"
+#include "montage.h"
+#include "playlist.h"
 #include "menu/menu.h"
 #include "viewer/viewer.h"
 
@@ -37,37 +39,119 @@ struct App
     SDL_Renderer *renderer;
     SDL_Texture *bg_texture;
     struct TextRenderer *paused_text, *looping_text, *playback_speed_text;
+    struct TextRenderer *pacing_text;
     int width, height;
+    /** Size of the GIF being shown. */
+    int image_width, image_height;
     struct Viewer view;
     GraphicList images, current_frame;
+    /** Index of current_frame in images. */
+    size_t frame_index;
+    /** Number of frames in images. */
+    size_t frame_count;
+    /** Every node of images, in order, for random access. */
+    GraphicList *frames;
+    /**
+     * Prefix sums of the frame delays (in 100ths of a second).  Frame I starts
+     * at frame_starts[I], and frame_starts[frame_count] is the total length of
+     * the animation.
+     */
+    uint64_t *frame_starts;
     Menu *menu;
     MenuButton *pause_btn;
     MenuButton *looping_btn;
-    /** Time since last frame (in 100ths of a second [centiseconds]). */
-    double timer;
-    /** Total length of the animation (in 100ths of a second). */
-    double full_time;
+    /** Playback position at anchor_time (in 100ths of a second). */
+    double anchor_position;
+    /**
+     * When playback was last anchored (a stats_now time).  While playing, the
+     * position is anchor_position plus the real time elapsed since, scaled by
+     * the playback speed.
+     */
+    uint64_t anchor_time;
+    /** When the current frame should have been shown (a stats_now time). */
+    uint64_t frame_scheduled;
+    /** Has the current frame been presented yet? */
+    bool frame_presented;
+    /** Do presents wait for the display's vertical blank? */
+    bool vsync;
+    /** Time between display refreshes (in stats_now ticks). */
+    uint64_t refresh_period;
+    /** When the last present returned (a stats_now time). */
+    uint64_t last_present;
+    /** Are frames drawn by the software scaler? */
+    bool software;
+    /**
+     * Window-sized streaming texture the software scaler draws frames into,
+     * or NULL if it hasn't been needed yet.
+     */
+    SDL_Texture *frame_target;
+    int frame_target_width, frame_target_height;
+    /** When pacing_text was last updated (a stats_now time). */
+    uint64_t pacing_text_updated;
+    /**
+     * The state display text as last drawn, or NULL if it hasn't been drawn
+     * yet or the renderer can't draw to textures.
+     */
+    SDL_Texture *overlay_texture;
+    /** Does overlay_texture need to be redrawn? */
+    bool overlay_dirty;
+    /** Can the state display text be drawn into overlay_texture? */
+    bool can_cache_overlay;
     /** Is the state display text visible? */
     bool state_text_visible;
     /** Is the window fullscreened? */
     bool is_fullscreen;
+    /** Thumbnail grid of every file, or NULL if it hasn't been shown yet. */
+    struct Montage *montage;
+    /** Is the thumbnail grid shown instead of the current file? */
+    bool montage_visible;
 };
 
 
-/** Create SDL data. */
-struct App *app_new(GIF const *gif, char const *path);
+/**
+ * Create SDL data.  If VSYNC is true, presents are synchronized to the display
+ * refresh, if the renderer supports it.  If SOFTWARE is true, SDL's software
+ * renderer is used, and frames are drawn by GIFView's own scaler.
+ */
+struct App *app_new(
+    struct PreparedGIF const *gif, char const *path, bool vsync,
+    bool software);
 
 /** Free SDL data. */
 void app_free(struct App const *app);
 
+/**
+ * Show GIF (loaded from PATH) instead of the current one, from its first
+ * frame, with the view reset.
+ */
+void app_load(
+    struct App *app, struct PreparedGIF const *gif, char const *path);
+
 /** Clear the screen. */
 void app_clear_screen(struct App *app);
 
-/** Increment the timer, returning true if we've moved to the next frame. */
-bool app_timer_increment(struct App *app);
+/**
+ * Show whichever frame is due at WHEN (a stats_now time), returning true if
+ * we've moved to another frame.  Frames whose time passed entirely since the
+ * last call are skipped.
+ */
+bool app_sync_playback(struct App *app, uint64_t when);
 
 /**
- * Move to the next frame.  (Normally done automatically by timer_increment.
+ * Get when the next present will reach the screen (a stats_now time).  Without
+ * vsync, that's now.
+ */
+uint64_t app_next_refresh(struct App const *app);
+
+/**
+ * Get the real time (in 100ths of a second) until the current frame should
+ * change, or a negative number if it won't change on its own (eg. because
+ * playback is paused).
+ */
+double app_time_until_next_frame(struct App const *app);
+
+/**
+ * Move to the next frame.  (Normally done automatically by sync_playback.
  * Use this if you want to change frames manually, eg. by user input.)
  */
 void app_next_frame(struct App *app);
@@ -75,7 +159,10 @@ void app_next_frame(struct App *app);
 /** Move to the previous frame. */
 void app_previous_frame(struct App *app);
 
-/** Draw the screen. */
+/**
+ * Draw the screen.  While the thumbnail grid is visible, that's drawn instead
+ * of the current frame.
+ */
 void app_draw(struct App *app);
 
 /** Resize the screen. */
@@ -19,6 +19,10 @@
 
 #include "sdlgif.h"
 #include "font.h"
+#include "indexed.h"
+#include "mip.h"
+#include "stats/stats.h"
+#include "stats/trace.h"
 
 #include <string.h>
 
@@ -28,6 +32,13 @@
 #define MIN(a, b)   (a < b? a : b)
 
 
+/**
+ * Frames smaller than this (in pixels) in both dimensions don't get mip
+ * levels, since drawing them at any zoom is already cheap.
+ */
+static int const MIP_MIN_SIZE = 256;
+
+
 /**
  * Interstitial structure used to construct the full frames contained in the
  * SDLGraphic struct.  SDL representation of a GIF_Graphic.
@@ -36,9 +47,17 @@ struct SurfaceGraphic
 {
     SDL_Rect rect;
     SDL_Surface *surface;
+    /** Bytes of pixel data owned by SURFACE. */
+    size_t bytes;
 };
 
 
+/** Bytes of pixel data in SURFACE. */
+size_t _surface_bytes(SDL_Surface const *surface)
+{
+    return (size_t)surface->pitch * surface->h;
+}
+
 SDL_Color
 sdl_color_get_from_colortable(struct GIF_ColorTable const *table, size_t index)
 {
@@ -62,6 +81,8 @@ SDL_Color *sdl_color_list_from_colortable(struct GIF_ColorTable const *table)
 struct SurfaceGraphic *surfacegraphic_from_image(struct GIF_Image const *image)
 {
     struct SurfaceGraphic *const out = malloc(sizeof(*out));
+    /* The surface uses the image's pixels rather than its own. */
+    out->bytes = 0;
     out->rect.x = image->left;
     out->rect.y = image->top;
     out->rect.w = image->width;
@@ -97,18 +118,57 @@ struct SurfaceGraphic *surfacegraphic_from_image(struct GIF_Image const *image)
     return out;
 }
 
+/** First and last characters a plaintext font has glyphs for. */
+#define PLAINTEXT_FIRST_GLYPH   ' '
+#define PLAINTEXT_LAST_GLYPH    '~'
+#define PLAINTEXT_GLYPH_COUNT \
+    (PLAINTEXT_LAST_GLYPH - PLAINTEXT_FIRST_GLYPH + 1)
+
+/** The monospace font opened at one point size, with its rendered glyphs. */
+struct PlainTextFont
+{
+    int points;
+    /** NULL if the font couldn't be opened at POINTS. */
+    TTF_Font *font;
+    /** 8-bit glyph surfaces, or NULL until they're first needed. */
+    SDL_Surface *glyphs[PLAINTEXT_GLYPH_COUNT];
+    size_t bytes;
+    struct PlainTextFont *next;
+};
+
+/**
+ * Every plaintext font opened so far, kept until sdlgif_quit.  Only used under
+ * lock_ttf, since GIFs can load on any thread.
+ */
+static struct PlainTextFont *plaintext_fonts = NULL;
+
+
+/** Get the display's DPI, querying it only the first time. */
+void _display_dpi(float *hdpi, float *vdpi)
+{
+    static bool queried = false;
+    static float cached_hdpi = 72.0f, cached_vdpi = 72.0f;
+    if (!queried)
+    {
+        queried = true;
+        if (SDL_GetDisplayDPI(0, NULL, &cached_hdpi, &cached_vdpi) != 0)
+        {
+            error("SDL_GetDisplayDPI -- %s\n", SDL_GetError());
+            cached_hdpi = 72.0f;
+            cached_vdpi = 72.0f;
+        }
+    }
+    *hdpi = cached_hdpi;
+    *vdpi = cached_vdpi;
+}
+
 /** Fit the font to the given width/height. */
 int fit_font_to_rect(int width, int height)
 {
     static float const POINTS_PER_INCH = 72.0f;
 
     float hdpi, vdpi;
-    if (SDL_GetDisplayDPI(0, NULL, &hdpi, &vdpi) != 0)
-    {
-        error("SDL_GetDisplayDPI -- %s\n", SDL_GetError());
-        hdpi = 72.0f;
-        vdpi = 72.0f;
-    }
+    _display_dpi(&hdpi, &vdpi);
 
     float const width_inches = (float)width / hdpi;
     float const height_inches = (float)height / vdpi;
@@ -118,7 +178,77 @@ int fit_font_to_rect(int width, int height)
     return MIN(v_points, h_points);
 }
 
-/** Create a SurfaceGraphic from a GIF_PlainTextExt. */
+/** Get the monospace font at POINTS, opening it the first time. */
+struct PlainTextFont *_plaintext_font(int points)
+{
+    for (struct PlainTextFont *f = plaintext_fonts; f; f = f->next)
+        if (f->points == points)
+            return f;
+
+    struct PlainTextFont *f = malloc(sizeof(*f));
+    f->points = points;
+    uint64_t const font_start = stats_now();
+    f->font = TTF_OpenFont(DEFAULT_MONOSPACE_FONT_PATH, points);
+    stats_stage_end(STATS_STAGE_FONT_LOAD, font_start);
+    if (!f->font)
+        error("TTF_OpenFont -- %s\n", TTF_GetError());
+    for (int i = 0; i < PLAINTEXT_GLYPH_COUNT; ++i)
+        f->glyphs[i] = NULL;
+    f->bytes = 0;
+    f->next = plaintext_fonts;
+    plaintext_fonts = f;
+    return f;
+}
+
+/**
+ * Get FONT's glyph for C, rendering it the first time.  Returns NULL for
+ * characters without a glyph, which are drawn as blank cells.
+ */
+SDL_Surface *_plaintext_glyph(struct PlainTextFont *font, uint8_t c)
+{
+    static SDL_Color const WHITE = {0xff, 0xff, 0xff, 0xff};
+
+    if (!font->font || c < PLAINTEXT_FIRST_GLYPH || c > PLAINTEXT_LAST_GLYPH)
+        return NULL;
+    SDL_Surface **glyph = &font->glyphs[c - PLAINTEXT_FIRST_GLYPH];
+    if (!*glyph)
+    {
+        *glyph = TTF_RenderGlyph_Solid(font->font, c, WHITE);
+        if (!*glyph)
+        {
+            error("TTF_RenderGlyph_Solid -- %s\n", TTF_GetError());
+            return NULL;
+        }
+        font->bytes += _surface_bytes(*glyph);
+        stats_memory_add(STATS_MEMORY_SURFACES, _surface_bytes(*glyph));
+    }
+    return *glyph;
+}
+
+/** Draw GLYPH into CELL of the 8-bit SURFACE as index 1, clipped to CELL. */
+void _draw_plaintext_glyph(
+    SDL_Surface *surface, SDL_Surface const *glyph, SDL_Rect const *cell)
+{
+    int const width = MIN(glyph->w, cell->w);
+    int const height = MIN(glyph->h, cell->h);
+    for (int y = 0; y < height; ++y)
+    {
+        uint8_t const *src = (uint8_t const *)glyph->pixels + y * glyph->pitch;
+        uint8_t *dst = (
+            (uint8_t *)surface->pixels
+            + (cell->y + y) * surface->pitch
+            + cell->x);
+        for (int x = 0; x < width; ++x)
+            if (src[x])
+                dst[x] = 1;
+    }
+}
+
+/**
+ * Create a SurfaceGraphic from a GIF_PlainTextExt.  Characters fill the text
+ * grid's cells left to right, top to bottom, and any that don't fit are
+ * dropped.
+ */
 struct SurfaceGraphic *surfacegraphic_from_plaintext(
     struct GIF_PlainTextExt const *restrict plaintext,
     struct GIF_ColorTable const *restrict gct)
@@ -129,29 +259,51 @@ struct SurfaceGraphic *surfacegraphic_from_plaintext(
     out->rect.w = plaintext->tg_width;
     out->rect.h = plaintext->tg_height;
 
-    SDL_Color fg = sdl_color_get_from_colortable(gct, plaintext->fg_idx);
-    SDL_Color bg = sdl_color_get_from_colortable(gct, plaintext->bg_idx);
-
-    int points = fit_font_to_rect(
-        plaintext->cell_width, plaintext->cell_height);
-    TTF_Font *font = TTF_OpenFont(DEFAULT_MONOSPACE_FONT_PATH, points);
-    if (!font)
-        error("TTF_OpenFont -- %s\n", TTF_GetError());
-
-    /* TODO:
-     * Sometimes draws boxes, maybe need to draw characters individually? */
-    /* Using TTF_RenderUTF8_Solid_Wrapped here because we need to stick to the
-     * given palette colors. */
-    char *text = strndup(plaintext->data, plaintext->data_size);
-    out->surface = TTF_RenderUTF8_Solid_Wrapped(
-        font, plaintext->data, fg, out->rect.w);
-    SDL_SetColorKey(out->surface, SDL_FALSE, 0);
-    SDL_SetPaletteColors(out->surface->format->palette, &bg, 0, 1);
-    free(text);
+    /* Index 0 is the background, and 1 the foreground, so the surface sticks
+     * to the given palette colors. */
+    out->surface = SDL_CreateRGBSurfaceWithFormat(
+        0, out->rect.w, out->rect.h, 8, SDL_PIXELFORMAT_INDEX8);
     if (!out->surface)
-        error("TTF_RenderUTF8_Shaded_Wrapped -- %s\n", TTF_GetError());
+    {
+        error("SDL_CreateRGBSurfaceWithFormat -- %s\n", SDL_GetError());
+        free(out);
+        return NULL;
+    }
+    SDL_Color const colors[2] = {
+        sdl_color_get_from_colortable(gct, plaintext->bg_idx),
+        sdl_color_get_from_colortable(gct, plaintext->fg_idx),
+    };
+    SDL_SetPaletteColors(out->surface->format->palette, colors, 0, 2);
+    SDL_FillRect(out->surface, NULL, 0);
+    out->bytes = _surface_bytes(out->surface);
+    stats_memory_add(STATS_MEMORY_SURFACES, out->bytes);
 
-    TTF_CloseFont(font);
+    int const columns = (
+        plaintext->cell_width? out->rect.w / plaintext->cell_width : 0);
+    int const rows = (
+        plaintext->cell_height? out->rect.h / plaintext->cell_height : 0);
+    size_t const cells = (size_t)columns * rows;
+    if (cells == 0)
+        return out;
+
+    lock_ttf();
+    struct PlainTextFont *font = _plaintext_font(
+        fit_font_to_rect(plaintext->cell_width, plaintext->cell_height));
+    size_t const count = MIN(plaintext->data_size, cells);
+    for (size_t i = 0; i < count; ++i)
+    {
+        SDL_Surface const *glyph = _plaintext_glyph(font, plaintext->data[i]);
+        if (!glyph)
+            continue;
+        SDL_Rect const cell = {
+            .x=(int)(i % columns) * plaintext->cell_width,
+            .y=(int)(i / columns) * plaintext->cell_height,
+            .w=plaintext->cell_width,
+            .h=plaintext->cell_height,
+        };
+        _draw_plaintext_glyph(out->surface, glyph, &cell);
+    }
+    unlock_ttf();
     return out;
 }
 
@@ -182,6 +334,7 @@ struct SurfaceGraphic *surfacegraphic_from_graphic(
 /** Free a SurfaceGraphic. */
 void surfacegraphic_free(struct SurfaceGraphic *sg)
 {
+    stats_memory_remove(STATS_MEMORY_SURFACES, sg->bytes);
     SDL_FreeSurface(sg->surface);
     free(sg);
 }
@@ -195,13 +348,78 @@ struct SDLGraphic *graphic_new(void)
     graphic->width = 0;
     graphic->height = 0;
     graphic->texture = NULL;
+    graphic->tiles = NULL;
+    graphic->surface = NULL;
+    graphic->mipmapped = false;
+    graphic->mip_texture = NULL;
+    graphic->mip_level = 0;
+    graphic->same_as = NULL;
     return graphic;
 }
 
+/**
+ * Can a WIDTH x HEIGHT texture be created with a renderer described by INFO?
+ * Renderers which report a maximum size of 0 have no limit.
+ */
+bool _fits_texture(SDL_RendererInfo const *info, int width, int height)
+{
+    return (
+        (info->max_texture_width <= 0 || width <= info->max_texture_width)
+        && (info->max_texture_height <= 0
+            || height <= info->max_texture_height));
+}
+
+/** Get the size of GRAPHIC's mip level LEVEL. */
+void _mip_size(
+    struct SDLGraphic const *graphic, int level, int *width, int *height)
+{
+    *width = graphic->width;
+    *height = graphic->height;
+    for (int i = 0; i < level; ++i)
+    {
+        *width = (*width + 1) / 2;
+        *height = (*height + 1) / 2;
+    }
+}
+
+/** Destroy GRAPHIC's cached mip texture, if any. */
+void _drop_mip_texture(struct SDLGraphic *graphic)
+{
+    if (!graphic->mip_texture)
+        return;
+    int width, height;
+    _mip_size(graphic, graphic->mip_level, &width, &height);
+    stats_memory_remove(
+        STATS_MEMORY_FRAME_TEXTURES, (size_t)width * height * 4);
+    SDL_DestroyTexture(graphic->mip_texture);
+    graphic->mip_texture = NULL;
+    graphic->mip_level = 0;
+}
+
 /** Free an SDLGraphic. */
 void graphic_free(struct SDLGraphic *graphic)
 {
+    if (graphic->same_as)
+    {
+        free(graphic);
+        return;
+    }
+    if (graphic->texture)
+    {
+        stats_memory_remove(
+            STATS_MEMORY_FRAME_TEXTURES,
+            (size_t)graphic->width * graphic->height * 4);
+    }
     SDL_DestroyTexture(graphic->texture);
+    if (graphic->tiles)
+        tiledtexture_free(graphic->tiles);
+    if (graphic->surface)
+    {
+        stats_memory_remove(
+            STATS_MEMORY_SURFACES, _surface_bytes(graphic->surface));
+        SDL_FreeSurface(graphic->surface);
+    }
+    _drop_mip_texture(graphic);
     free(graphic);
 }
 
@@ -239,6 +457,7 @@ _make_frame(
     /* Create the current frame, copying over data from the previous frame. */
     SDL_Surface *frame = SDL_CreateRGBSurfaceWithFormat(
         0, (*nextframe)->w, (*nextframe)->h, 32, SDL_PIXELFORMAT_RGBA32);
+    stats_memory_add(STATS_MEMORY_SURFACES, _surface_bytes(frame));
     SDL_BlitSurface(*nextframe, NULL, frame, NULL);
 
     LinkedList const *gcurr = start_orig;
@@ -296,28 +515,245 @@ _make_frame(
     return frame;
 }
 
-GraphicList graphiclist_new_from_gif(SDL_Renderer *renderer, GIF gif)
+/** Create the transparent surface the first frame of GIF is built on. */
+SDL_Surface *_new_base_frame(GIF const *gif)
+{
+    SDL_Surface *base = SDL_CreateRGBSurfaceWithFormat(
+        0, gif->width, gif->height, 32, SDL_PIXELFORMAT_RGBA32);
+    SDL_FillRect(base, NULL, SDL_MapRGBA(base->format, 0, 0, 0, 0));
+    stats_memory_add(STATS_MEMORY_SURFACES, _surface_bytes(base));
+    return base;
+}
+
+/**
+ * Build the frame starting at *NODE with _make_frame and pass it to ON_FRAME.
+ * INDEX is the frame's number, for tracing.
+ */
+void _composite_frame(
+    LinkedList const **node,
+    SDL_Surface **lastframe,
+    GIF const *gif,
+    size_t index,
+    FrameCallback on_frame,
+    void *userdata)
 {
-    SDL_Surface *lastframe = SDL_CreateRGBSurfaceWithFormat(
-        0, gif.width, gif.height, 32, SDL_PIXELFORMAT_RGBA32);
-    SDL_FillRect(lastframe, NULL, SDL_MapRGBA(lastframe->format, 0, 0, 0, 0));
+    uint64_t const start = stats_now();
+    SDL_Surface *frame = _make_frame(node, lastframe, gif);
+    stats_stage_end(STATS_STAGE_COMPOSITE, start);
+    trace_span(
+        "_make_frame", start, index, (long long)frame->w * frame->h * 4);
+    stats_count(STATS_COUNTER_FRAMES_COMPOSITED, 1);
 
-    GraphicList out = NULL;
+    struct GIF_Graphic const *g = (*node)->data;
+    size_t const delay = g->extension? g->extension->delay_time : 0;
+    on_frame(frame, delay, userdata);
+
+    stats_memory_remove(STATS_MEMORY_SURFACES, _surface_bytes(frame));
+    SDL_FreeSurface(frame);
+}
+
+void sdlgif_composite_frames(GIF gif, FrameCallback on_frame, void *userdata)
+{
+    SDL_Surface *lastframe = _new_base_frame(&gif);
+    size_t index = 0;
     for (LinkedList const *node = gif.graphics; node; node = node->next)
+        _composite_frame(&node, &lastframe, &gif, index++, on_frame, userdata);
+    stats_memory_remove(STATS_MEMORY_SURFACES, _surface_bytes(lastframe));
+    SDL_FreeSurface(lastframe);
+}
+
+struct SDLGIFCompositor
+{
+    GIF const *gif;
+    FrameCallback on_frame;
+    void *userdata;
+    /** Basis for the next frame. */
+    SDL_Surface *lastframe;
+    /** LinkedList<GIF_Graphic>.  Graphics not yet built into a frame. */
+    LinkedList *pending;
+    /**
+     * Does the last pending graphic end a frame?  That frame is only built
+     * once the graphic after it arrives, since _make_frame looks at it too.
+     */
+    bool frame_ended;
+    /** Number of frames built so far. */
+    size_t count;
+};
+
+struct SDLGIFCompositor *sdlgif_compositor_new(
+    GIF const *gif, FrameCallback on_frame, void *userdata)
+{
+    struct SDLGIFCompositor *compositor = malloc(sizeof(*compositor));
+    *compositor = (struct SDLGIFCompositor){
+        .gif = gif,
+        .on_frame = on_frame,
+        .userdata = userdata,
+        .lastframe = _new_base_frame(gif),
+        .pending = NULL,
+        .frame_ended = false,
+        .count = 0,
+    };
+    return compositor;
+}
+
+/**
+ * Build a frame from COMPOSITOR's pending graphics, then free the ones it
+ * used.
+ */
+void _compositor_flush(struct SDLGIFCompositor *compositor)
+{
+    LinkedList const *last = compositor->pending;
+    _composite_frame(
+        &last, &compositor->lastframe, compositor->gif, compositor->count++,
+        compositor->on_frame, compositor->userdata);
+
+    LinkedList *rest = last->next;
+    for (LinkedList *curr = compositor->pending; curr != rest;)
+    {
+        LinkedList *next = curr->next;
+        gif_free_graphic(curr->data, compositor->gif->global_color_table);
+        free(curr->data);
+        free(curr);
+        curr = next;
+    }
+    compositor->pending = rest;
+}
+
+void sdlgif_compositor_add(
+    struct SDLGIFCompositor *compositor, struct GIF_Graphic *graphic)
+{
+    linkedlist_append(&compositor->pending, linkedlist_new(graphic));
+    if (compositor->frame_ended)
+        _compositor_flush(compositor);
+    /* A nonzero delay ends a frame, as in _make_frame. */
+    compositor->frame_ended = (
+        graphic->extension && graphic->extension->delay_time != 0);
+}
+
+size_t sdlgif_compositor_finish(struct SDLGIFCompositor *compositor)
+{
+    while (compositor->pending)
+        _compositor_flush(compositor);
+    size_t const count = compositor->count;
+    stats_memory_remove(
+        STATS_MEMORY_SURFACES, _surface_bytes(compositor->lastframe));
+    SDL_FreeSurface(compositor->lastframe);
+    free(compositor);
+    return count;
+}
+
+/** Data passed to _append_graphic by the graphiclist_new_* functions. */
+struct GraphicListBuilder
+{
+    SDL_Renderer *renderer;
+    /** The renderer's limits, for deciding which frames need tiling. */
+    SDL_RendererInfo info;
+    /** Keep frames as surfaces for the software scaler? */
+    bool software;
+    GraphicList list;
+    /** Number of frames appended so far. */
+    size_t count;
+    /** The last graphic appended, or NULL. */
+    struct SDLGraphic *last;
+};
+
+/** FrameCallback which uploads FRAME and appends it to a GraphicList. */
+void _append_graphic(SDL_Surface *frame, size_t delay, void *userdata)
+{
+    struct GraphicListBuilder *builder = userdata;
+    struct SDLGraphic *frame_g = graphic_new();
+    frame_g->delay = delay;
+    frame_g->width = frame->w;
+    frame_g->height = frame->h;
+
+    /* The software scaler works straight from the pixels, and needs neither
+     * textures nor mip levels. */
+    if (builder->software)
     {
-        SDL_Surface *frame = _make_frame(&node, &lastframe, &gif);
+        frame_g->surface = SDL_ConvertSurfaceFormat(
+            frame, SDL_PIXELFORMAT_ARGB8888, 0);
+        if (frame_g->surface == NULL)
+            fatal("SDL_ConvertSurfaceFormat -- %s\n", SDL_GetError());
+        stats_memory_add(
+            STATS_MEMORY_SURFACES, _surface_bytes(frame_g->surface));
+        builder->count++;
+        builder->last = frame_g;
+        linkedlist_append(&builder->list, linkedlist_new(frame_g));
+        return;
+    }
+
+    /* Oversized frames get uploaded a tile at a time when they're drawn. */
+    if (!_fits_texture(&builder->info, frame->w, frame->h))
+    {
+        frame_g->tiles = tiledtexture_new(frame);
+        builder->count++;
+    }
+    else
+    {
+        uint64_t const start = stats_now();
+        frame_g->texture = SDL_CreateTextureFromSurface(
+            builder->renderer, frame);
+        stats_stage_end(STATS_STAGE_TEXTURE_UPLOAD, start);
+        trace_span(
+            "texture upload", start, builder->count++,
+            (long long)frame->w * frame->h * 4);
+        stats_count(STATS_COUNTER_TEXTURES_CREATED, 1);
+        stats_count(
+            STATS_COUNTER_TEXTURE_BYTES, (uint64_t)frame->w * frame->h * 4);
+        stats_memory_add(
+            STATS_MEMORY_FRAME_TEXTURES, (size_t)frame->w * frame->h * 4);
+    }
+
+    /* Mip levels are only built if the frame is drawn zoomed out.  Tiles keep
+     * the pixels to build them from, otherwise they're rendered from the
+     * texture. */
+    frame_g->mipmapped = (
+        (frame->w >= MIP_MIN_SIZE || frame->h >= MIP_MIN_SIZE)
+        && (frame_g->tiles
+            || (builder->info.flags & SDL_RENDERER_TARGETTEXTURE)));
 
-        struct GIF_Graphic *g = node->data;
-        struct SDLGraphic *frame_g = graphic_new();
-        frame_g->delay = g->extension? g->extension->delay_time : 0;
-        frame_g->width = frame->w;
-        frame_g->height = frame->h;
-        frame_g->texture = SDL_CreateTextureFromSurface(renderer, frame);
+    builder->last = frame_g;
+    linkedlist_append(&builder->list, linkedlist_new(frame_g));
+}
 
-        SDL_FreeSurface(frame);
+/** Append a graphic drawn with SOURCE, shown for DELAY, to BUILDER's list. */
+void _append_shared_graphic(
+    struct GraphicListBuilder *builder, struct SDLGraphic *source, size_t delay)
+{
+    struct SDLGraphic *frame_g = graphic_new();
+    frame_g->delay = delay;
+    frame_g->width = source->width;
+    frame_g->height = source->height;
+    frame_g->same_as = source;
+    builder->count++;
+    builder->last = frame_g;
+    linkedlist_append(&builder->list, linkedlist_new(frame_g));
+}
 
-        linkedlist_append(&out, linkedlist_new(frame_g));
+/** Start building a GraphicList of frames for RENDERER. */
+struct GraphicListBuilder _builder_new(SDL_Renderer *renderer, bool software)
+{
+    struct GraphicListBuilder builder = {
+        .renderer = renderer,
+        .software = software,
+        .list = NULL,
+        .count = 0,
+        .last = NULL,
+    };
+    if (SDL_GetRendererInfo(renderer, &builder.info) != 0)
+    {
+        error("SDL_GetRendererInfo -- %s\n", SDL_GetError());
+        builder.info.flags = 0;
+        builder.info.max_texture_width = 0;
+        builder.info.max_texture_height = 0;
     }
+    return builder;
+}
+
+/** Finish building a GraphicList, returning it. */
+GraphicList _builder_finish(struct GraphicListBuilder *builder)
+{
+    GraphicList out = builder->list;
 
     /* Make the list circular, for free looping. */
     for (GraphicList g = out; g != NULL; g = g->next)
@@ -332,6 +768,261 @@ GraphicList graphiclist_new_from_gif(SDL_Renderer *renderer, GIF gif)
     return out;
 }
 
+GraphicList graphiclist_new_from_gif(
+    SDL_Renderer *renderer, GIF gif, bool software)
+{
+    struct GraphicListBuilder builder = _builder_new(renderer, software);
+    sdlgif_composite_frames(gif, _append_graphic, &builder);
+    return _builder_finish(&builder);
+}
+
+GraphicList graphiclist_new_from_frames(
+    SDL_Renderer *renderer, SDL_Surface *const *frames, size_t const *sources,
+    size_t const *delays, size_t count, bool software)
+{
+    struct GraphicListBuilder builder = _builder_new(renderer, software);
+    /* The graphic made for each frame, for later frames to share. */
+    struct SDLGraphic **graphics = malloc(count * sizeof(*graphics));
+    for (size_t i = 0; i < count; ++i)
+    {
+        if (sources[i] != i)
+        {
+            _append_shared_graphic(&builder, graphics[sources[i]], delays[i]);
+        }
+        else if (frames[i]->format->format != SDL_PIXELFORMAT_INDEX8)
+        {
+            _append_graphic(frames[i], delays[i], &builder);
+        }
+        else
+        {
+            /* Indexed frames are only expanded for as long as uploading
+             * takes. */
+            SDL_Surface *frame = indexed_to_rgba(frames[i]);
+            stats_memory_add(STATS_MEMORY_SURFACES, _surface_bytes(frame));
+            _append_graphic(frame, delays[i], &builder);
+            stats_memory_remove(STATS_MEMORY_SURFACES, _surface_bytes(frame));
+            SDL_FreeSurface(frame);
+        }
+        graphics[i] = builder.last;
+    }
+    free(graphics);
+    return _builder_finish(&builder);
+}
+
+/**
+ * Render mip level LEVEL of GRAPHIC from its texture on RENDERER.  The texture
+ * is halved a level at a time with linear filtering, which averages each 2x2
+ * block.  Returns NULL if the renderer can't.
+ */
+SDL_Texture *_render_mip(
+    struct SDLGraphic const *graphic, SDL_Renderer *renderer, int level)
+{
+    SDL_Texture *const target = SDL_GetRenderTarget(renderer);
+    SDL_ScaleMode scale_mode;
+    SDL_BlendMode blend_mode;
+    SDL_GetTextureScaleMode(graphic->texture, &scale_mode);
+    SDL_GetTextureBlendMode(graphic->texture, &blend_mode);
+    SDL_Texture *source = graphic->texture;
+    int width = graphic->width, height = graphic->height;
+    for (int i = 0; i < level && source; ++i)
+    {
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+        SDL_Texture *next = SDL_CreateTexture(
+            renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_TARGET,
+            width, height);
+        if (next)
+        {
+            stats_count(STATS_COUNTER_TEXTURES_CREATED, 1);
+            stats_count(
+                STATS_COUNTER_TEXTURE_BYTES, (uint64_t)width * height * 4);
+            /* Copy alpha as it is, rather than blending onto the target. */
+            SDL_SetTextureScaleMode(source, SDL_ScaleModeLinear);
+            SDL_SetTextureBlendMode(source, SDL_BLENDMODE_NONE);
+            /* Flushed before the source's modes are put back, since copies
+             * can be batched until then. */
+            if (SDL_SetRenderTarget(renderer, next) != 0
+                || SDL_RenderCopy(renderer, source, NULL, NULL) != 0
+                || SDL_RenderFlush(renderer) != 0)
+            {
+                SDL_DestroyTexture(next);
+                next = NULL;
+            }
+        }
+        else
+            error("SDL_CreateTexture -- %s\n", SDL_GetError());
+        if (source == graphic->texture)
+        {
+            SDL_SetTextureScaleMode(source, scale_mode);
+            SDL_SetTextureBlendMode(source, blend_mode);
+        }
+        else
+            SDL_DestroyTexture(source);
+        source = next;
+    }
+    SDL_SetRenderTarget(renderer, target);
+    return source;
+}
+
+/**
+ * Build mip level LEVEL of GRAPHIC, which is WIDTH x HEIGHT, from the pixels
+ * behind its tiles, and upload it to RENDERER.  Bands of rows are expanded and
+ * halved one at a time, so the whole frame is never expanded at once.  Returns
+ * NULL if the texture can't be created.
+ */
+SDL_Texture *_build_mip_from_tiles(
+    struct SDLGraphic const *graphic, SDL_Renderer *renderer, int level,
+    int width, int height)
+{
+    SDL_Surface const *surface = graphic->tiles->surface;
+    bool const indexed = surface->format->format == SDL_PIXELFORMAT_INDEX8;
+    int const band_rows = 1 << level;
+    size_t const row_bytes = (size_t)surface->w * 4;
+    /* Each band is halved back and forth between these two. */
+    uint8_t *band = malloc(row_bytes * band_rows);
+    uint8_t *half = malloc((size_t)(surface->w + 1) / 2 * 4 * band_rows / 2);
+    uint8_t *pixels = malloc((size_t)width * height * 4);
+    for (int y = 0; y < surface->h; y += band_rows)
+    {
+        SDL_Rect const rect = {
+            .x=0, .y=y, .w=surface->w, .h=MIN(band_rows, surface->h - y)
+        };
+        uint8_t const *src = (
+            (uint8_t const *)surface->pixels + (size_t)y * surface->pitch);
+        size_t src_pitch = surface->pitch;
+        if (indexed)
+        {
+            indexed_expand_rect(surface, &rect, band, row_bytes);
+            src = band;
+            src_pitch = row_bytes;
+        }
+        int band_width = rect.w, band_height = rect.h;
+        uint8_t *spare[2] = {half, band};
+        for (int i = 0; i < level; ++i)
+        {
+            int const next_width = (band_width + 1) / 2;
+            int const next_height = (band_height + 1) / 2;
+            uint8_t *dst = (
+                i == level - 1
+                ? pixels + (size_t)(y / band_rows) * width * 4
+                : spare[i % 2]);
+            mip_downscale_rgba(
+                src, src_pitch, band_width, band_height,
+                dst, (size_t)next_width * 4);
+            src = dst;
+            src_pitch = (size_t)next_width * 4;
+            band_width = next_width;
+            band_height = next_height;
+        }
+    }
+    free(half);
+    free(band);
+
+    SDL_Texture *texture = SDL_CreateTexture(
+        renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC,
+        width, height);
+    if (texture)
+    {
+        SDL_UpdateTexture(texture, NULL, pixels, width * 4);
+        stats_count(STATS_COUNTER_TEXTURES_CREATED, 1);
+        stats_count(STATS_COUNTER_TEXTURE_BYTES, (uint64_t)width * height * 4);
+    }
+    else
+        error("SDL_CreateTexture -- %s\n", SDL_GetError());
+    free(pixels);
+    return texture;
+}
+
+/**
+ * Get the texture to draw GRAPHIC with at ZOOM, or NULL if it has to be drawn
+ * from tiles.
+ */
+SDL_Texture *_texture_for_zoom(
+    struct SDLGraphic *graphic, SDL_Renderer *renderer, double zoom)
+{
+    if (!graphic->mipmapped)
+        return graphic->texture;
+
+    /* Each level halves the size, so go down while the next level would still
+     * be at least as big as the image on screen. */
+    int level = 0;
+    int width = graphic->width, height = graphic->height;
+    while (zoom * (2 << level) <= 1.0 && (width > 1 || height > 1))
+    {
+        level++;
+        width = (width + 1) / 2;
+        height = (height + 1) / 2;
+    }
+    if (level == 0)
+        return graphic->texture;
+    if (graphic->mip_texture && graphic->mip_level == level)
+        return graphic->mip_texture;
+    if (graphic->tiles)
+    {
+        SDL_RendererInfo info;
+        if (SDL_GetRendererInfo(renderer, &info) != 0
+            || !_fits_texture(&info, width, height))
+            return NULL;
+    }
+
+    uint64_t const start = stats_now();
+    _drop_mip_texture(graphic);
+    SDL_Texture *mip = (
+        graphic->tiles
+        ? _build_mip_from_tiles(graphic, renderer, level, width, height)
+        : _render_mip(graphic, renderer, level));
+    if (!mip)
+    {
+        /* Don't try again every frame. */
+        graphic->mipmapped = false;
+        return graphic->texture;
+    }
+    SDL_SetTextureBlendMode(mip, SDL_BLENDMODE_BLEND);
+    graphic->mip_texture = mip;
+    graphic->mip_level = level;
+    stats_memory_add(STATS_MEMORY_FRAME_TEXTURES, (size_t)width * height * 4);
+    trace_span(
+        "mip build", start, TRACE_NO_ARG, (long long)width * height * 4);
+    return graphic->mip_texture;
+}
+
+void graphic_draw(
+    struct SDLGraphic *graphic, SDL_Renderer *renderer, SDL_Rect const *dst,
+    double zoom)
+{
+    SDL_Texture *const texture = _texture_for_zoom(graphic, renderer, zoom);
+    if (texture)
+        SDL_RenderCopy(renderer, texture, NULL, dst);
+    else if (graphic->tiles)
+        tiledtexture_draw(graphic->tiles, renderer, dst);
+}
+
+size_t graphiclist_resident_bytes(GraphicList graphics)
+{
+    size_t bytes = 0;
+    GraphicList node = graphics;
+    do
+    {
+        struct SDLGraphic const *graphic = node->data;
+        if (graphic->surface)
+            bytes += _surface_bytes(graphic->surface);
+        if (graphic->tiles)
+            bytes += _surface_bytes(graphic->tiles->surface);
+        node = node->next;
+    } while (node != graphics);
+    return bytes;
+}
+
+void graphiclist_drop_mips(GraphicList graphics)
+{
+    GraphicList node = graphics;
+    do
+    {
+        _drop_mip_texture(node->data);
+        node = node->next;
+    } while (node != graphics);
+}
+
 void graphiclist_free(GraphicList graphics)
 {
     for (GraphicList node = graphics->next; node != NULL;)
@@ -344,3 +1035,20 @@ void graphiclist_free(GraphicList graphics)
         node = next;
     }
 }
+
+void sdlgif_quit(void)
+{
+    lock_ttf();
+    while (plaintext_fonts)
+    {
+        struct PlainTextFont *next = plaintext_fonts->next;
+        for (int i = 0; i < PLAINTEXT_GLYPH_COUNT; ++i)
+            SDL_FreeSurface(plaintext_fonts->glyphs[i]);
+        stats_memory_remove(STATS_MEMORY_SURFACES, plaintext_fonts->bytes);
+        if (plaintext_fonts->font)
+            TTF_CloseFont(plaintext_fonts->font);
+        free(plaintext_fonts);
+        plaintext_fonts = next;
+    }
+    unlock_ttf();
+}
@@ -20,6 +20,7 @@
 #ifndef GIFVIEW_SDLGIF_H
 #define GIFVIEW_SDLGIF_H
 
+#include "tiledtexture.h"
 #include "util.h"
 #include "gif/gif.h"
 
@@ -29,21 +30,132 @@
 /** SDL data for a GIF graphic.  Represents a complete frame of a GIF. */
 struct SDLGraphic
 {
+    /** The frame, or NULL if it's too big for a texture. */
     SDL_Texture *texture;
+    /** The frame, if it's too big for a texture, or NULL. */
+    struct TiledTexture *tiles;
+    /**
+     * The frame as an ARGB8888 surface, for drawing with the software scaler,
+     * or NULL.  Frames that have this don't have a texture or tiles.
+     */
+    SDL_Surface *surface;
     int width, height;
     size_t delay;
+    /**
+     * Whether the frame is drawn from smaller mip levels when zoomed out.
+     * They're built from TEXTURE or TILES when they're first needed.  False
+     * if the frame is too small to need them, or the renderer can't build
+     * them.
+     */
+    bool mipmapped;
+    /** Texture for mip level mip_level, or NULL if none is cached. */
+    SDL_Texture *mip_texture;
+    int mip_level;
+    /**
+     * Earlier frame with the same pixels, which this one is drawn with, or
+     * NULL.  Frames that have this own no texture, tiles, surface or mips.
+     */
+    struct SDLGraphic *same_as;
 };
 
 
 /** LinkedList<SDLGraphic>. */
 typedef LinkedList *GraphicList;
 
+/**
+ * Receives composited frames from sdlgif_composite_frames.  FRAME is an RGBA32
+ * surface which is freed once the callback returns.  DELAY is in 100ths of a
+ * second.
+ */
+typedef void (*FrameCallback)(SDL_Surface *frame, size_t delay, void *userdata);
+
+
+/**
+ * Composite the graphics in GIF into complete frames, passing each one to
+ * ON_FRAME as soon as it's built.  Needs no renderer, so it can be used
+ * headlessly.
+ */
+void sdlgif_composite_frames(GIF gif, FrameCallback on_frame, void *userdata);
+
+/**
+ * Composites frames from graphics handed over one at a time, for GIFs read
+ * with gif_read_begin, so the whole file never has to be held in memory.
+ * Frames are passed to ON_FRAME exactly as sdlgif_composite_frames would.
+ */
+struct SDLGIFCompositor;
 
-/** Generate a linked list of Graphics from a linked list of GIF_Graphics. */
-GraphicList graphiclist_new_from_gif(SDL_Renderer *renderer, GIF gif);
+/**
+ * Create a compositor for frames of GIF, which must outlive it.  GIF's
+ * graphics are ignored.
+ */
+struct SDLGIFCompositor *sdlgif_compositor_new(
+    GIF const *gif, FrameCallback on_frame, void *userdata);
+
+/**
+ * Add GRAPHIC to COMPOSITOR, which takes ownership of it.  Calls ON_FRAME if
+ * GRAPHIC completes a frame.
+ */
+void sdlgif_compositor_add(
+    struct SDLGIFCompositor *compositor, struct GIF_Graphic *graphic);
+
+/**
+ * Build the last frame from any graphics left over, then free COMPOSITOR.
+ * Returns the number of frames built.
+ */
+size_t sdlgif_compositor_finish(struct SDLGIFCompositor *compositor);
+
+/**
+ * Generate a linked list of Graphics from a linked list of GIF_Graphics.  If
+ * SOFTWARE is true, the frames are kept as surfaces for the software scaler
+ * instead of being uploaded.
+ */
+GraphicList graphiclist_new_from_gif(
+    SDL_Renderer *renderer, GIF gif, bool software);
+
+/**
+ * Generate a linked list of Graphics from COUNT frames already composited by
+ * sdlgif_composite_frames (either as they came or packed by indexed_from_rgba),
+ * and their DELAYS.  Frames whose SOURCES entry (see PreparedGIF) isn't their
+ * own index are drawn with that frame's graphic rather than being uploaded
+ * again.  The frames aren't freed.
+ */
+GraphicList graphiclist_new_from_frames(
+    SDL_Renderer *renderer, SDL_Surface *const *frames, size_t const *sources,
+    size_t const *delays, size_t count, bool software);
+
+/**
+ * Draw GRAPHIC to DST at ZOOM.  When zoomed out, this uses the smallest mip
+ * level at least as big as the image on screen, which is built and cached on
+ * first use.  Levels are rendered from the frame's texture by the GPU, or
+ * downscaled from the pixels behind its tiles.  Only one level is cached per
+ * graphic.  Frames too big for a texture are drawn from tiles, unless a mip
+ * level fits.
+ */
+void graphic_draw(
+    struct SDLGraphic *graphic, SDL_Renderer *renderer, SDL_Rect const *dst,
+    double zoom);
+
+/**
+ * Bytes of memory (not counting textures) that GRAPHICS keep: surfaces for the
+ * software scaler, and the pixels behind tiles.
+ */
+size_t graphiclist_resident_bytes(GraphicList graphics);
+
+/**
+ * Forget GRAPHICS' cached mip levels, which are rebuilt when they're next
+ * needed.  Call this when render targets are reset, since the levels are
+ * rendered into them.
+ */
+void graphiclist_drop_mips(GraphicList graphics);
 
 /** Free a linked list of Graphics. */
 void graphiclist_free(GraphicList graphics);
 
+/**
+ * Close the fonts cached for drawing plaintext graphics.  Must be called
+ * before TTF_Quit.
+ */
+void sdlgif_quit(void);
+
 
 #endif /* GIFVIEW_SDLGIF_H */
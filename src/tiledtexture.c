@@ -0,0 +1,257 @@
+/*
+ * tiledtexture.c -- Tiled texture definitions.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "tiledtexture.h"
+#include "indexed.h"
+#include "util.h"
+#include "stats/stats.h"
+#include "stats/trace.h"
+
+#include <math.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+
+/** Most bytes of tiles to keep resident before evicting unused ones. */
+static size_t const TILE_BUDGET_BYTES = (size_t)256 * 1024 * 1024;
+
+
+/** An uploaded tile of a TiledTexture. */
+struct Tile
+{
+    SDL_Texture *texture;
+    struct TiledTexture *owner;
+    /** Index of the tile in OWNER's tiles. */
+    size_t index;
+    size_t bytes;
+    /** Value of resident.draws when the tile was last drawn. */
+    uint64_t last_draw;
+    /** Neighbours in the resident list, most recently drawn first. */
+    struct Tile *prev, *next;
+};
+
+/** All resident tiles, across every TiledTexture. */
+static struct
+{
+    struct Tile *head, *tail;
+    size_t bytes;
+    /** Number of tiledtexture_draw calls so far. */
+    uint64_t draws;
+} resident = {NULL, NULL, 0, 0};
+
+
+/** Remove TILE from the resident list. */
+void _unlink_tile(struct Tile *tile)
+{
+    if (tile->prev)
+        tile->prev->next = tile->next;
+    else
+        resident.head = tile->next;
+    if (tile->next)
+        tile->next->prev = tile->prev;
+    else
+        resident.tail = tile->prev;
+    tile->prev = NULL;
+    tile->next = NULL;
+}
+
+/** Add TILE to the front of the resident list. */
+void _push_tile(struct Tile *tile)
+{
+    tile->prev = NULL;
+    tile->next = resident.head;
+    if (resident.head)
+        resident.head->prev = tile;
+    else
+        resident.tail = tile;
+    resident.head = tile;
+}
+
+/** Evict TILE, freeing its texture. */
+void _evict_tile(struct Tile *tile)
+{
+    _unlink_tile(tile);
+    resident.bytes -= tile->bytes;
+    stats_memory_remove(STATS_MEMORY_FRAME_TEXTURES, tile->bytes);
+    tile->owner->tiles[tile->index] = NULL;
+    SDL_DestroyTexture(tile->texture);
+    free(tile);
+}
+
+/**
+ * Get the resident tile covering SRC, uploading it if needed.  Returns NULL
+ * if the upload fails.
+ */
+struct Tile *_get_tile(
+    struct TiledTexture *tt, SDL_Renderer *renderer, size_t index,
+    SDL_Rect const *src)
+{
+    struct Tile *tile = tt->tiles[index];
+    if (tile)
+        _unlink_tile(tile);
+    else
+    {
+        uint64_t const start = stats_now();
+        SDL_Texture *texture = SDL_CreateTexture(
+            renderer, SDL_PIXELFORMAT_RGBA32, SDL_TEXTUREACCESS_STATIC,
+            src->w, src->h);
+        if (texture == NULL)
+        {
+            error("SDL_CreateTexture -- %s\n", SDL_GetError());
+            return NULL;
+        }
+        if (tt->surface->format->format == SDL_PIXELFORMAT_INDEX8)
+        {
+            size_t const pitch = (size_t)src->w * 4;
+            uint8_t *pixels = malloc(pitch * src->h);
+            indexed_expand_rect(tt->surface, src, pixels, pitch);
+            SDL_UpdateTexture(texture, NULL, pixels, pitch);
+            free(pixels);
+        }
+        else
+        {
+            uint8_t const *const pixels = (
+                (uint8_t const *)tt->surface->pixels
+                + (size_t)src->y * tt->surface->pitch + (size_t)src->x * 4);
+            SDL_UpdateTexture(texture, NULL, pixels, tt->surface->pitch);
+        }
+        SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+
+        tile = malloc(sizeof(*tile));
+        tile->texture = texture;
+        tile->owner = tt;
+        tile->index = index;
+        tile->bytes = (size_t)src->w * src->h * 4;
+        tt->tiles[index] = tile;
+        resident.bytes += tile->bytes;
+
+        stats_stage_end(STATS_STAGE_TEXTURE_UPLOAD, start);
+        trace_span("tile upload", start, TRACE_NO_ARG, tile->bytes);
+        stats_count(STATS_COUNTER_TEXTURES_CREATED, 1);
+        stats_count(STATS_COUNTER_TEXTURE_BYTES, tile->bytes);
+        stats_memory_add(STATS_MEMORY_FRAME_TEXTURES, tile->bytes);
+    }
+    tile->last_draw = resident.draws;
+    _push_tile(tile);
+    return tile;
+}
+
+/**
+ * Get the range of tiles [*FIRST, *LAST] along an axis of SIZE pixels, drawn
+ * at OFFSET with SCALE, which overlap an output of OUTPUT pixels.
+ */
+void _visible_tiles(
+    int size, int offset, double scale, int output, int *first, int *last)
+{
+    int const tile = TILEDTEXTURE_TILE_SIZE;
+    int const count = (size + tile - 1) / tile;
+    double const start = floor(-offset / scale / tile);
+    double const end = floor((output - offset) / scale / tile);
+    *first = start < 0? 0 : start < count? (int)start : count;
+    *last = end >= count? count - 1 : end < 0? -1 : (int)end;
+}
+
+
+struct TiledTexture *tiledtexture_new(SDL_Surface *surface)
+{
+    struct TiledTexture *tt = malloc(sizeof(*tt));
+    tt->surface = indexed_from_rgba(surface);
+    if (tt->surface == NULL)
+        tt->surface = SDL_DuplicateSurface(surface);
+    if (tt->surface == NULL)
+        fatal("SDL_DuplicateSurface -- %s\n", SDL_GetError());
+    stats_memory_add(
+        STATS_MEMORY_SURFACES, (size_t)tt->surface->pitch * tt->surface->h);
+    tt->columns = (
+        (surface->w + TILEDTEXTURE_TILE_SIZE - 1) / TILEDTEXTURE_TILE_SIZE);
+    tt->rows = (
+        (surface->h + TILEDTEXTURE_TILE_SIZE - 1) / TILEDTEXTURE_TILE_SIZE);
+    tt->tiles = calloc((size_t)tt->columns * tt->rows, sizeof(*tt->tiles));
+    return tt;
+}
+
+void tiledtexture_free(struct TiledTexture *tt)
+{
+    for (size_t i = 0; i < (size_t)tt->columns * tt->rows; ++i)
+        if (tt->tiles[i])
+            _evict_tile(tt->tiles[i]);
+    stats_memory_remove(
+        STATS_MEMORY_SURFACES, (size_t)tt->surface->pitch * tt->surface->h);
+    SDL_FreeSurface(tt->surface);
+    free(tt->tiles);
+    free(tt);
+}
+
+void tiledtexture_draw(
+    struct TiledTexture *tt, SDL_Renderer *renderer, SDL_Rect const *dst)
+{
+    if (dst->w <= 0 || dst->h <= 0)
+        return;
+    resident.draws++;
+
+    int output_w, output_h;
+    SDL_GetRendererOutputSize(renderer, &output_w, &output_h);
+    double const scale_x = (double)dst->w / tt->surface->w;
+    double const scale_y = (double)dst->h / tt->surface->h;
+    int first_column, last_column, first_row, last_row;
+    _visible_tiles(
+        tt->surface->w, dst->x, scale_x, output_w, &first_column, &last_column);
+    _visible_tiles(
+        tt->surface->h, dst->y, scale_y, output_h, &first_row, &last_row);
+
+    for (int row = first_row; row <= last_row; ++row)
+    {
+        for (int column = first_column; column <= last_column; ++column)
+        {
+            SDL_Rect src = {
+                .x = column * TILEDTEXTURE_TILE_SIZE,
+                .y = row * TILEDTEXTURE_TILE_SIZE,
+            };
+            src.w = tt->surface->w - src.x;
+            src.h = tt->surface->h - src.y;
+            if (src.w > TILEDTEXTURE_TILE_SIZE)
+                src.w = TILEDTEXTURE_TILE_SIZE;
+            if (src.h > TILEDTEXTURE_TILE_SIZE)
+                src.h = TILEDTEXTURE_TILE_SIZE;
+
+            /* Round both edges the same way, so neighbouring tiles meet
+             * without gaps. */
+            int const x0 = dst->x + (int)floor(src.x * scale_x);
+            int const y0 = dst->y + (int)floor(src.y * scale_y);
+            int const x1 = dst->x + (int)floor((src.x + src.w) * scale_x);
+            int const y1 = dst->y + (int)floor((src.y + src.h) * scale_y);
+            SDL_Rect const to = {x0, y0, x1 - x0, y1 - y0};
+            if (to.w <= 0 || to.h <= 0)
+                continue;
+
+            size_t const index = (size_t)row * tt->columns + column;
+            struct Tile *const tile = _get_tile(tt, renderer, index, &src);
+            if (tile)
+                SDL_RenderCopy(renderer, tile->texture, NULL, &to);
+        }
+    }
+
+    /* Tiles drawn just now are all at the front, so this never evicts one
+     * that's still on screen. */
+    while (
+        resident.bytes > TILE_BUDGET_BYTES
+        && resident.tail
+        && resident.tail->last_draw != resident.draws)
+        _evict_tile(resident.tail);
+}
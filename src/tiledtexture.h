@@ -0,0 +1,69 @@
+/*
+ * tiledtexture.h -- Tiled texture declarations.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFVIEW_TILEDTEXTURE_H
+#define GIFVIEW_TILEDTEXTURE_H
+
+#include <SDL2/SDL.h>
+
+
+/** Size (in pixels) of the sides of a tile. */
+#define TILEDTEXTURE_TILE_SIZE  1024
+
+/** A resident tile.  Defined in tiledtexture.c. */
+struct Tile;
+
+/**
+ * An image too big to fit in a single texture.  The pixels stay in memory,
+ * and square tiles of them are uploaded when they're first drawn.  Tiles that
+ * haven't been drawn recently are evicted once all TiledTextures' resident
+ * tiles go over a memory budget.
+ */
+struct TiledTexture
+{
+    /**
+     * Pixels of the whole image.  INDEX8 if they fit in 256 colors, which
+     * are expanded to RGBA32 as tiles are uploaded, otherwise RGBA32.
+     */
+    SDL_Surface *surface;
+    /** Number of tile columns and rows. */
+    int columns, rows;
+    /** Tiles, indexed by row * columns + column.  NULL if not resident. */
+    struct Tile **tiles;
+};
+
+
+/**
+ * Create a TiledTexture from a copy of the RGBA32 surface SURFACE.  The copy
+ * is kept as 8-bit indices if SURFACE has no more than 256 colors.
+ */
+struct TiledTexture *tiledtexture_new(SDL_Surface *surface);
+
+/** Free a TiledTexture, along with any resident tiles. */
+void tiledtexture_free(struct TiledTexture *tt);
+
+/**
+ * Draw TT stretched to DST, uploading any visible tiles that aren't resident.
+ * Tiles outside the renderer's output are skipped.
+ */
+void tiledtexture_draw(
+    struct TiledTexture *tt, SDL_Renderer *renderer, SDL_Rect const *dst);
+
+
+#endif /* GIFVIEW_TILEDTEXTURE_H */
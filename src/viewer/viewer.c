@@ -72,7 +72,7 @@ void viewer_quit(struct Viewer *v)
     v->running = false;
 }
 
-bool viewer_should_timer_increment(struct Viewer *v)
+bool viewer_should_timer_increment(struct Viewer const *v)
 {
     if (v->paused)
         return false;
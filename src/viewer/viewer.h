@@ -80,7 +80,7 @@ void viewer_shift_left(struct Viewer *v);
 void viewer_quit(struct Viewer *v);
 
 /** Return true if the timer should be allowed to increment, false otherwise. */
-bool viewer_should_timer_increment(struct Viewer *v);
+bool viewer_should_timer_increment(struct Viewer const *v);
 
 
 #endif /* GIFVIEW_VIEWER_H */
@@ -0,0 +1,260 @@
+/*
+ * yuv.c -- RGB to YUV conversion definitions.
+ *
+ * All arithmetic is done in 16-bit integers, so the SSE2 and scalar paths
+ * produce identical output:
+ *
+ *   Y = ((  66 R + 129 G +  25 B + 128) >> 8) +  16
+ *   U = (( -38 R -  74 G + 112 B + 128) >> 8) + 128
+ *   V = (( 112 R -  94 G -  18 B + 128) >> 8) + 128
+ *
+ * where U and V are computed from the rounded average of each 2x2 block.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#include "yuv.h"
+
+#if __SSE2__
+#include <emmintrin.h>
+#endif
+
+
+/** Get the RGB of an RGBA pixel, with transparent pixels made black. */
+void _rgb(uint8_t const *pixel, int *r, int *g, int *b)
+{
+    int const opaque = pixel[3] != 0;
+    *r = pixel[0] * opaque;
+    *g = pixel[1] * opaque;
+    *b = pixel[2] * opaque;
+}
+
+uint8_t _luma(int r, int g, int b)
+{
+    return ((66 * r + 129 * g + 25 * b + 128) >> 8) + 16;
+}
+
+uint8_t _chroma_u(int r, int g, int b)
+{
+    return ((-38 * r - 74 * g + 112 * b + 128) >> 8) + 128;
+}
+
+uint8_t _chroma_v(int r, int g, int b)
+{
+    return ((112 * r - 94 * g - 18 * b + 128) >> 8) + 128;
+}
+
+/** Convert pixels [X0, WIDTH) of a row to luma. */
+void _luma_row_scalar(uint8_t const *row, int x0, int width, uint8_t *out)
+{
+    for (int x = x0; x < width; ++x)
+    {
+        int r, g, b;
+        _rgb(row + 4 * x, &r, &g, &b);
+        out[x] = _luma(r, g, b);
+    }
+}
+
+/**
+ * Convert chroma samples [CX0, (WIDTH+1)/2) from the 2x2 blocks spanning ROW0
+ * and ROW1.  The last column is repeated if WIDTH is odd.
+ */
+void _chroma_row_scalar(
+    uint8_t const *row0, uint8_t const *row1, int cx0, int width,
+    uint8_t *u, uint8_t *v)
+{
+    for (int cx = cx0; cx < (width + 1) / 2; ++cx)
+    {
+        int const x0 = 2 * cx;
+        int const x1 = x0 + 1 < width? x0 + 1 : x0;
+        int r = 0, g = 0, b = 0;
+        uint8_t const *const pixels[4] = {
+            row0 + 4 * x0, row0 + 4 * x1, row1 + 4 * x0, row1 + 4 * x1
+        };
+        for (int i = 0; i < 4; ++i)
+        {
+            int pr, pg, pb;
+            _rgb(pixels[i], &pr, &pg, &pb);
+            r += pr;
+            g += pg;
+            b += pb;
+        }
+        r = (r + 2) >> 2;
+        g = (g + 2) >> 2;
+        b = (b + 2) >> 2;
+        u[cx] = _chroma_u(r, g, b);
+        v[cx] = _chroma_v(r, g, b);
+    }
+}
+
+
+#if __SSE2__
+/**
+ * Split 8 RGBA pixels into 16-bit R, G and B vectors, with transparent pixels
+ * made black.
+ */
+void _unpack8_sse2(
+    uint8_t const *pixels, __m128i *r, __m128i *g, __m128i *b)
+{
+    __m128i const zero = _mm_setzero_si128();
+    __m128i const byte = _mm_set1_epi32(0xFF);
+    __m128i lo = _mm_loadu_si128((__m128i const *)pixels);
+    __m128i hi = _mm_loadu_si128((__m128i const *)(pixels + 16));
+    lo = _mm_andnot_si128(
+        _mm_cmpeq_epi32(_mm_srli_epi32(lo, 24), zero), lo);
+    hi = _mm_andnot_si128(
+        _mm_cmpeq_epi32(_mm_srli_epi32(hi, 24), zero), hi);
+    *r = _mm_packs_epi32(_mm_and_si128(lo, byte), _mm_and_si128(hi, byte));
+    *g = _mm_packs_epi32(
+        _mm_and_si128(_mm_srli_epi32(lo, 8), byte),
+        _mm_and_si128(_mm_srli_epi32(hi, 8), byte));
+    *b = _mm_packs_epi32(
+        _mm_and_si128(_mm_srli_epi32(lo, 16), byte),
+        _mm_and_si128(_mm_srli_epi32(hi, 16), byte));
+}
+
+/** Convert as many whole groups of 8 pixels of a row as fit.  */
+int _luma_row_sse2(uint8_t const *row, int width, uint8_t *out)
+{
+    __m128i const kr = _mm_set1_epi16(66);
+    __m128i const kg = _mm_set1_epi16(129);
+    __m128i const kb = _mm_set1_epi16(25);
+    __m128i const round = _mm_set1_epi16(128);
+    __m128i const offset = _mm_set1_epi16(16);
+
+    int x = 0;
+    for (; x + 8 <= width; x += 8)
+    {
+        __m128i r, g, b;
+        _unpack8_sse2(row + 4 * x, &r, &g, &b);
+        /* At most 220 * 255 + 128, which fits unsigned 16-bit. */
+        __m128i sum = _mm_add_epi16(
+            _mm_add_epi16(_mm_mullo_epi16(r, kr), _mm_mullo_epi16(g, kg)),
+            _mm_add_epi16(_mm_mullo_epi16(b, kb), round));
+        __m128i const luma = _mm_add_epi16(_mm_srli_epi16(sum, 8), offset);
+        _mm_storel_epi64(
+            (__m128i *)(out + x), _mm_packus_epi16(luma, luma));
+    }
+    return x;
+}
+
+/** Sum adjacent pairs of 16-bit lanes in A and B, giving 8 sums. */
+__m128i _pair_sums_sse2(__m128i a, __m128i b)
+{
+    __m128i const ones = _mm_set1_epi16(1);
+    return _mm_packs_epi32(_mm_madd_epi16(a, ones), _mm_madd_epi16(b, ones));
+}
+
+/**
+ * Convert as many whole groups of 8 chroma samples (16 pixels) as fit.
+ * Returns the number of chroma samples done.
+ */
+int _chroma_row_sse2(
+    uint8_t const *row0, uint8_t const *row1, int width,
+    uint8_t *u, uint8_t *v)
+{
+    __m128i const two = _mm_set1_epi16(2);
+    __m128i const round = _mm_set1_epi16(128);
+    __m128i const offset = _mm_set1_epi16(128);
+
+    int cx = 0;
+    for (; 2 * cx + 16 <= width; cx += 8)
+    {
+        uint8_t const *const p0 = row0 + 8 * cx;
+        uint8_t const *const p1 = row1 + 8 * cx;
+        __m128i r0a, g0a, b0a, r0b, g0b, b0b, r1a, g1a, b1a, r1b, g1b, b1b;
+        _unpack8_sse2(p0, &r0a, &g0a, &b0a);
+        _unpack8_sse2(p0 + 32, &r0b, &g0b, &b0b);
+        _unpack8_sse2(p1, &r1a, &g1a, &b1a);
+        _unpack8_sse2(p1 + 32, &r1b, &g1b, &b1b);
+
+        /* Average each 2x2 block. */
+        __m128i const r = _mm_srli_epi16(_mm_add_epi16(_pair_sums_sse2(
+            _mm_add_epi16(r0a, r1a), _mm_add_epi16(r0b, r1b)), two), 2);
+        __m128i const g = _mm_srli_epi16(_mm_add_epi16(_pair_sums_sse2(
+            _mm_add_epi16(g0a, g1a), _mm_add_epi16(g0b, g1b)), two), 2);
+        __m128i const b = _mm_srli_epi16(_mm_add_epi16(_pair_sums_sse2(
+            _mm_add_epi16(b0a, b1a), _mm_add_epi16(b0b, b1b)), two), 2);
+
+        /* Each term is at most 112 * 255 in magnitude, so the sums fit
+         * signed 16-bit. */
+        __m128i const su = _mm_add_epi16(
+            _mm_sub_epi16(
+                _mm_mullo_epi16(b, _mm_set1_epi16(112)),
+                _mm_add_epi16(
+                    _mm_mullo_epi16(r, _mm_set1_epi16(38)),
+                    _mm_mullo_epi16(g, _mm_set1_epi16(74)))),
+            round);
+        __m128i const sv = _mm_add_epi16(
+            _mm_sub_epi16(
+                _mm_mullo_epi16(r, _mm_set1_epi16(112)),
+                _mm_add_epi16(
+                    _mm_mullo_epi16(g, _mm_set1_epi16(94)),
+                    _mm_mullo_epi16(b, _mm_set1_epi16(18)))),
+            round);
+        __m128i const cu = _mm_add_epi16(_mm_srai_epi16(su, 8), offset);
+        __m128i const cv = _mm_add_epi16(_mm_srai_epi16(sv, 8), offset);
+        _mm_storel_epi64((__m128i *)(u + cx), _mm_packus_epi16(cu, cu));
+        _mm_storel_epi64((__m128i *)(v + cx), _mm_packus_epi16(cv, cv));
+    }
+    return cx;
+}
+#endif
+
+
+void yuv420_from_rgba(
+    uint8_t const *restrict rgba, size_t pitch, int width, int height,
+    uint8_t *restrict y, uint8_t *restrict u, uint8_t *restrict v)
+{
+#if __SSE2__
+    int const chroma_width = (width + 1) / 2;
+    for (int row = 0; row < height; ++row)
+    {
+        uint8_t const *const in = rgba + row * pitch;
+        uint8_t *const out = y + (size_t)row * width;
+        _luma_row_scalar(in, _luma_row_sse2(in, width, out), width, out);
+    }
+    for (int row = 0; row < height; row += 2)
+    {
+        uint8_t const *const row0 = rgba + row * pitch;
+        uint8_t const *const row1 = row + 1 < height? row0 + pitch : row0;
+        uint8_t *const out_u = u + (size_t)(row / 2) * chroma_width;
+        uint8_t *const out_v = v + (size_t)(row / 2) * chroma_width;
+        int const done = _chroma_row_sse2(row0, row1, width, out_u, out_v);
+        _chroma_row_scalar(row0, row1, done, width, out_u, out_v);
+    }
+#else
+    yuv420_from_rgba_scalar(rgba, pitch, width, height, y, u, v);
+#endif
+}
+
+void yuv420_from_rgba_scalar(
+    uint8_t const *restrict rgba, size_t pitch, int width, int height,
+    uint8_t *restrict y, uint8_t *restrict u, uint8_t *restrict v)
+{
+    int const chroma_width = (width + 1) / 2;
+    for (int row = 0; row < height; ++row)
+        _luma_row_scalar(rgba + row * pitch, 0, width, y + (size_t)row * width);
+    for (int row = 0; row < height; row += 2)
+    {
+        uint8_t const *const row0 = rgba + row * pitch;
+        uint8_t const *const row1 = row + 1 < height? row0 + pitch : row0;
+        _chroma_row_scalar(
+            row0, row1, 0, width,
+            u + (size_t)(row / 2) * chroma_width,
+            v + (size_t)(row / 2) * chroma_width);
+    }
+}
@@ -0,0 +1,44 @@
+/*
+ * yuv.h -- RGB to YUV conversion declarations.
+ *
+ * Copyright (C) 2023 Trevor Last
+ *
+ * This program is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation, either version 3 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+#ifndef GIFVIEW_YUV_H
+#define GIFVIEW_YUV_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+
+/**
+ * Convert a WIDTH x HEIGHT RGBA32 image, with rows PITCH bytes apart, to
+ * planar 4:2:0 YUV using limited-range BT.601 coefficients.  Fully
+ * transparent pixels become black.  Y must hold WIDTH*HEIGHT bytes, while U
+ * and V must each hold ((WIDTH+1)/2) * ((HEIGHT+1)/2) bytes.  Uses SSE2 where
+ * available, which gives the same output as yuv420_from_rgba_scalar.
+ */
+void yuv420_from_rgba(
+    uint8_t const *restrict rgba, size_t pitch, int width, int height,
+    uint8_t *restrict y, uint8_t *restrict u, uint8_t *restrict v);
+
+/** Portable version of yuv420_from_rgba. */
+void yuv420_from_rgba_scalar(
+    uint8_t const *restrict rgba, size_t pitch, int width, int height,
+    uint8_t *restrict y, uint8_t *restrict u, uint8_t *restrict v);
+
+
+#endif /* GIFVIEW_YUV_H */